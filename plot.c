@@ -3,7 +3,30 @@
  ***********************************************************************/
 
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
+#ifdef INSTRUMENT
+#include <signal.h>
+#endif
+#include <float.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) && defined(__linux__) && !defined(NO_JIT)
+#define HAVE_JIT 1
+#endif
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
 
 /********************PRE AND POST CONDITIONS********************/
 
@@ -28,6 +51,15 @@ float get_x (int index, float x_scale, float x_shift);
 */
 void cosine (float values[], size_t len, float x_scale, float x_shift);
 
+/* Procedure to fill the elements begin to end - 1 of values[] with cos(x), using the absolute index for get_x.*/
+/* Pre-conditions: values[] is an array of float values with atleast end elements.
+                   begin and end are unsigned integers, begin <= end.
+                   x_scale is a float which is a scale factor of the transformation.
+                   x_shift is a float which is the shift of the transformation.
+* Post-conditions: replaces values[i] for begin <= i < end with cos(get_x(i, x_scale, x_shift)), as cosine() would.
+*/
+void cosine_span (float values[], size_t begin, size_t end, float x_scale, float x_shift);
+
 /* Procedure to raise x to the desired power.*/
 /* Pre-conditions: value_of_x_after_transformation is a float, the value after applying get_x to a given variable. 
                    j is a positive integer. 
@@ -35,7 +67,8 @@ void cosine (float values[], size_t len, float x_scale, float x_shift);
 */
 float power_function (float value_of_x_after_transformation, int j);
 
-/* Procedure to find the value of f(x) of a given x, where f(x) is a polynomial function.*/
+/* Procedure to find the value of f(x) of a given x, where f(x) is a polynomial function, by summing powers of x.*/
+/* Kept as the reference for polynomial_eval(), which polynomial() uses.*/
 /* Pre-conditions: coeffs[] is an array of floats of the coefficients of the polynomial function, length of coeffs[] = 1 + degree.
                    degree is an unsigned positive integer of the degree of the polynomial, degre <= 3.
                    value_of_x_after_transformation is a float, the value after applying get_x to a given variable. 
@@ -45,12 +78,12 @@ float f_of_x_of_polynomial (float coeffs[], size_t degree, float value_of_x_afte
 
 /* Procedure to fill the given array values[] with the values of f(x) for each x, where f(x) is a polynomial function.*/
 /* Pre-conditions: coeffs[] is an array of floats of the coefficients of the polynomial function, length of coeffs[] = 1 + degree.
-                   degree is an unsigned positive integer of the degree of the polynomial, degre <= 3.
+                   degree is an unsigned positive integer of the degree of the polynomial, with no upper bound.
                    values[] is an array of float values with atleast one element. 
                    len is an unsigned positive integer where len <= length of values[].
                    x_scale is a float which is a scale factor of the transformation.
                    x_shift is a float which is the shift of the transformation.        
-* Post-conditions: updates values[] with the polynomial function applied to the transformed domain.
+* Post-conditions: updates values[] with the polynomial function applied to the transformed domain, in Horner form.
 */
 void polynomial (float coeffs[], size_t degree, float values[], size_t len, float x_scale, float x_shift);
 
@@ -61,7 +94,7 @@ void polynomial (float coeffs[], size_t degree, float values[], size_t len, floa
                    p_min is a pointer which points to a variable, which stores the min of the array as a float. 
 * Post-conditions: has the effect of changing the values of *p_max and *p_min to the max and the min of the array.
 */
-void range (float values[], size_t len, float * p_max, float * p_min);
+void range (const float values[], size_t len, float * p_max, float * p_min);
 
 /* Procedure to returns the discrete quantum between 0 and levels-1 of given values.*/
 /* Pre-conditions: value is a double, min <= value <= max. 
@@ -69,6 +102,8 @@ void range (float values[], size_t len, float * p_max, float * p_min);
                    min is any float, where max > min. 
                    max is any float, where max > min. 
 * Post-conditions: returns a positive integer < levels, the level at which the value lies. 
+                   When max == min every value is at level 0. A NaN or infinite value, or one so far outside
+                   min and max that its level is not an int, is at level -1, which no plot draws.
 */
 int quantize (double value, int levels, float min, float max);
 
@@ -88,542 +123,7912 @@ void scale (const float values[], int scaled[], size_t len, size_t height, float
                    symbol is a single character such as 'x' or 'o'
                    len is an unsigned positive integer where len <= length of values[].
                    height is a positive, non-zero integer.
-* Post-conditions: prints the graph within the desired dimensions.
+* Post-conditions: prints the graph within the desired dimensions. When there is no memory for the levels,
+                   prints nothing and says so on stderr.
 */
 void plot (const float values[], char symbol, int len, int height);
 
-/***************************** TESTING *****************************/
-
-/* Print a report of a collection of unit tests.
- * Prints OK when no errors and FAIL with a count otherwise.
- */
-void
-reportTests (int numErrors)
-{
-  if (numErrors>0)
-    printf (" FAIL: %d errors\n",numErrors);
-  else
-    printf (" OK\n");
-} // reportTests
-/* Test all functionality by running test functions.
- * Returns the total number of errors.
+/* Procedure to draw the quantized levels of a function into a character frame, one pass over scaled[].*/
+/* Pre-conditions: scaled[] is an array of integers of the quantized values, as filled by scale().
+                   symbol is a single character such as 'x' or 'o'.
+                   len is a positive integer where len <= length of scaled[].
+                   height is a positive, non-zero integer.
+                   frame[] is an array of characters with atleast height * (len + 1) elements.
+* Post-conditions: frame[] holds height rows of len characters each followed by '\n', top row first,
+                   the same bytes plot() would print. Levels outside 0..height-1 are left blank.
 */
+void fill_frame (const int scaled[], char symbol, int len, int height, char frame[]);
 
-/* Tests for get_x(). */
-int
-testGetX (void)
-{
-  int numErrors = 0;
-  printf ("--GETX TESTS--");
-
-  /* Testing small positive numbers. */
-  FTEST(-0.00001, get_x(1, 0.00001, 0.00002), 0.0000001);
-  FTEST(0.00008, get_x(2, 0.00005, 0.00002), 0.0000001); 
+/* Procedure to plot the points of a function through a frame, written with a single fwrite.*/
+/* Pre-conditions: values[] is an array of float values with atleast one element.
+                   symbol is a single character such as 'x' or 'o'.
+                   len is a positive integer where len <= length of values[].
+                   height is a positive, non-zero integer.
+                   scaled[] is an array of integers with atleast len elements, used as scratch.
+                   frame[] is an array of characters with atleast height * (len + 1) elements.
+* Post-conditions: prints the same graph as plot(), using scaled[] and frame[] instead of the stack.
+*/
+void plot_buffered (const float values[], char symbol, int len, int height, int scaled[], char frame[]);
 
-  /* Testing average sized positive numbers. */
-  FTEST(40, get_x(5, 10, 10), 0.0000001);
-  FTEST(-16, get_x(4, 6, 40), 0.0000001); 
+/* Kernels the batch evaluators can run on, from slowest to widest. */
+enum batch_kernel { KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2 };
 
-  /* Testing big positive numbers. */
-  FTEST(499925500, get_x(10000, 50000.55, 80000), 0.0000001);
-  FTEST(-100000000, get_x(2000, 200000, 500000000), 0.0000001);  
+/* Procedure to choose the kernel used by cosine_batch() and polynomial_batch().*/
+/* Pre-conditions: requested is the widest kernel the caller wants to allow.
+* Post-conditions: returns the kernel now in use, the widest one the CPU supports that is not wider than requested.
+                   Without a call the widest supported kernel is picked on first use.
+*/
+enum batch_kernel batch_kernel_select (enum batch_kernel requested);
 
-  /* Testing zeros. */
-  FTEST(0, get_x(0, 0.0, 0.0), 0.0000001);
+/* Largest |x| cosine_approx() and the batch cosine are accurate for. */
+#define COSINE_APPROX_LIMIT 8192
 
-  /* Testing small negative numbers. */
-  FTEST(-0.00003, get_x(-1, 0.00001, 0.00002), 0.0000001);
+/* Procedure to approximate cos(x) in float with range reduction and a minimax polynomial.*/
+/* Pre-conditions: x is a float with |x| <= COSINE_APPROX_LIMIT.
+* Post-conditions: returns cos(x) with an absolute error of at most 1e-7 and at most 2 ULP
+                   where |cos(x)| >= 2^-10, measured against double cos().
+*/
+float cosine_approx (float x);
 
-  FTEST(-0.00001, get_x(-1, -0.00001, 0.00002), 0.0000001);
-  FTEST(0.00006, get_x(-1, -0.00008, 0.00002), 0.0000001);
+/* Procedure to fill values[] with cos(x) like cosine(), several elements at a time.*/
+/* Pre-conditions: values[] is an array of float values with atleast one element.
+                   len is an unsigned positive integer where len <= length of values[].
+                   x_scale is a float which is a scale factor of the transformation.
+                   x_shift is a float which is the shift of the transformation, |get_x(i, x_scale, x_shift)| <= COSINE_APPROX_LIMIT.
+* Post-conditions: replaces first 'len' elements of values[] with cosine_approx(get_x(i, x_scale, x_shift)),
+                   8 at a time with AVX2, 4 at a time with SSE, one at a time otherwise.
+*/
+void cosine_batch (float values[], size_t len, float x_scale, float x_shift);
 
-  FTEST(0.00001, get_x(-1, 0.00001, -0.00002), 0.0000001);
-  FTEST(-0.00006, get_x(-1, 0.00008, -0.00002), 0.0000001);
+/* Procedure to fill values[] with a polynomial like polynomial(), several elements at a time.*/
+/* Pre-conditions: coeffs[] is an array of floats of the coefficients of the polynomial function, length of coeffs[] = 1 + degree.
+                   degree is an unsigned integer of the degree of the polynomial.
+                   values[] is an array of float values with atleast one element.
+                   len is an unsigned positive integer where len <= length of values[].
+                   x_scale is a float which is a scale factor of the transformation.
+                   x_shift is a float which is the shift of the transformation.
+* Post-conditions: updates values[] with the polynomial evaluated in Horner form on the transformed domain,
+                   8 at a time with AVX2, 4 at a time with SSE, one at a time otherwise.
+*/
+void polynomial_batch (const float coeffs[], size_t degree, float values[], size_t len, float x_scale, float x_shift);
 
-  FTEST(0.00003, get_x(-1, -0.00001, -0.00002), 0.0000001);
+/* Ways polynomial_eval() can evaluate a polynomial. POLY_FORWARD steps over a whole grid in polynomial_with(), at the
+   exact x = i * x_scale - x_shift in double rather than at the float get_x(i), so its samples can differ from the
+   other methods' by the slope times the rounding of get_x. */
+enum poly_method { POLY_HORNER, POLY_ESTRIN, POLY_COMPENSATED, POLY_FORWARD };
 
-  FTEST(-0.00003, get_x(1, -0.00001, 0.00002), 0.0000001);
+/* Samples between re-anchorings of POLY_FORWARD, and the interleaved streams it runs. */
+#define FORWARD_ANCHOR 1024
+#define FORWARD_LANES 8
+/* Highest degree POLY_FORWARD takes: the rounding of the d-th difference reaches the values multiplied by about
+   C(steps, d), which for the 128 steps of a lane between anchors stays below float precision only up to 4. */
+#define FORWARD_MAX_DEGREE 4
 
-  FTEST(0.00003, get_x(1, 0.00001, -0.00002), 0.0000001);
+/* Coefficients POLY_ESTRIN combines in one tree, a power of 2; higher degrees chain the trees by Horner's rule. */
+#define ESTRIN_CHUNK 32
 
-  FTEST(0.00001, get_x(1, -0.00001, -0.00002), 0.0000001);
-  FTEST(-0.00006, get_x(1, -0.00008, -0.00002), 0.0000001);
+/* Procedure to find the value of f(x) of a given x for a polynomial of any degree.*/
+/* Pre-conditions: coeffs[] is an array of floats of the coefficients of the polynomial function, length of coeffs[] = 1 + degree.
+                   degree is an unsigned integer of the degree of the polynomial, with no upper bound.
+                   x is a float, the value after applying get_x to a given variable.
+                   method is POLY_HORNER for one multiply and add per coefficient,
+                   POLY_ESTRIN for independent pairs that can run in parallel in the pipeline, in trees of
+                   ESTRIN_CHUNK coefficients so any degree runs in a fixed scratch on the stack,
+                   or POLY_COMPENSATED for Horner with the rounding error of each step carried along with fmaf.
+                   POLY_FORWARD, which needs a whole grid, is Horner for a single x.
+* Post-conditions: returns a float, the value of the polynomial at x. POLY_COMPENSATED is about as accurate
+                   as Horner evaluated in twice the precision and rounded to float.
+*/
+float polynomial_eval (const float coeffs[], size_t degree, float x, enum poly_method method);
 
-  /* Testing average sized negative numbers. */
-  FTEST(-3, get_x(-1, 1, 2), 0.0000001);
+/* Procedure to fill the given array values[] with a polynomial of any degree, evaluated with the given method.*/
+/* Pre-conditions: coeffs[] is an array of floats of the coefficients of the polynomial function, length of coeffs[] = 1 + degree.
+                   degree is an unsigned integer of the degree of the polynomial.
+                   values[] is an array of float values with atleast one element.
+                   len is an unsigned positive integer where len <= length of values[].
+                   x_scale is a float which is a scale factor of the transformation.
+                   x_shift is a float which is the shift of the transformation.
+                   method is one of the methods of polynomial_eval(), or POLY_FORWARD.
+* Post-conditions: updates values[i] with polynomial_eval(coeffs, degree, get_x(i, x_scale, x_shift), method).
+                   POLY_FORWARD instead steps FORWARD_LANES interleaved forward difference tables in double, one
+                   addition per degree for each sample and no multiply, starting them again from Horner's rule every
+                   FORWARD_ANCHOR samples so the drift cannot build up. Its values are the polynomial at
+                   i * x_scale - x_shift in double, rounded to float. Degrees over FORWARD_MAX_DEGREE use Horner.
+*/
+void polynomial_with (const float coeffs[], size_t degree, float values[], size_t len,
+                      float x_scale, float x_shift, enum poly_method method);
 
-  FTEST(-1, get_x(-1, -1, 2), 0.0000001);
-  FTEST(6, get_x(-1, -8, 2), 0.0000001);
+/* Number of floats in a 64-byte cache line; parallel chunks start at indices that are multiples of it. */
+#define CACHE_LINE_FLOATS 16
+/* Most threads the pool will run, counting the calling thread. */
+#define MAX_THREADS 64
 
-  FTEST(1, get_x(-1, 1, -2), 0.0000001);
-  FTEST(-6, get_x(-1, 8, -2), 0.0000001);
+/* Procedure to set how many threads the parallel procedures use, counting the calling thread.*/
+/* Pre-conditions: count is an integer, 0 or less meaning one per online processor.
+                   No parallel procedure is running.
+* Post-conditions: starts or joins pool workers so count - 1 of them wait for work, count capped at MAX_THREADS.
+                   Returns the thread count now in use. A count of 1 runs everything on the calling thread.
+*/
+int set_thread_count (int count);
 
-  FTEST(3, get_x(-1, -1, -2), 0.0000001);
+/* Procedure to run task over [0, len) split into chunks shared between the calling thread and the pool.*/
+/* Pre-conditions: len is an unsigned integer.
+                   task is a procedure which handles the elements begin to end - 1, given context.
+                   context is passed unchanged to every call of task.
+* Post-conditions: task has been called on disjoint chunks covering [0, len). Each chunk starts at an index that
+                   is a multiple of CACHE_LINE_FLOATS, so chunks of a float array that starts on a 64-byte boundary
+                   never share a cache line; an array from malloc() may not, and then neighbours share one line.
+                   Returns when all are done.
+*/
+void parallel_for (size_t len, void (*task) (void * context, size_t begin, size_t end), void * context);
 
-  FTEST(-3, get_x(1, -1, 2), 0.0000001);
+/* Procedure to fill values[] like cosine(), with the pool splitting the indices.*/
+/* Pre-conditions: same as cosine().
+* Post-conditions: values[] holds exactly what cosine() would store.
+*/
+void cosine_parallel (float values[], size_t len, float x_scale, float x_shift);
 
-  FTEST(3, get_x(1, 1, -2), 0.0000001);
+/* Procedure to fill values[] like polynomial(), with the pool splitting the indices.*/
+/* Pre-conditions: same as polynomial().
+* Post-conditions: values[] holds exactly what polynomial() would store.
+*/
+void polynomial_parallel (const float coeffs[], size_t degree, float values[], size_t len, float x_scale, float x_shift);
 
-  FTEST(1, get_x(1, -1, -2), 0.0000001);
-  FTEST(-6, get_x(1, -8, -2), 0.0000001);
+/* Procedure to find the max and min of values[] like range(), each chunk reducing its own part.*/
+/* Pre-conditions: same as range().
+* Post-conditions: *p_max and *p_min hold the same max and min range() would find.
+*/
+void range_parallel (const float values[], size_t len, float * p_max, float * p_min);
 
-  /* Testing big negative numbers. */
-  FTEST(-100020000, get_x(-10000, 10000, 20000), 0.0000001);
+/* Procedure to quantize values[] into scaled[] like scale(), with the pool splitting the indices.*/
+/* Pre-conditions: same as scale().
+* Post-conditions: scaled[] holds exactly what scale() would store.
+*/
+void scale_parallel (const float values[], int scaled[], size_t len, size_t height, float min, float max);
 
-  FTEST(-100000, get_x(-100, -1000, 200000), 0.0000001);
-  FTEST(800000, get_x(-100, -10000, 200000), 0.0000001);
+/* Functions the generic procedures can evaluate. */
+enum function_kind { FUNCTION_COSINE, FUNCTION_POLYNOMIAL };
 
-  FTEST(100000, get_x(-100, 1000, -200000), 0.0000001);
-  FTEST(-800000, get_x(-100, 10000, -200000), 0.0000001);
+/* A function to plot: cos(x), or the polynomial with coeffs[0..degree]. */
+struct function_spec
+{
+    enum function_kind kind;
+    const float * coeffs;
+    size_t degree;
+};
 
-  FTEST(300000, get_x(-100, -1000, -200000), 0.0000001);
+/* Samples evaluated per block by the fused pipeline, small enough to stay in the L1 cache. */
+#define PIPELINE_BLOCK 1024
 
-  FTEST(-300000, get_x(100, -1000, 200000), 0.0000001);
+/* Procedure to find f(x) for the given function.*/
+/* Pre-conditions: function points to a function_spec, with degree + 1 coeffs for a polynomial.
+                   x is a float, the value after applying get_x to a given variable.
+* Post-conditions: returns the same float cosine() or polynomial() would store for x.
+*/
+float evaluate_function (const struct function_spec * function, float x);
 
-  FTEST(300000, get_x(100, 1000, -200000), 0.0000001);
+/* Procedure to evaluate count samples of a function starting at an absolute index.*/
+/* Pre-conditions: function points to a function_spec.
+                   block[] is an array of floats with atleast count elements.
+                   first_index is the absolute index of block[0].
+                   x_scale and x_shift are the floats of the transformation.
+* Post-conditions: block[k] holds evaluate_function(function, get_x(first_index + k, x_scale, x_shift)).
+*/
+void evaluate_block (const struct function_spec * function, float block[], size_t first_index, size_t count,
+                     float x_scale, float x_shift);
 
-  FTEST(100000, get_x(100, -1000, -200000), 0.0000001);
-  FTEST(-800000, get_x(100, -10000, -200000), 0.0000001);
+/* Procedure to evaluate, range and quantize a function in two blocked passes, without an intermediate array.*/
+/* Pre-conditions: function points to a function_spec.
+                   len is an unsigned positive integer, the number of samples.
+                   x_scale and x_shift are the floats of the transformation.
+                   height is an unsigned positive non-zero integer.
+                   levels[] is an array of integers with atleast len elements.
+                   values[] is NULL, or an array of floats with atleast len elements if the caller wants the samples.
+                   p_max and p_min point to floats.
+* Post-conditions: levels[] holds what scale() gives for the samples, *p_max and *p_min what range() gives,
+                   and values[] (when not NULL) what cosine() or polynomial() gives. When range_oracle() can
+                   answer, its range lets one pass evaluate and quantize block by block. Otherwise the first pass
+                   evaluates and tracks the max and min and the second quantizes block by block, since scaling
+                   needs the range of every block: with values[] the second reads the samples back from memory
+                   once len passes PIPELINE_BLOCK, and with values[] NULL it evaluates each block a second time
+                   into a buffer on the stack, trading twice the evaluations for no float array.
+*/
+void pipeline_levels (const struct function_spec * function, size_t len, float x_scale, float x_shift,
+                      size_t height, int levels[], float values[], float * p_max, float * p_min);
 
-  reportTests (numErrors);
-  return numErrors;
-} //testGetX
+/* Limits of a compiled expression. */
+#define EXPRESSION_MAX_CODE 256
+#define EXPRESSION_MAX_CONSTANTS 64
+#define EXPRESSION_MAX_DEPTH 16
+/* Deepest nesting of parentheses, signs and exponents the parser recurses through, and the longest number. */
+#define EXPRESSION_MAX_NESTING 64
+#define EXPRESSION_MAX_NUMBER 64
+/* Samples the expression VM runs each instruction over before moving to the next. */
+#define EXPRESSION_BATCH 256
 
-/* Tests for cosine(). */
-int
-testCosine (void)
+/* Instructions of the expression VM, each acting on a stack of batches of samples. */
+enum opcode
 {
-    int numErrors = 0;
-    printf("--COSINE TESTS--");
-   
-    float data_1[5] = {0,0,0,0,0};
+    OP_CONST, /* Push constants[operand].*/
+    OP_X,     /* Push get_x() of each sample.*/
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW,
+    OP_POWI,  /* Raise the top to the small integer power operand, by repeated multiplication.*/
+    OP_NEG, OP_SIN, OP_COS, OP_TAN, OP_EXP, OP_LOG, OP_SQRT, OP_ABS
+};
 
-    /* Testing when len < length of array with 0 shift and scale. */  
-    cosine (data_1, 1, 0, 0);
-    float expected_array_1[5] = {1.0, 0.0, 0.0, 0.0, 0.0};
-    for (int i = 0; i < 5; i++)
-    {
-        FTEST(expected_array_1[i], data_1[i], 0.0000001);
-    }
+/* An expression such as y=2*sin(x)-x^3, compiled to stack bytecode. */
+struct expression
+{
+    unsigned char code[EXPRESSION_MAX_CODE];
+    unsigned char operand[EXPRESSION_MAX_CODE];
+    float constants[EXPRESSION_MAX_CONSTANTS];
+    int length;
+    int constant_count;
+    int max_depth;
+    int error; /* Offset into the text of the first error, or -1.*/
+};
 
-    /* Testing when len < length of array with 0 scale and non-zero shift. */ 
-    cosine (data_1, 1, 0, (2*M_PI));
-    float expected_array_2[5] = {1.0, 0.0, 0.0, 0.0, 0.0};
-    for (int i = 0; i < 5; i++)
-    {
-        FTEST(expected_array_2[i], data_1[i], 0.0000001);
-    } 
+/* Procedure to compile an expression of x into bytecode.*/
+/* Pre-conditions: text is a string such as "y=2*sin(x)-x^3", with an optional "y=", decimal numbers, x, pi, e,
+                   + - * / ^ and parentheses, and sin cos tan exp log sqrt abs of a parenthesized argument.
+                   expr points to an expression.
+* Post-conditions: returns 0 and fills *expr on success. Returns -1 and sets expr->error to the offset of the
+                   first character that could not be compiled when the text is invalid or too large, including
+                   nesting deeper than EXPRESSION_MAX_NESTING.
+*/
+int expression_compile (const char * text, struct expression * expr);
 
-    /* Testing when len = length of array with 0 shift and non-zero scale. */ 
-    cosine (data_1, 5, M_PI_2, 0);
-    float expected_array_3[5] = {1.0, -0.0, -1.0, 0.0, 1.0};
-    for (int i = 0; i < 5; i++)
-    {
-        FTEST(expected_array_3[i], data_1[i], 0.0000001);
-    }
+/* Procedure to fill values[] with a compiled expression, like cosine() and polynomial().*/
+/* Pre-conditions: expr points to an expression compiled by expression_compile().
+                   values[] is an array of float values with atleast len elements.
+                   len is an unsigned integer.
+                   x_scale is a float which is a scale factor of the transformation.
+                   x_shift is a float which is the shift of the transformation.
+* Post-conditions: values[i] holds the expression at get_x(i, x_scale, x_shift). Each instruction is
+                   dispatched once per EXPRESSION_BATCH samples rather than once per sample.
+*/
+void expression_fill (const struct expression * expr, float values[], size_t len, float x_scale, float x_shift);
 
-    /* Testing when len = length of array with non-zero shift and scale. */ 
-    cosine (data_1, 5, M_PI_2, M_PI);
-    float expected_array_4[5] = {-1.0, 0, 1.0, 0.0, -1.0};
-    for (int i = 0; i < 5; i++)
-    {
-        FTEST(expected_array_4[i], data_1[i], 0.0000001);
-    }    
+/* Procedure to fill the elements begin to end - 1 of values[] with a compiled expression, using absolute indices.*/
+/* Pre-conditions: as expression_fill(), with begin <= end and values[] atleast end elements long.
+* Post-conditions: values[i] for begin <= i < end holds what expression_fill() would store.
+*/
+void expression_fill_span (const struct expression * expr, float values[], size_t begin, size_t end,
+                           float x_scale, float x_shift);
 
-    reportTests (numErrors);
-    return numErrors;
-} //testCosine
+/* Shape of the fill procedures, such as cosine(). */
+typedef void (*fill_function) (float values[], size_t len, float x_scale, float x_shift);
 
-/* Tests for polynomial(). */
-int
-testPolynomial (void)
+/* Native code compiled from an expression by expression_jit(). */
+struct jit_function
 {
-    int numErrors = 0;
-    printf("--POLYNOMIAL TESTS--");
+    fill_function fill; /* NULL when the expression is left to the interpreter.*/
+    void * memory;
+    size_t size;
+};
 
-    /* Testing for degree 0 with zero shift and non-zero scale, len = length of values[].*/
-    float data_1[4] = {0,0,0,0};
-    float flat[1] = {7};
-    polynomial (flat,0,data_1,4,1,0);
-    float expected_array_1[4] = {7.0, 7.0, 7.0, 7.0};
-    for (int i = 0; i < 4; i++)
-    {
-        FTEST(expected_array_1[i], data_1[i], 0.0000001);
-    }
+/* Procedure to compile an expression to native x86-64 code that fills values[] 4 samples at a time with SSE.*/
+/* Pre-conditions: expr points to an expression compiled by expression_compile().
+                   jit points to a jit_function.
+* Post-conditions: returns 0 and sets jit->fill to a procedure storing the expression at get_x(i, x_scale, x_shift)
+                   in values[i], like expression_fill(). Returns -1 with jit->fill NULL when the JIT is disabled
+                   (built with NO_JIT or not on x86-64 Linux), when the expression uses pow or a function other
+                   than sqrt and abs, when it needs more than 11 stack slots, or when the code cannot be mapped.
+*/
+int expression_jit (const struct expression * expr, struct jit_function * jit);
 
-    /* Testing for degree 1 with non-zero shift and scale, len = length of values[].*/
-    float data_2[6] = {0,0,0,0,0,0};
-    float line[2] = {2, 2};
-    polynomial(line, 1, data_2, 6, 1, 1); 
-    float expected_array_2[6] = {0, 2.0, 4.0, 6.0, 8.0, 10.0};
-    for (int i = 0; i < 6; i++)
-    {
-        FTEST(expected_array_2[i], data_2[i], 0.0000001);
-    }
+/* Procedure to fill values[] with an expression, through its native code when there is any.*/
+/* Pre-conditions: expr points to an expression compiled by expression_compile().
+                   jit points to a jit_function set by expression_jit() for expr.
+                   values[], len, x_scale and x_shift are as for expression_fill().
+* Post-conditions: values[] holds the expression, from jit->fill or else from expression_fill().
+*/
+void expression_fill_jit (const struct expression * expr, const struct jit_function * jit,
+                          float values[], size_t len, float x_scale, float x_shift);
 
-    /* Testing for degree 2 with zero scale and non-zero shift, len < length of values[].*/
-    float data_3[2] = {0,0};
-    float square[3] = {7, 1, 1};
-    polynomial(square, 2, data_3, 1, 0, 2);
-    float expected_array_3[2] = {9.0, 0};
-    for (int i = 0; i < 2; i++)
-    {
-        FTEST(expected_array_3[i], data_3[i], 0.0000001);
-    }
+/* Procedure to unmap the native code of a jit_function.*/
+/* Pre-conditions: jit points to a jit_function set by expression_jit().
+* Post-conditions: the code is unmapped and jit->fill is NULL.
+*/
+void jit_release (struct jit_function * jit);
 
-    /* Testing for degree 3 with zero scale and shift, len = length of values[].*/
-    float data_4[3] = {0,0,0};
-    float cube[4] = {7, 1, 1};  
-    polynomial(cube, 3, data_4, 3, 0, 0); 
-    float expected_array_4[3] =  {7.0, 7.0, 7.0};
-    for (int i = 0; i < 3; i++)
-    {
-        FTEST(expected_array_4[i], data_4[i], 0.0000001);
-    }
+/* A window of len columns onto a function, which can be panned a few columns at a time. */
+struct viewport
+{
+    struct function_spec function;
+    float x_scale;
+    float x_shift;
+    long first;          /* Absolute index of the leftmost column.*/
+    int len;
+    int height;
+    char symbol;
+    int tree_size;       /* Leaves in the segment trees, a power of two >= len.*/
+    float * samples;     /* Ring buffer, the sample of absolute index i in slot i mod len.*/
+    float * tree_max;    /* Segment trees over the slots, node k has children 2k and 2k+1.*/
+    float * tree_min;
+    int * scaled;
+    char * frame;
+    char * shown;        /* The frame last written, to find the rows that changed.*/
+    char * output;
+    int rendered;
+    size_t evaluations;
+};
 
-    reportTests (numErrors);
-    return numErrors;
-} //testPolynomial
+/* Procedure to set up a viewport and evaluate its first len samples.*/
+/* Pre-conditions: view points to a viewport.
+                   function points to a function_spec, whose coeffs must outlive the viewport.
+                   symbol is a single character such as 'x' or 'o'.
+                   len and height are positive, non-zero integers.
+                   x_scale and x_shift are the floats of the transformation of get_x.
+* Post-conditions: returns 0 with view holding the samples of absolute indices 0 to len - 1,
+                   or -1 when memory runs out. Free it with viewport_free().
+*/
+int viewport_init (struct viewport * view, const struct function_spec * function, char symbol, int len, int height,
+                   float x_scale, float x_shift);
 
-/* Tests for range(). */
-int
-testRange (void)
-{
-    int numErrors = 0;
-    printf("--RANGE TESTS--");
+/* Procedure to pan a viewport by a number of columns, evaluating only the columns that come into view.*/
+/* Pre-conditions: view points to a viewport set up by viewport_init().
+                   columns is the number of columns to move right, negative to move left.
+* Post-conditions: view shows absolute indices first + columns onwards. Only min(|columns|, len) samples are
+                   evaluated, and the max and min are updated in O(log len) per new sample.
+*/
+void viewport_pan (struct viewport * view, long columns);
 
-    /* Testing with cosine.*/
-    /* Testing with non-zero shift and scale, max and min are different values.*/
-    float max_1;
-    float min_1;
-    float data_1[5] = {0, 0, 0, 0, 0};
-    cosine(data_1, 5, M_PI, M_PI);
-    range(data_1, 5, &max_1, &min_1);
-    FTEST(1.0, max_1, 0.0000001); // positive max
-    FTEST(-1.0, min_1, 0.0000001); // negative min
+/* Procedure to give the max and min of the samples in view, without scanning them.*/
+/* Pre-conditions: view points to a viewport set up by viewport_init(); p_max and p_min point to floats.
+* Post-conditions: *p_max and *p_min hold what range() would give for the columns in view.
+*/
+void viewport_range (const struct viewport * view, float * p_max, float * p_min);
 
-    /* Testing with zero shift and scale, max and min are same values.*/
-    float max_2;
-    float min_2;
-    float data_2[3] = {0, 0, 0};
-    cosine(data_2, 0, 0, 0);
-    range(data_2, 3, &max_2, &min_2);
-    FTEST(0.0, max_2, 0.0000001); // zero max
-    FTEST(0.0, min_2, 0.0000001); //zero min
+/* Procedure to draw a viewport, writing only the rows that changed since the last draw.*/
+/* Pre-conditions: view points to a viewport set up by viewport_init().
+                   out is a stream to a terminal that understands ANSI cursor movement, with the plot at its top left.
+* Post-conditions: the columns in view are quantized and drawn into view->frame with view->symbol like fill_frame().
+                   Every row that differs from the last draw is written after a cursor move to it, in a single fwrite.
+                   Returns the number of rows written, all of them the first time.
+*/
+int viewport_render (struct viewport * view, FILE * out);
 
-    /* Testing with polynomial.*/
-    /* Testing with non-zero shift and scale, max and min are different values.*/
-    float max_3;
-    float min_3;
-    float data_3[4] = {0, 0, 0, 0};
-    float cube[4] = {0,0,0,-1};
-    polynomial(cube, 3, data_3, 4, 1, 2);
-    range(data_3, 4, &max_3, &min_3);
-    FTEST(8, max_3, 0.0000001);
-    FTEST(-1, min_3, 0.0000001);    
+/* Procedure to free the buffers of a viewport.*/
+/* Pre-conditions: view points to a viewport set up by viewport_init().
+* Post-conditions: the buffers are freed.
+*/
+void viewport_free (struct viewport * view);
 
-    /* Testing with zero shift and scale, max and min are same values.*/
-    float max_4;
-    float min_4;
-    float data_4[3] = {0, 0, 0};
-    float square[3] = {0, 0, 1};
-    polynomial(square, 2, data_4, 3, 0, 0);
-    range(data_4, 3, &max_4, &min_4);
-    FTEST(0.0, max_4, 0.0000001);
-    FTEST(0.0, min_4, 0.0000001);
+/* Columns between the samples of the first, coarse pass of adaptive_fill(). */
+#define ADAPTIVE_STRIDE 16
 
-    reportTests (numErrors);
-    return numErrors;
-} //testRange
+/* Procedure to fill values[] with a function, evaluating it only where straight lines between samples are not enough.*/
+/* Pre-conditions: function points to a function_spec.
+                   values[] is an array of float values with atleast len elements, len > 0.
+                   x_scale and x_shift are the floats of the transformation of get_x.
+                   height is an unsigned positive non-zero integer, the number of levels the values will be quantized to.
+* Post-conditions: samples every ADAPTIVE_STRIDE columns, then halves each interval until the sample at its middle is
+                   within half a level of the straight line between its ends and the ends are within one level of each
+                   other, the levels coming from the range of the coarse samples. Columns in a settled interval are
+                   filled from the straight line. Returns the number of times the function was evaluated.
+                   Staying within one level of the uniform fill is a heuristic, not a guarantee: a peak narrower than
+                   the samples around it is never seen, so neither its interval nor the coarse range reflects it.
+*/
+size_t adaptive_fill (const struct function_spec * function, float values[], size_t len,
+                      float x_scale, float x_shift, size_t height);
 
-/* Tests for quantize(). */
-int
-testQuantize (void)
+/* The max and min of each column of a stream of samples that is wider than the screen. */
+struct envelope
 {
-    int numErrors = 0;
-    printf("--QUANTIZE TESTS--");
+    float * max;
+    float * min;
+    size_t columns;
+    size_t total;        /* Samples the stream will have, spread evenly over the columns.*/
+    size_t seen;
+    size_t column;       /* Column the next sample goes to.*/
+    size_t column_end;   /* Index of the first sample of the column after it.*/
+};
 
-    /* Testing negative min and max.*/
-    TEST(6, quantize(-4, 10, -10, -1));
-    TEST(9, quantize(-1, 10, -10, -1)); //max
+/* Procedure to set up an envelope of total samples over a number of columns.*/
+/* Pre-conditions: env points to an envelope.
+                   columns is an unsigned positive integer.
+                   total is an unsigned positive integer, the number of samples that will be added.
+* Post-conditions: returns 0 with every column empty, or -1 when memory runs out. Free it with envelope_free().
+*/
+int envelope_init (struct envelope * env, size_t columns, size_t total);
+
+/* Procedure to fold the next samples of the stream into the max and min of their columns.*/
+/* Pre-conditions: env points to an envelope set up by envelope_init().
+                   samples[] is an array of floats with atleast count elements.
+                   count is an unsigned integer, with no more than total samples added in all.
+* Post-conditions: sample number s of the stream went to column s * columns / total, in O(1) time and no memory.
+*/
+void envelope_add (struct envelope * env, const float samples[], size_t count);
+
+/* Procedure to draw the vertical span between the levels of each column's min and max into a frame.*/
+/* Pre-conditions: lows[] and highs[] are arrays of integers of len levels each, lows[i] <= highs[i],
+                   a negative low marking an empty column.
+                   symbol, len, height and frame[] are as for fill_frame().
+* Post-conditions: frame[] holds height rows of len characters and a '\n', with symbol from level lows[i]
+                   up to level highs[i] in column i.
+*/
+void fill_span_frame (const int lows[], const int highs[], char symbol, int len, int height, char frame[]);
+
+/* Procedure to plot an envelope, each column drawn from its min to its max.*/
+/* Pre-conditions: env points to an envelope set up by envelope_init(), with atleast one sample added.
+                   out is a stream open for writing.
+                   symbol is a single character such as 'x' or 'o'.
+                   height is a positive, non-zero integer.
+                   lows[] and highs[] are arrays of integers with atleast env->columns elements.
+                   frame[] is an array of characters with atleast height * (env->columns + 1) elements.
+* Post-conditions: quantizes the mins and maxes against the range of the whole stream and prints the spans
+                   to out with a single fwrite. Peaks anywhere in a column are drawn.
+*/
+void plot_envelope (const struct envelope * env, FILE * out, char symbol, int height,
+                    int lows[], int highs[], char frame[]);
+
+/* Procedure to free the columns of an envelope.*/
+/* Pre-conditions: env points to an envelope set up by envelope_init().
+* Post-conditions: the columns are freed.
+*/
+void envelope_free (struct envelope * env);
+
+/* Encodings of the samples read by stream_plot(). */
+enum stream_format { STREAM_TEXT, STREAM_BINARY };
+
+/* Procedure to read the next chunk of samples from a stream.*/
+/* Pre-conditions: in is a stream of floats, as text separated by white space, or as raw native floats.
+                   chunk[] is an array of floats with atleast capacity elements.
+                   p_bad points to an integer.
+* Post-conditions: returns how many floats were read into chunk[], less than capacity only at the end of the stream
+                   or at text that is not a number. *p_bad is 1 when reading stopped at such text, 0 otherwise.
+*/
+size_t stream_read (FILE * in, enum stream_format format, float chunk[], size_t capacity, int * p_bad);
+
+/* Procedure to plot a stream of any length in frames of len samples, with memory that does not grow with it.*/
+/* Pre-conditions: in is a stream of floats in the given format.
+                   out is the stream the frames are written to.
+                   symbol, len and height are as for plot().
+                   chunk[] is an array of floats and scaled[] an array of integers, each with atleast len elements.
+                   frame[] is an array of characters with atleast height * (len + 1) elements.
+                   p_bad_sample points to a size_t.
+* Post-conditions: every len samples are drawn as one frame, the last frame possibly narrower. When in can seek,
+                   a first pass finds the range of the whole stream and every frame shares it; otherwise each
+                   frame is scaled to its own range. The buffers are reused for every chunk.
+                   Returns the number of frames written. Text that is not a number fails the stream: returns -1
+                   with *p_bad_sample the index of the sample it stands in place of, after drawing nothing from a
+                   stream that can seek, and only the frames before it from one that cannot.
+*/
+int stream_plot (FILE * in, enum stream_format format, FILE * out, char symbol, int len, int height,
+                 float chunk[], int scaled[], char frame[], size_t * p_bad_sample);
+
+/* Identifies a sample table file, and the version of its layout. */
+#define TABLE_MAGIC "PLOTTBL"
+#define TABLE_VERSION 1
+/* Alignment of the samples in a table file, a cache line. */
+#define TABLE_ALIGNMENT 64
+
+/* Header of a sample table file. The degree + 1 coefficients of a polynomial follow it,
+   then the len samples as native floats from payload_offset, a multiple of TABLE_ALIGNMENT. */
+struct table_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t function_kind;
+    float x_scale;
+    float x_shift;
+    uint64_t len;
+    float min;
+    float max;
+    uint32_t degree;
+    uint32_t payload_offset;
+};
+
+/* A sample table file mapped read-only into memory. */
+struct sample_table
+{
+    const struct table_header * header;
+    const float * coeffs;
+    const float * values;  /* Points into the mapping, no copy is made.*/
+    void * mapping;
+    size_t size;
+};
+
+/* Procedure to write the samples of a function to a table file, with their range in the header.*/
+/* Pre-conditions: path names a file that can be created or replaced.
+                   function points to a function_spec.
+                   len is an unsigned positive integer, the number of samples.
+                   x_scale and x_shift are the floats of the transformation of get_x.
+* Post-conditions: returns 0 when the file holds the header, the coefficients and what cosine() or polynomial()
+                   would store, evaluated a block at a time; returns -1 when it could not be written.
+*/
+int table_export (const char * path, const struct function_spec * function, size_t len, float x_scale, float x_shift);
+
+/* Procedure to map a table file read-only.*/
+/* Pre-conditions: path names a file written by table_export(); table points to a sample_table.
+* Post-conditions: returns 0 with table pointing into the mapped file, or -1 when the file cannot be mapped or
+                   is not a table of this version, or when its header places the coefficients or the samples
+                   past the end of the file. Unmap it with table_unmap().
+*/
+int table_map (const char * path, struct sample_table * table);
+
+/* Procedure to unmap a table file.*/
+/* Pre-conditions: table points to a sample_table set by table_map().
+* Post-conditions: the file is unmapped and the pointers of table are NULL.
+*/
+void table_unmap (struct sample_table * table);
+
+/* Procedure to plot a mapped table, straight from the mapped pages and with the range from its header.*/
+/* Pre-conditions: table points to a sample_table set by table_map().
+                   out is the stream the frame is written to.
+                   symbol and height are as for plot().
+                   scaled[] is an array of integers with atleast len elements.
+                   frame[] is an array of characters with atleast height * (len + 1) elements.
+* Post-conditions: returns 0 after writing the same frame as plot_buffered() would for the samples, without
+                   calling range(); returns -1 and writes nothing when len does not fit an int.
+*/
+int plot_table (const struct sample_table * table, FILE * out, char symbol, int height, int scaled[], char frame[]);
+
+/* Hash buckets of a sample_cache. */
+#define CACHE_BUCKETS 256
+
+/* A rendered view of a function kept by a sample_cache, in one allocation with its arrays. */
+struct cache_entry
+{
+    /* The key: the function, the get_x() parameters and the screen.*/
+    enum function_kind kind;
+    size_t degree;  /* 0 for a cosine, whose degree and coefficients are not part of the key.*/
+    float * coeffs;
+    float x_scale;
+    float x_shift;
+    size_t len;
+    int height;
+    char symbol;
+    /* What a render needs, so a repeat only writes the frame.*/
+    float * values;
+    float min;
+    float max;
+    int * levels;
+    char * frame;
+    size_t bytes;
+    uint64_t hash;
+    struct cache_entry * chain;   /* Next entry in the same bucket.*/
+    struct cache_entry * newer;   /* Neighbours in least recently used order.*/
+    struct cache_entry * older;
+};
+
+/* A least recently used cache of rendered views, within a budget of bytes. */
+struct sample_cache
+{
+    struct cache_entry * buckets[CACHE_BUCKETS];
+    struct cache_entry * newest;
+    struct cache_entry * oldest;
+    size_t budget;
+    size_t used;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+};
+
+/* Procedure to set up an empty cache.*/
+/* Pre-conditions: cache points to a sample_cache.
+                   budget is the most bytes the entries may take, counting their arrays.
+* Post-conditions: the cache is empty, with its counters at 0. Free it with cache_free().
+*/
+void cache_init (struct sample_cache * cache, size_t budget);
+
+/* Procedure to find the rendered view of a function, filling it on a miss.*/
+/* Pre-conditions: cache points to a sample_cache set up by cache_init().
+                   function points to a function_spec.
+                   len is an unsigned positive integer; x_scale and x_shift are the floats of get_x.
+                   height and symbol are as for plot().
+* Post-conditions: returns the entry holding the samples, their max and min, their levels and the frame plot_buffered()
+                   would write, and makes it the most recently used. A hit counts in cache->hits; a miss counts in
+                   cache->misses, evaluates the function, and evicts least recently used entries until the new one
+                   fits, counting them in cache->evictions. Returns NULL when the entry alone is over the budget
+                   or memory runs out. The entry is valid until the next call. A cosine hits whatever the
+                   degree and coeffs of its function_spec, since it does not use them.
+*/
+const struct cache_entry * cache_get (struct sample_cache * cache, const struct function_spec * function, size_t len,
+                                      float x_scale, float x_shift, int height, char symbol);
+
+/* Procedure to free every entry of a cache.*/
+/* Pre-conditions: cache points to a sample_cache set up by cache_init().
+* Post-conditions: the entries are freed and the cache is empty; the counters are kept.
+*/
+void cache_free (struct sample_cache * cache);
+
+/* Ways to compute cosine, from cheapest to most accurate. */
+enum cosine_tier { COSINE_TABLE, COSINE_MINIMAX, COSINE_LIBM };
+
+/* Entries per period in the table of COSINE_TABLE, a power of 2. */
+#define COSINE_TABLE_SIZE 256
+
+/* Procedure to give the bound on the absolute error of a cosine tier.*/
+/* Pre-conditions: tier is a cosine_tier.
+* Post-conditions: returns the most a value stored by cosine_tiered() can differ from the exact cos(x):
+                   for COSINE_TABLE the linear interpolation error (2*pi/COSINE_TABLE_SIZE)^2 / 8 plus rounding,
+                   for COSINE_MINIMAX the bound of cosine_approx(), for COSINE_LIBM the rounding to float.
+*/
+double cosine_tier_bound (enum cosine_tier tier);
+
+/* Procedure to measure the error of a cosine tier against double cos().*/
+/* Pre-conditions: tier is a cosine_tier.
+                   samples is an unsigned positive integer, the number of points tried in
+                   [-COSINE_APPROX_LIMIT, COSINE_APPROX_LIMIT].
+* Post-conditions: returns the largest absolute error found.
+*/
+double cosine_tier_measure (enum cosine_tier tier, size_t samples);
+
+/* Procedure to fill values[] with cos(x) like cosine(), with the given tier.*/
+/* Pre-conditions: same as cosine(). For COSINE_MINIMAX, |get_x(i, x_scale, x_shift)| <= COSINE_APPROX_LIMIT.
+                   tier is a cosine_tier.
+* Post-conditions: replaces first 'len' elements of values[] with cos(get_x(i, x_scale, x_shift)), each within
+                   cosine_tier_bound(tier). COSINE_LIBM stores exactly what cosine() stores.
+*/
+void cosine_tiered (float values[], size_t len, float x_scale, float x_shift, enum cosine_tier tier);
+
+/* Procedure to choose the cheapest cosine tier a plot of the given height cannot tell from exact.*/
+/* Pre-conditions: height is a positive, non-zero integer.
+                   span is the max minus the min of the values to be plotted, a float.
+                   x_limit is the largest |x| that will be evaluated.
+* Post-conditions: returns the cheapest tier whose bound, doubled to cover the max and min moving too,
+                   is under one quantization level span / height, so no level is off by more than one.
+                   Returns COSINE_LIBM when no cheaper tier is below it or |x| is beyond cosine_approx().
+*/
+enum cosine_tier cosine_tier_choose (int height, float span, float x_limit);
+
+/* Procedure to fill values[] with cos(x) for a plot of the given height with the cheapest tier that suffices.*/
+/* Pre-conditions: same as cosine().
+                   height is a positive, non-zero integer.
+* Post-conditions: chooses the tier with cosine_tier_choose() from the span of the samples before filling, then
+                   fills values[] once. The span is what range_oracle() gives, or when it declines, the range it
+                   gives over a prefix of a few periods, or else over the two end samples: never wider than the
+                   span of the samples. Returns the tier used, COSINE_TABLE when len is 0 and there is nothing to fill.
+*/
+enum cosine_tier cosine_for_height (float values[], size_t len, float x_scale, float x_shift, int height);
+
+/* One function to overlay: its values and the symbol drawn for them. */
+struct series
+{
+    const float * values;
+    char symbol;
+};
+
+/* What plot_overlay() draws where two series land on the same cell. */
+enum overlay_collision { COLLISION_FIRST, COLLISION_LAST, COLLISION_MARK };
+
+/* Symbol drawn on shared cells with COLLISION_MARK. */
+#define COLLISION_SYMBOL '#'
+
+/* Procedure to find the max and min over several series at once.*/
+/* Pre-conditions: series[] is an array of count series, each with atleast len values.
+                   count and len are unsigned positive integers.
+                   p_max and p_min are pointers to floats.
+* Post-conditions: *p_max and *p_min hold the max and min of all count * len values.
+*/
+void range_series (const struct series series[], size_t count, size_t len, float * p_max, float * p_min);
+
+/* Procedure to draw several series into one character frame on a shared scale.*/
+/* Pre-conditions: series[] is an array of count series, each with atleast len values.
+                   count is an unsigned positive integer.
+                   len and height are as for fill_frame().
+                   min and max are the floats all series are quantized between, as found by range_series().
+                   collision is how a cell hit by more than one series is drawn.
+                   scaled[] is an array of integers with atleast len elements, used as scratch.
+                   drawn[] is an array of characters with atleast height * len elements, used as scratch.
+                   frame[] is an array of characters with atleast height * (len + 1) elements.
+* Post-conditions: frame[] holds the blank frame of fill_frame() with each series' symbol at its levels. A cell hit
+                   by several series holds the first series' symbol for COLLISION_FIRST, the last one's for
+                   COLLISION_LAST, and COLLISION_SYMBOL for COLLISION_MARK. Whether a cell was hit is kept in
+                   drawn[], so a series drawn with ' ' still collides.
+*/
+void fill_overlay_frame (const struct series series[], size_t count, int len, int height, float min, float max,
+                         enum overlay_collision collision, int scaled[], char drawn[], char frame[]);
+
+/* Procedure to plot several series over each other in one frame, written with a single fwrite.*/
+/* Pre-conditions: same as fill_overlay_frame(), without min and max.
+                   out is a stream open for writing.
+* Post-conditions: writes the frame of fill_overlay_frame() on the joint range of all series to out.
+*/
+void plot_overlay (const struct series series[], size_t count, int len, int height,
+                   enum overlay_collision collision, FILE * out, int scaled[], char drawn[], char frame[]);
+
+#ifdef INSTRUMENT
+/* Procedures timed by the instrumentation. */
+enum probe { PROBE_COSINE, PROBE_POLYNOMIAL, PROBE_RANGE, PROBE_SCALE, PROBE_PLOT, PROBE_PLOT_BUFFERED, PROBE_COUNT };
+
+/* Everything the instrumentation has gathered since the start or the last instrument_reset(). */
+struct instrument_totals
+{
+    uint64_t calls[PROBE_COUNT];
+    uint64_t ns[PROBE_COUNT];
+    uint64_t cycles[PROBE_COUNT];
+    uint64_t evaluations;     /* Function values computed.*/
+    uint64_t bytes_written;   /* Bytes of frames written out.*/
+    uint64_t quantize_calls;
+};
+static struct instrument_totals instrument_totals;
+
+/* Macros around the hot paths; with INSTRUMENT undefined they compile to nothing. PROBE_BEGIN() goes at the top
+   of a procedure and PROBE_END(PROBE_X) at its end; COUNT() adds to one of the counters from any thread. */
+#define PROBE_BEGIN() uint64_t probe_start_ns = probe_now (); uint64_t probe_start_cycles = probe_cycles ()
+#define PROBE_END(PROBE) probe_record (PROBE, probe_start_ns, probe_start_cycles)
+#define COUNT(COUNTER, N) __atomic_fetch_add(&instrument_totals.COUNTER, (uint64_t) (N), __ATOMIC_RELAXED)
+
+/* Procedure to read the clock of the probes.*/
+/* Pre-conditions: none.
+* Post-conditions: returns a monotonic time in nanoseconds.
+*/
+uint64_t probe_now (void);
+
+/* Procedure to read the cycle counter of the probes.*/
+/* Pre-conditions: none.
+* Post-conditions: returns the time stamp counter on x86, 0 elsewhere.
+*/
+uint64_t probe_cycles (void);
+
+/* Procedure to add one call of a probe to the totals.*/
+/* Pre-conditions: probe is a probe below PROBE_COUNT.
+                   start_ns and start_cycles are what probe_now() and probe_cycles() returned when the call began.
+* Post-conditions: the call, its nanoseconds and its cycles are added to instrument_totals, atomically.
+*/
+void probe_record (enum probe probe, uint64_t start_ns, uint64_t start_cycles);
+
+/* Procedure to write a summary of the totals.*/
+/* Pre-conditions: fd is a file descriptor open for writing.
+* Post-conditions: writes one line per probe that was called, then the counters, with write() alone,
+                   so it is safe in a signal handler.
+*/
+void instrument_dump (int fd);
+
+/* Procedure to set every total back to 0.*/
+/* Pre-conditions: no instrumented procedure is running.
+* Post-conditions: instrument_totals is all 0.
+*/
+void instrument_reset (void);
+
+/* Procedure to have the summary written to stderr at exit and on SIGUSR1.*/
+/* Pre-conditions: none.
+* Post-conditions: instrument_dump(STDERR_FILENO) runs at exit and whenever the process gets SIGUSR1.
+*/
+void instrument_init (void);
+#else
+#define PROBE_BEGIN()
+#define PROBE_END(PROBE)
+#define COUNT(COUNTER, N)
+#endif
+
+/* What quantize_batch_u8() and quantize_batch_u16() need to quantize many values between one min and max. */
+struct quantizer
+{
+    float min;
+    float reciprocal;    /* levels / (max - min), for a first guess by multiplying.*/
+    float top;           /* levels - 1, the highest level.*/
+    float * thresholds;  /* thresholds[k] is the least max - min distance quantize() puts at level k or above.*/
+    int search;          /* Set when the multiply can miss by more than a level: the thresholds are searched instead.*/
+};
+
+/* Procedure to prepare a quantizer for values between min and max.*/
+/* Pre-conditions: quantizer points to a struct quantizer.
+                   levels is a positive integer, at most 256 for quantize_batch_u8() and 65536 for quantize_batch_u16().
+                   min and max are floats with min <= max.
+* Post-conditions: returns 0 with the quantizer ready, or -1 when memory runs out. The thresholds are found once
+                   here, stepping a float at a time around k * (max - min) / levels the way quantize() divides.
+                   When the step is subnormal or levels / (max - min) overflows, the batch procedures binary search
+                   the thresholds instead of guessing by a multiply. Free it with quantizer_free().
+*/
+int quantizer_init (struct quantizer * quantizer, int levels, float min, float max);
+
+/* Procedure to quantize values[] into 8-bit levels without a divide or a branch per element.*/
+/* Pre-conditions: quantizer points to a struct quantizer prepared by quantizer_init() with at most 256 levels.
+                   values[] is an array of len floats.
+                   levels_out[] is an array of atleast len unsigned 8-bit integers.
+* Post-conditions: levels_out[i] holds quantize(values[i], levels, min, max) for every value between min and max,
+                   0 for values below min and levels - 1 above max. When max == min every level is 0.
+*/
+void quantize_batch_u8 (const struct quantizer * quantizer, const float values[], uint8_t levels_out[], size_t len);
+
+/* Procedure to quantize values[] into 16-bit levels like quantize_batch_u8().*/
+/* Pre-conditions: same as quantize_batch_u8(), with at most 65536 levels and levels_out[] of 16-bit integers.
+* Post-conditions: same as quantize_batch_u8().
+*/
+void quantize_batch_u16 (const struct quantizer * quantizer, const float values[], uint16_t levels_out[], size_t len);
+
+/* Procedure to free the thresholds of a quantizer.*/
+/* Pre-conditions: quantizer points to a struct quantizer prepared by quantizer_init().
+* Post-conditions: the thresholds are freed.
+*/
+void quantizer_free (struct quantizer * quantizer);
+
+/* How plot_render() draws each character cell: one symbol, two half blocks, or 2x4 Braille dots. */
+enum render_mode { RENDER_ASCII, RENDER_HALF_BLOCK, RENDER_BRAILLE };
+
+/* Procedure to give the levels a render mode draws in one character row.*/
+/* Pre-conditions: mode is a render_mode.
+* Post-conditions: returns 1 for RENDER_ASCII, 2 for RENDER_HALF_BLOCK and 4 for RENDER_BRAILLE.
+*/
+int render_subcells (enum render_mode mode);
+
+/* Procedure to give the most bytes a rendered frame can take.*/
+/* Pre-conditions: mode is a render_mode.
+                   len and height are positive integers, the columns of values and the rows of characters.
+* Post-conditions: returns height * (len + 1) for RENDER_ASCII; each half block and Braille cell takes up to 3 bytes
+                   of UTF-8, and a Braille cell holds 2 columns.
+*/
+size_t render_frame_size (enum render_mode mode, int len, int height);
+
+/* Procedure to draw levels into a frame of character rows with the given mode.*/
+/* Pre-conditions: scaled[] is an array of len levels from scale() with height * render_subcells(mode) levels.
+                   symbol is the character RENDER_ASCII draws.
+                   len and height are positive integers; height counts character rows.
+                   frame[] is an array of characters with atleast render_frame_size(mode, len, height) elements.
+* Post-conditions: frame[] holds height rows, top row first, each followed by '\n'. RENDER_ASCII is what fill_frame()
+                   draws. RENDER_HALF_BLOCK draws U+2580 or U+2584 for the upper or lower level of a cell, RENDER_BRAILLE
+                   the U+2800 pattern with a dot for each of its 2 columns at its 4 levels. Empty cells are spaces.
+                   Returns the bytes used.
+*/
+size_t fill_render_frame (const int scaled[], int len, int height, enum render_mode mode, char symbol, char frame[]);
+
+/* Procedure to plot values with the given mode, written with a single fwrite.*/
+/* Pre-conditions: values[] is an array of float values with atleast len elements.
+                   len, height, mode and symbol are as for fill_render_frame().
+                   out is a stream open for writing.
+                   scaled[] is an array of integers with atleast len elements, used as scratch.
+                   frame[] is an array of characters with atleast render_frame_size(mode, len, height) elements.
+* Post-conditions: values are quantized by scale() into height * render_subcells(mode) levels and their frame is
+                   written to out, height rows of characters.
+*/
+void plot_render (const float values[], int len, int height, enum render_mode mode, char symbol, FILE * out,
+                  int scaled[], char frame[]);
+
+/* A screen kept up to date by writing only the cells whose level changed since the last frame. */
+struct diff_renderer
+{
+    int len;
+    int height;
+    char symbol;
+    int * previous;      /* The level shown in each column, -1 before the first frame.*/
+    int64_t * changes;   /* Cells to write, as (row * len + column) << 8 | character.*/
+    char * output;
+    int rendered;
+};
+
+/* Procedure to set up a differential renderer.*/
+/* Pre-conditions: renderer points to a diff_renderer.
+                   len and height are positive integers, the columns and rows of the plot.
+* Post-conditions: returns 0 with nothing shown yet, or -1 when memory runs out. Free it with diff_free().
+*/
+int diff_init (struct diff_renderer * renderer, int len, int height);
+
+/* Procedure to bring the screen from the last frame to a new one.*/
+/* Pre-conditions: renderer points to a diff_renderer set up by diff_init().
+                   scaled[] is an array of len levels, as filled by scale() with the renderer's height.
+                   symbol is a single character such as 'x' or 'o'.
+                   out is a stream open for writing, to a terminal that has shown every earlier frame.
+* Post-conditions: writes, in one fwrite, ANSI cursor moves and characters that blank the old cell and draw the new one
+                   of each column whose level changed, row by row, moving the cursor only where the next cell is not
+                   the one after the last. The first frame, or one with a new symbol, clears the screen first and
+                   draws every column. Leaves the cursor below the plot. Returns the bytes written.
+*/
+size_t diff_render (struct diff_renderer * renderer, const int scaled[], char symbol, FILE * out);
+
+/* Procedure to free a differential renderer.*/
+/* Pre-conditions: renderer points to a diff_renderer set up by diff_init().
+* Post-conditions: its arrays are freed.
+*/
+void diff_free (struct diff_renderer * renderer);
+
+/* Highest polynomial degree a batch job can give. */
+#define JOB_MAX_DEGREE 15
+/* Largest width and height of a batch job, so the size of its frame is far from overflowing. */
+#define JOB_MAX_SIZE 65536
+/* Most bytes the frame of one job and the frames of a whole batch can take. */
+#define JOB_MAX_FRAME (64 << 20)
+#define BATCH_MAX_BYTES (1 << 30)
+/* Longest line of a job list, counting the newline. */
+#define JOB_MAX_LINE 1024
+
+/* One plot of a batch: what to evaluate, on which grid, and where its frame goes in the output. */
+struct plot_job
+{
+    struct function_spec function;
+    float coeffs[JOB_MAX_DEGREE + 1];
+    float x_scale;
+    float x_shift;
+    int width;
+    int height;
+    char symbol;
+    size_t offset;
+};
+
+/* A bump allocator: memory is handed out from one block and all given back at once. */
+struct arena
+{
+    char * base;
+    size_t size;
+    size_t used;
+};
+
+/* Procedure to set up an arena.*/
+/* Pre-conditions: arena points to a struct arena.
+                   size is the bytes it can hand out, counting alignment.
+* Post-conditions: returns 0 with the block allocated and empty, or -1 when memory runs out.
+*/
+int arena_init (struct arena * arena, size_t size);
+
+/* Procedure to take memory from an arena.*/
+/* Pre-conditions: arena points to a struct arena set up by arena_init().
+                   bytes is an unsigned integer.
+* Post-conditions: returns bytes of memory aligned to 64, valid until arena_reset(), or NULL when the arena is full.
+*/
+void * arena_alloc (struct arena * arena, size_t bytes);
+
+/* Procedure to give back everything taken from an arena.*/
+/* Pre-conditions: arena points to a struct arena set up by arena_init().
+* Post-conditions: the arena is empty again; earlier pointers from it must not be used.
+*/
+void arena_reset (struct arena * arena);
+
+/* Procedure to free the block of an arena.*/
+/* Pre-conditions: arena points to a struct arena set up by arena_init().
+* Post-conditions: the block is freed.
+*/
+void arena_free (struct arena * arena);
+
+/* Procedure to read one line of a job list.*/
+/* Pre-conditions: line is a null-terminated string, either "cosine x_scale x_shift width height [symbol]"
+                   or "polynomial c0,c1,...,cn x_scale x_shift width height [symbol]"; blank lines and
+                   lines starting with '#' hold no job.
+                   job points to a struct plot_job.
+* Post-conditions: returns 1 with job filled, symbol '*' when none is given; 0 for a line with no job;
+                   -1 when the line cannot be read or has anything after the symbol, the degree is over
+                   JOB_MAX_DEGREE, a size is not positive or over JOB_MAX_SIZE, or the frame would take more
+                   than JOB_MAX_FRAME bytes.
+*/
+int batch_parse (const char * line, struct plot_job * job);
+
+/* Procedure to read a job list.*/
+/* Pre-conditions: in is a stream open for reading.
+                   jobs, count and bad_line are pointers.
+* Post-conditions: returns 0 with *jobs holding the *count jobs in order, to be freed by the caller.
+                   Returns -1 with *bad_line the number of the first line batch_parse() refused, that is
+                   longer than JOB_MAX_LINE or whose job takes the frames past BATCH_MAX_BYTES, or 0 when memory
+                   ran out; nothing is left allocated then.
+*/
+int batch_read (FILE * in, struct plot_job ** jobs, size_t * count, size_t * bad_line);
+
+/* Procedure to render a list of jobs on the threads of the pool and write their frames in order.*/
+/* Pre-conditions: jobs[] is an array of count jobs from batch_read() or batch_parse().
+                   out is a stream open for writing.
+                   No parallel procedure is running.
+* Post-conditions: every job is evaluated, ranged and scaled by pipeline_levels(), which asks range_oracle() for
+                   the range before scanning, and drawn like plot_buffered() would, by the threads
+                   set by set_thread_count() pulling jobs from a shared counter. Each thread keeps its values[] and
+                   scaled[] in its own arena, sized once for the widest job, and draws straight into the job's
+                   place in one output buffer, so no job allocates. The frames are written to out in job order
+                   in one fwrite. Returns 0, or -1 before any job starts when memory runs out or the frames
+                   would take more than JOB_MAX_FRAME bytes for a job or BATCH_MAX_BYTES in all.
+*/
+int batch_render (struct plot_job jobs[], size_t count, FILE * out);
+
+/* Most critical points range_oracle() visits before leaving the window to range(). */
+#define RANGE_ORACLE_LIMIT 64
+
+/* Procedure to find the max and min of a function over its sampled grid from where it can turn.*/
+/* Pre-conditions: function points to a function_spec.
+                   len is an unsigned positive integer; x_scale and x_shift are the floats of get_x.
+                   p_max and p_min are pointers to floats.
+* Post-conditions: returns 0 with *p_max and *p_min found from the samples at both ends and the samples on either side of
+                   each critical point: k*pi for cosine, the roots of the derivative for a polynomial of degree <= 3.
+                   Between critical points the samples are monotonic, so for cosine this is exactly what range() finds
+                   over what cosine() stores, after O(1) evaluations for each critical point in the window. For a
+                   polynomial of degree 2 or 3, whose float Horner values can wobble where the curve is flat, it also
+                   visits every sample whose exact value is within twice the rounding bound of Horner's rule of the
+                   max or min, so it too is exactly what range() finds over what polynomial() stores. Returns -1 with
+                   nothing stored for higher degrees, when the window holds more than RANGE_ORACLE_LIMIT critical
+                   points or so many that scanning is cheaper, or when the flat stretches hold more than len / 4
+                   samples.
+*/
+int range_oracle (const struct function_spec * function, size_t len, float x_scale, float x_shift,
+                  float * p_max, float * p_min);
+
+/* Procedure to fill values[] like cosine() and give their max and min without scanning them when it can.*/
+/* Pre-conditions: same as cosine(); p_max and p_min are pointers to floats.
+* Post-conditions: values[] holds what cosine() stores and *p_max and *p_min what range() would find, from
+                   range_oracle() when it can answer and from range() otherwise.
+*/
+void cosine_ranged (float values[], size_t len, float x_scale, float x_shift, float * p_max, float * p_min);
+
+/* Procedure to fill values[] like polynomial() and give their max and min without scanning them when it can.*/
+/* Pre-conditions: same as polynomial(); p_max and p_min are pointers to floats.
+* Post-conditions: values[] holds what polynomial() stores and *p_max and *p_min what range() would find, from
+                   range_oracle() when it can answer and from range() otherwise.
+*/
+void polynomial_ranged (const float coeffs[], size_t degree, float values[], size_t len, float x_scale, float x_shift,
+                        float * p_max, float * p_min);
+
+/* Largest len, degree and expression the differential checks take from a random or fuzzed case. */
+#define CHECK_MAX_LEN 4096
+#define CHECK_MAX_DEGREE 7
+#define CHECK_MAX_TEXT 128
+
+/* One input to check_fast_paths(): a grid, a height, a polynomial and an expression. */
+struct check_case
+{
+    float x_scale;
+    float x_shift;
+    size_t len;
+    int height;
+    size_t degree;
+    float coeffs[CHECK_MAX_DEGREE + 1];
+    char text[CHECK_MAX_TEXT];
+};
+
+/* Procedure to check every fast path against its scalar reference on one case.*/
+/* Pre-conditions: test points to a check_case with len <= CHECK_MAX_LEN, degree <= CHECK_MAX_DEGREE,
+                   height >= 1 and a null-terminated text. Any float may be NaN or infinite.
+* Post-conditions: returns the number of broken rules, printing each. The rules: the parallel procedures store
+                   exactly what the serial ones do; other polynomial methods and the batch kernels stay within
+                   4 (degree + 1) float epsilons of sum |c_k| |x|^k of polynomial(), forward differences within
+                   that plus the rounding of get_x, and the batch cosine within 2e-7 of cosine() where |x| <= COSINE_APPROX_LIMIT.
+                   On a finite grid pipeline_levels() and the batch quantizer give exactly the levels of
+                   range() and scale(), the range oracle gives exactly the max and min of range() whenever it
+                   answers, and an approximation whose error is under a level moves no sample by more than
+                   one level. There, every quantizer kernel gives those levels too, the viewport's trees and the
+                   envelope's columns give exactly the max and min range() gives over their samples,
+                   adaptive_fill() is exact on the columns it samples and stays within the range between them,
+                   and each cosine tier, like the tier cosine_for_height() picks, is within cosine_tier_bound()
+                   of cos(x) where |x| <= COSINE_APPROX_LIMIT. A compiled expression's native code stores exactly what the interpreter does.
+                   Cases with NaN or infinity are run through every path for their defined results only.
+*/
+int check_fast_paths (const struct check_case * test);
+
+/* A 16.16 fixed-point number, the value times Q16_ONE in 32 bits, for targets without a floating-point unit. */
+typedef int32_t q16;
+#define Q16_ONE 65536
+
+/* Largest degree the numeric cores convert once into an array on the stack; above it they convert as they go. */
+#define NUMERIC_MAX_DEGREE 15
+
+/* Procedure to convert a double to 16.16 fixed point.*/
+/* Pre-conditions: value is any double.
+* Post-conditions: returns value rounded to the nearest 1/65536, saturated to the q16 range, with NaN as 0.
+*/
+q16 q16_from_double (double value);
+
+/* Procedure to convert 16.16 fixed point to a double.*/
+/* Pre-conditions: value is any q16.
+* Post-conditions: returns value / 65536 exactly.
+*/
+double q16_to_double (q16 value);
+
+/* The evaluate, range and scale path over one numeric type T, the procedures named with the suffix S. */
+/* DEFINE_NUMERIC_CORE generates every instantiation from one body, with the arithmetic inlined from the type's
+   numeric_*_S operations, so no procedure checks the type at run time. There is one for float (f32), double (f64)
+   and 16.16 fixed point (q16). Unlike cosine(), the float core evaluates cos() in float. Fixed-point arithmetic
+   saturates, and its cosine interpolates a table.
+
+   numeric_evaluate_S:
+   Pre-conditions: function points to a function_spec.
+                   values[] is an array of T with atleast len elements.
+                   x_scale and x_shift are the T of the transformation.
+   * Post-conditions: values[i] holds f(i * x_scale - x_shift), evaluated in T; a polynomial by Horner's rule.
+                      Above NUMERIC_MAX_DEGREE each coefficient is converted to T every time it is used,
+                      with the same results.
+
+   numeric_range_S:
+   Pre-conditions: values[] is an array of T with atleast len elements. p_max and p_min point to T.
+   * Post-conditions: *p_max and *p_min hold the largest and smallest of values[], as range() finds them.
+                      When len is 0 they are left as they were.
+
+   numeric_scale_S:
+   Pre-conditions: values[] is an array of T and scaled[] an array of integers, both with atleast len elements.
+                   height is an unsigned positive integer, at most 2^30. min and max are T, min <= max.
+   * Post-conditions: scaled[i] holds the level of values[i] by the rules of quantize(), computed in T.
+
+   numeric_levels_S:
+   Pre-conditions: as the three above, x_scale and x_shift given as doubles.
+   * Post-conditions: runs the three in turn: values[] holds the samples, *p_max and *p_min their range and
+                      levels[] their levels. When len is 0 nothing is written.
+*/
+#define DECLARE_NUMERIC_CORE(S, T) \
+void numeric_evaluate_##S (const struct function_spec * function, T values[], size_t len, T x_scale, T x_shift); \
+void numeric_range_##S (const T values[], size_t len, T * p_max, T * p_min); \
+void numeric_scale_##S (const T values[], int scaled[], size_t len, size_t height, T min, T max); \
+void numeric_levels_##S (const struct function_spec * function, size_t len, double x_scale, double x_shift, \
+                         size_t height, int levels[], T values[], T * p_max, T * p_min);
+
+DECLARE_NUMERIC_CORE(f32, float)
+DECLARE_NUMERIC_CORE(f64, double)
+DECLARE_NUMERIC_CORE(q16, q16)
+
+/***************************** TESTING *****************************/
+
+/* Print a report of a collection of unit tests.
+ * Prints OK when no errors and FAIL with a count otherwise.
+ */
+void
+reportTests (int numErrors)
+{
+  if (numErrors>0)
+    printf (" FAIL: %d errors\n",numErrors);
+  else
+    printf (" OK\n");
+} // reportTests
+/* Test all functionality by running test functions.
+ * Returns the total number of errors.
+*/
+
+/* Tests for get_x(). */
+int
+testGetX (void)
+{
+  int numErrors = 0;
+  printf ("--GETX TESTS--");
+
+  /* Testing small positive numbers. */
+  FTEST(-0.00001, get_x(1, 0.00001, 0.00002), 0.0000001);
+  FTEST(0.00008, get_x(2, 0.00005, 0.00002), 0.0000001); 
+
+  /* Testing average sized positive numbers. */
+  FTEST(40, get_x(5, 10, 10), 0.0000001);
+  FTEST(-16, get_x(4, 6, 40), 0.0000001); 
+
+  /* Testing big positive numbers. */
+  FTEST(499925500, get_x(10000, 50000.55, 80000), 0.0000001);
+  FTEST(-100000000, get_x(2000, 200000, 500000000), 0.0000001);  
+
+  /* Testing zeros. */
+  FTEST(0, get_x(0, 0.0, 0.0), 0.0000001);
+
+  /* Testing small negative numbers. */
+  FTEST(-0.00003, get_x(-1, 0.00001, 0.00002), 0.0000001);
+
+  FTEST(-0.00001, get_x(-1, -0.00001, 0.00002), 0.0000001);
+  FTEST(0.00006, get_x(-1, -0.00008, 0.00002), 0.0000001);
+
+  FTEST(0.00001, get_x(-1, 0.00001, -0.00002), 0.0000001);
+  FTEST(-0.00006, get_x(-1, 0.00008, -0.00002), 0.0000001);
+
+  FTEST(0.00003, get_x(-1, -0.00001, -0.00002), 0.0000001);
+
+  FTEST(-0.00003, get_x(1, -0.00001, 0.00002), 0.0000001);
+
+  FTEST(0.00003, get_x(1, 0.00001, -0.00002), 0.0000001);
+
+  FTEST(0.00001, get_x(1, -0.00001, -0.00002), 0.0000001);
+  FTEST(-0.00006, get_x(1, -0.00008, -0.00002), 0.0000001);
+
+  /* Testing average sized negative numbers. */
+  FTEST(-3, get_x(-1, 1, 2), 0.0000001);
+
+  FTEST(-1, get_x(-1, -1, 2), 0.0000001);
+  FTEST(6, get_x(-1, -8, 2), 0.0000001);
+
+  FTEST(1, get_x(-1, 1, -2), 0.0000001);
+  FTEST(-6, get_x(-1, 8, -2), 0.0000001);
+
+  FTEST(3, get_x(-1, -1, -2), 0.0000001);
+
+  FTEST(-3, get_x(1, -1, 2), 0.0000001);
+
+  FTEST(3, get_x(1, 1, -2), 0.0000001);
+
+  FTEST(1, get_x(1, -1, -2), 0.0000001);
+  FTEST(-6, get_x(1, -8, -2), 0.0000001);
+
+  /* Testing big negative numbers. */
+  FTEST(-100020000, get_x(-10000, 10000, 20000), 0.0000001);
+
+  FTEST(-100000, get_x(-100, -1000, 200000), 0.0000001);
+  FTEST(800000, get_x(-100, -10000, 200000), 0.0000001);
+
+  FTEST(100000, get_x(-100, 1000, -200000), 0.0000001);
+  FTEST(-800000, get_x(-100, 10000, -200000), 0.0000001);
+
+  FTEST(300000, get_x(-100, -1000, -200000), 0.0000001);
+
+  FTEST(-300000, get_x(100, -1000, 200000), 0.0000001);
+
+  FTEST(300000, get_x(100, 1000, -200000), 0.0000001);
+
+  FTEST(100000, get_x(100, -1000, -200000), 0.0000001);
+  FTEST(-800000, get_x(100, -10000, -200000), 0.0000001);
+
+  reportTests (numErrors);
+  return numErrors;
+} //testGetX
+
+/* Tests for cosine(). */
+int
+testCosine (void)
+{
+    int numErrors = 0;
+    printf("--COSINE TESTS--");
+   
+    float data_1[5] = {0,0,0,0,0};
+
+    /* Testing when len < length of array with 0 shift and scale. */  
+    cosine (data_1, 1, 0, 0);
+    float expected_array_1[5] = {1.0, 0.0, 0.0, 0.0, 0.0};
+    for (int i = 0; i < 5; i++)
+    {
+        FTEST(expected_array_1[i], data_1[i], 0.0000001);
+    }
+
+    /* Testing when len < length of array with 0 scale and non-zero shift. */ 
+    cosine (data_1, 1, 0, (2*M_PI));
+    float expected_array_2[5] = {1.0, 0.0, 0.0, 0.0, 0.0};
+    for (int i = 0; i < 5; i++)
+    {
+        FTEST(expected_array_2[i], data_1[i], 0.0000001);
+    } 
+
+    /* Testing when len = length of array with 0 shift and non-zero scale. */ 
+    cosine (data_1, 5, M_PI_2, 0);
+    float expected_array_3[5] = {1.0, -0.0, -1.0, 0.0, 1.0};
+    for (int i = 0; i < 5; i++)
+    {
+        FTEST(expected_array_3[i], data_1[i], 0.0000001);
+    }
+
+    /* Testing when len = length of array with non-zero shift and scale. */ 
+    cosine (data_1, 5, M_PI_2, M_PI);
+    float expected_array_4[5] = {-1.0, 0, 1.0, 0.0, -1.0};
+    for (int i = 0; i < 5; i++)
+    {
+        FTEST(expected_array_4[i], data_1[i], 0.0000001);
+    }    
+
+    reportTests (numErrors);
+    return numErrors;
+} //testCosine
+
+/* Tests for polynomial(). */
+int
+testPolynomial (void)
+{
+    int numErrors = 0;
+    printf("--POLYNOMIAL TESTS--");
+
+    /* Testing for degree 0 with zero shift and non-zero scale, len = length of values[].*/
+    float data_1[4] = {0,0,0,0};
+    float flat[1] = {7};
+    polynomial (flat,0,data_1,4,1,0);
+    float expected_array_1[4] = {7.0, 7.0, 7.0, 7.0};
+    for (int i = 0; i < 4; i++)
+    {
+        FTEST(expected_array_1[i], data_1[i], 0.0000001);
+    }
+
+    /* Testing for degree 1 with non-zero shift and scale, len = length of values[].*/
+    float data_2[6] = {0,0,0,0,0,0};
+    float line[2] = {2, 2};
+    polynomial(line, 1, data_2, 6, 1, 1); 
+    float expected_array_2[6] = {0, 2.0, 4.0, 6.0, 8.0, 10.0};
+    for (int i = 0; i < 6; i++)
+    {
+        FTEST(expected_array_2[i], data_2[i], 0.0000001);
+    }
+
+    /* Testing for degree 2 with zero scale and non-zero shift, len < length of values[].*/
+    float data_3[2] = {0,0};
+    float square[3] = {7, 1, 1};
+    polynomial(square, 2, data_3, 1, 0, 2);
+    float expected_array_3[2] = {9.0, 0};
+    for (int i = 0; i < 2; i++)
+    {
+        FTEST(expected_array_3[i], data_3[i], 0.0000001);
+    }
+
+    /* Testing for degree 3 with zero scale and shift, len = length of values[].*/
+    float data_4[3] = {0,0,0};
+    float cube[4] = {7, 1, 1};  
+    polynomial(cube, 3, data_4, 3, 0, 0); 
+    float expected_array_4[3] =  {7.0, 7.0, 7.0};
+    for (int i = 0; i < 3; i++)
+    {
+        FTEST(expected_array_4[i], data_4[i], 0.0000001);
+    }
+
+    reportTests (numErrors);
+    return numErrors;
+} //testPolynomial
+
+/* Tests for range(). */
+int
+testRange (void)
+{
+    int numErrors = 0;
+    printf("--RANGE TESTS--");
+
+    /* Testing with cosine.*/
+    /* Testing with non-zero shift and scale, max and min are different values.*/
+    float max_1;
+    float min_1;
+    float data_1[5] = {0, 0, 0, 0, 0};
+    cosine(data_1, 5, M_PI, M_PI);
+    range(data_1, 5, &max_1, &min_1);
+    FTEST(1.0, max_1, 0.0000001); // positive max
+    FTEST(-1.0, min_1, 0.0000001); // negative min
+
+    /* Testing with zero shift and scale, max and min are same values.*/
+    float max_2;
+    float min_2;
+    float data_2[3] = {0, 0, 0};
+    cosine(data_2, 0, 0, 0);
+    range(data_2, 3, &max_2, &min_2);
+    FTEST(0.0, max_2, 0.0000001); // zero max
+    FTEST(0.0, min_2, 0.0000001); //zero min
+
+    /* Testing with polynomial.*/
+    /* Testing with non-zero shift and scale, max and min are different values.*/
+    float max_3;
+    float min_3;
+    float data_3[4] = {0, 0, 0, 0};
+    float cube[4] = {0,0,0,-1};
+    polynomial(cube, 3, data_3, 4, 1, 2);
+    range(data_3, 4, &max_3, &min_3);
+    FTEST(8, max_3, 0.0000001);
+    FTEST(-1, min_3, 0.0000001);    
+
+    /* Testing with zero shift and scale, max and min are same values.*/
+    float max_4;
+    float min_4;
+    float data_4[3] = {0, 0, 0};
+    float square[3] = {0, 0, 1};
+    polynomial(square, 2, data_4, 3, 0, 0);
+    range(data_4, 3, &max_4, &min_4);
+    FTEST(0.0, max_4, 0.0000001);
+    FTEST(0.0, min_4, 0.0000001);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testRange
+
+/* Tests for quantize(). */
+int
+testQuantize (void)
+{
+    int numErrors = 0;
+    printf("--QUANTIZE TESTS--");
+
+    /* Testing negative min and max.*/
+    TEST(6, quantize(-4, 10, -10, -1));
+    TEST(9, quantize(-1, 10, -10, -1)); //max
     TEST(0, quantize(-10, 10, -10, -1)); //min
 
-    /* Testing positive min and max.*/
-    TEST(1, quantize(46, 5, 10, 110));
-    TEST(4, quantize(110, 5, 10, 110)); //max
-    TEST(0, quantize(10, 5, 10, 110)); //min
+    /* Testing positive min and max.*/
+    TEST(1, quantize(46, 5, 10, 110));
+    TEST(4, quantize(110, 5, 10, 110)); //max
+    TEST(0, quantize(10, 5, 10, 110)); //min
+
+    /* Testing negative min and positive max.*/
+    TEST(3, quantize(10, 4, -20, 20));
+    TEST(1, quantize(-4, 4, -20, 20));
+    TEST(3, quantize(20, 4, -20, 20)); //max
+    TEST(0, quantize(-20, 4, -20, 20)); //min
+
+    reportTests (numErrors);
+    return numErrors;
+} //testQuantize
+
+/* Tests for scale(). */
+int 
+testScale (void)
+{
+    int numErrors = 0;
+    printf("--QUANTIZE SCALE--");
+
+    /* Testing positive max and zero min.*/
+    float data_1[5] = {0,2,4,6,10};
+    int scaled_1[5] = {0, 0, 0, 0, 0};
+    scale(data_1, scaled_1, 5, 2, 0, 10);
+    int expected_array_1[5] = {0, 0, 0, 1, 1};
+     for (int i = 0; i < 5; i++)
+    {
+        TEST(expected_array_1[i], scaled_1[i]);
+    }
+
+    /* Testing zero max and negative min. */
+    float data_2[5] = {0,-2,-4,-6,-10};
+    int scaled_2[5] = {0, 0, 0, 0, 0};
+    scale(data_2, scaled_2, 5, 5, -10, 0);
+    int expected_array_2[5] = {4, 4, 3, 2, 0};
+    for (int i = 0; i < 5; i++)
+    {
+        TEST(expected_array_2[i], scaled_2[i]);
+    }
+
+    /* Testing positive max and negative min.*/
+    float data_3[7] = {0,2,4,-6,-10, 0, -8};
+    int scaled_3[7] = {0, 0, 0, 0, 0, 0, 0};
+    scale(data_3, scaled_3, 7, 10, -10, 10);
+    int expected_array_3[5] = {5, 6, 7, 2, 0};
+    for (int i = 0; i < 5; i++)
+    {
+        TEST(expected_array_3[i], scaled_3[i]);
+    }
+
+    reportTests (numErrors);
+    return numErrors;
+} //testScale
+
+/* Tests for plot(). */
+void
+testPlot (void)
+{
+    printf("Testing the plot function:\n");
+
+    /* Testing example 1.*/
+    int SCREEN_HEIGHT_1 = 3;
+    int SCREEN_WIDTH_1 = 6;
+    
+    float values_1[SCREEN_WIDTH_1];
+
+    cosine (values_1, SCREEN_WIDTH_1, M_PI, 0.0);
+    printf("Alternating points between maximum and minum of the function.\n");
+    plot (values_1, '*', SCREEN_WIDTH_1, SCREEN_HEIGHT_1);
+
+    /* Testing example 2.*/
+    int SCREEN_HEIGHT_2 = 5;
+    int SCREEN_WIDTH_2 = 10;
+    
+    float values_2[SCREEN_WIDTH_2];
+    float cubic_1[] = {0,1,2,1};  
+    polynomial(cubic_1, 3, values_2, SCREEN_WIDTH_2, 1, 20);
+    printf("Diagonal line from top right to bottom left with atleast one symbol across the line.\n");
+    plot (values_2, '*', SCREEN_WIDTH_2, SCREEN_HEIGHT_2);
+
+    /* Testing example 3.*/
+    int SCREEN_HEIGHT_3 = 4;
+    int SCREEN_WIDTH_3 = 8;
+    
+    float values_3[SCREEN_WIDTH_3];
+    float square_1[] = {0,1,2};  
+    polynomial(square_1, 2, values_3, SCREEN_WIDTH_3, 0.5, 5);
+    printf("Diagonal line from top left to bottom right with atleast one symbol across the line.\n");
+    plot (values_3, '*', SCREEN_WIDTH_3, SCREEN_HEIGHT_3);
+
+    /* Testing example 4.*/
+    int SCREEN_HEIGHT_4 = 7;
+    int SCREEN_WIDTH_4 = 14;
+    
+    float values_4[SCREEN_WIDTH_4];
+    cosine (values_4, SCREEN_WIDTH_4, M_PI_2, 1);
+    printf("Small diagonal lines from top right to bottom left, one below the other and after each other.\n");
+    plot (values_4, '*', SCREEN_WIDTH_4, SCREEN_HEIGHT_4);
+
+} //testPlot
+
+/* Builds the rows plot() prints, the reference path, into expected[]. */
+void
+referenceFrame (const int scaled[], char symbol, int len, int height, char expected[])
+{
+    int k = 0;
+    for (int j = (height - 1); j >= 0; j--)
+    {
+        for (int i = 0; i < len; i++)
+            expected[k++] = (scaled[i] == j) ? symbol : ' ';
+        expected[k++] = '\n';
+    }
+} //referenceFrame
+
+/* Tests for fill_frame(). */
+int
+testFrame (void)
+{
+    int numErrors = 0;
+    printf("--FRAME TESTS--");
+
+    /* Testing cosine at the production screen size against the reference rows.*/
+    int height_1 = 60;
+    int width_1 = 80;
+    float values_1[80];
+    int scaled_1[80];
+    char frame_1[60 * 81];
+    char expected_1[60 * 81];
+    float max_1;
+    float min_1;
+    cosine (values_1, width_1, 0.15, 0.0);
+    range (values_1, width_1, &max_1, &min_1);
+    scale (values_1, scaled_1, width_1, height_1, min_1, max_1);
+    fill_frame (scaled_1, '*', width_1, height_1, frame_1);
+    referenceFrame (scaled_1, '*', width_1, height_1, expected_1);
+    TEST(0, memcmp(frame_1, expected_1, sizeof(frame_1)));
+
+    /* Testing a cubic with a different symbol.*/
+    float values_2[10];
+    int scaled_2[10];
+    char frame_2[5 * 11];
+    char expected_2[5 * 11];
+    float cubic_1[] = {0,1,2,1};
+    float max_2;
+    float min_2;
+    polynomial (cubic_1, 3, values_2, 10, 1, 20);
+    range (values_2, 10, &max_2, &min_2);
+    scale (values_2, scaled_2, 10, 5, min_2, max_2);
+    fill_frame (scaled_2, 'o', 10, 5, frame_2);
+    referenceFrame (scaled_2, 'o', 10, 5, expected_2);
+    TEST(0, memcmp(frame_2, expected_2, sizeof(frame_2)));
+
+    /* Testing levels outside the screen are left blank, like plot().*/
+    int scaled_3[3] = {-1, 1, 2};
+    char frame_3[2 * 4];
+    fill_frame (scaled_3, '*', 3, 2, frame_3);
+    TEST(0, memcmp(frame_3, " * \n   \n", sizeof(frame_3)));
+
+    reportTests (numErrors);
+    return numErrors;
+} //testFrame
+
+/* True when value is within the bound cosine_approx() promises of the exact cosine: 1e-7, and 2 ULP where
+   |cos(x)| >= 2^-10. */
+static int
+cosine_within_bound (float value, double exact)
+{
+    float rounded = fabs(exact);
+    double ulp = nextafterf(rounded, INFINITY) - rounded;
+    return fabs(value - exact) <= 1e-7 && (fabs(exact) < 0x1p-10 || fabs(value - exact) <= 2 * ulp);
+} //cosine_within_bound
+
+/* Tests for cosine_batch() and polynomial_batch(), with cosine() and polynomial() as the oracle. */
+int
+testBatch (void)
+{
+    int numErrors = 0;
+    printf("--BATCH TESTS--");
+
+    enum batch_kernel best = batch_kernel_select (KERNEL_AVX2);
+    float expected[1003];
+    float values[1003];
+    float cubic[] = {0,1,18,1};
+    float wide[] = {1, -0.5, 0.25, -0.125, 0.0625, -0.03125};
+
+    /* Testing every kernel the CPU supports, with a length that leaves a scalar tail.*/
+    for (enum batch_kernel kernel = KERNEL_SCALAR; kernel <= best; kernel++)
+    {
+        TEST(kernel, batch_kernel_select (kernel));
+
+        /* Testing cosine over many periods, against the absolute error bound.*/
+        cosine (expected, 1003, 0.15, 70.0);
+        cosine_batch (values, 1003, 0.15, 70.0);
+        for (int i = 0; i < 1003; i++)
+        {
+            FTEST(expected[i], values[i], 0.0000001);
+        }
+
+        /* Testing cosine near the edge of the reduced domain.*/
+        cosine (expected, 1003, 7.9, -100.0);
+        cosine_batch (values, 1003, 7.9, -100.0);
+        for (int i = 0; i < 1003; i++)
+        {
+            FTEST(expected[i], values[i], 0.0000001);
+        }
+
+        /* Testing the cubic from main(), relative to the size of the values.*/
+        polynomial (cubic, 3, expected, 1003, 0.375, 20);
+        polynomial_batch (cubic, 3, values, 1003, 0.375, 20);
+        for (int i = 0; i < 1003; i++)
+        {
+            FTEST(expected[i], values[i], 0.000001 * (1 + fabs(expected[i])));
+        }
+
+        /* Testing a degree 5 polynomial.*/
+        polynomial (wide, 5, expected, 1003, 0.01, 5);
+        polynomial_batch (wide, 5, values, 1003, 0.01, 5);
+        for (int i = 0; i < 1003; i++)
+        {
+            FTEST(expected[i], values[i], 0.000001 * (1 + fabs(expected[i])));
+        }
+
+        /* Testing len smaller than one vector leaves the rest of values[] untouched.*/
+        values[3] = 42;
+        cosine_batch (values, 3, M_PI_2, 0);
+        FTEST(1.0, values[0], 0.0000001);
+        FTEST(0.0, values[1], 0.0000001);
+        FTEST(-1.0, values[2], 0.0000001);
+        FTEST(42.0, values[3], 0.0000001);
+    }
+    batch_kernel_select (best);
+
+    /* Testing the bound of cosine_approx() on every 64th float of the reduced domain, both signs.*/
+    uint32_t bits;
+    uint32_t last_bits;
+    float x = COSINE_APPROX_LIMIT;
+    memcpy(&last_bits, &x, sizeof(float));
+    int outside = 0;
+    for (bits = 0; bits <= last_bits; bits += 64)
+    {
+        memcpy(&x, &bits, sizeof(float));
+        outside += !cosine_within_bound(cosine_approx(x), cos((double) x));
+        outside += !cosine_within_bound(cosine_approx(-x), cos((double) x));
+    }
+    TEST(0, outside);
+
+    /* Testing every kernel on a dense grid over the whole domain, 2^20 points a pass.*/
+    size_t dense = 1 << 20;
+    float * grid = malloc(dense * sizeof(float));
+    float grid_scale = 2.0f * COSINE_APPROX_LIMIT / dense;
+    for (enum batch_kernel kernel = KERNEL_SCALAR; kernel <= best; kernel++)
+    {
+        batch_kernel_select (kernel);
+        outside = 0;
+        cosine_batch (grid, dense, grid_scale, COSINE_APPROX_LIMIT);
+        for (size_t i = 0; i < dense; i++)
+        outside += !cosine_within_bound(grid[i], cos((double) get_x(i, grid_scale, COSINE_APPROX_LIMIT)));
+        TEST(0, outside);
+    }
+    batch_kernel_select (best);
+    free(grid);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testBatch
+
+/* Evaluates a polynomial in double precision, as the exact answer for the tests. */
+double
+referencePolynomial (const float coeffs[], size_t degree, double x)
+{
+    double sum = coeffs[degree];
+    for (size_t j = degree; j > 0; j--)
+        sum = sum * x + coeffs[j - 1];
+    return sum;
+} //referencePolynomial
+
+/* Tests for polynomial_eval() and polynomial_with(). */
+int
+testPolynomialEngine (void)
+{
+    int numErrors = 0;
+    printf("--POLYNOMIAL ENGINE TESTS--");
+
+    /* Testing every method agrees with f_of_x_of_polynomial() on small integers.*/
+    float cubic[] = {0,1,18,1};
+    for (int method = POLY_HORNER; method <= POLY_COMPENSATED; method++)
+    {
+        for (int x = -5; x <= 5; x++)
+        {
+            TEST(f_of_x_of_polynomial(cubic, 3, x), polynomial_eval(cubic, 3, x, method));
+        }
+        TEST(7, polynomial_eval((float[]){7}, 0, 3, method));
+    }
+
+    /* Testing degree 30 and degree 50 polynomials against double precision.*/
+    float high[51];
+    for (int k = 0; k <= 50; k++)
+    {
+        high[k] = ((k % 2) ? -1.0 : 1.0) / (k + 1);
+    }
+    for (int method = POLY_HORNER; method <= POLY_COMPENSATED; method++)
+    {
+        for (float x = -1; x <= 1; x += 0.125)
+        {
+            FTEST(referencePolynomial(high, 30, x), polynomial_eval(high, 30, x, method), 0.000001);
+            FTEST(referencePolynomial(high, 50, x), polynomial_eval(high, 50, x, method), 0.000001);
+        }
+    }
+
+    /* Testing compensated evaluation near a multiple root, (x-1)^5, where plain Horner cancels.*/
+    float root[] = {-1, 5, -10, 10, -5, 1};
+    float near_root = 1.1;
+    double exact = pow((double) near_root - 1, 5);
+    FTEST(exact, polynomial_eval(root, 5, near_root, POLY_COMPENSATED), fabs(exact) * 0.00001);
+
+    /* Testing Estrin's scheme at a degree whose coefficients would not fit on the stack, against Horner.*/
+    size_t huge_degree = 4000000;
+    float * huge = malloc((huge_degree + 1) * sizeof(float));
+    for (size_t k = 0; k <= huge_degree; k++)
+    huge[k] = ((k % 2) ? -1.0 : 1.0) / (k + 1);
+    for (float x = -0.75; x <= 0.75; x += 0.25)
+    FTEST(polynomial_eval(huge, huge_degree, x, POLY_HORNER), polynomial_eval(huge, huge_degree, x, POLY_ESTRIN), 0.00001);
+    free(huge);
+
+    /* Testing polynomial_with() fills the same values as polynomial().*/
+    float expected[20];
+    float values[20];
+    polynomial (high, 30, expected, 20, 0.1, 1);
+    polynomial_with (high, 30, values, 20, 0.1, 1, POLY_HORNER);
+    for (int i = 0; i < 20; i++)
+    {
+        TEST(expected[i], values[i]);
+    }
+
+    reportTests (numErrors);
+    return numErrors;
+} //testPolynomialEngine
+
+/* Tests for the parallel procedures, which must match the serial ones exactly. */
+int
+testParallel (void)
+{
+    int numErrors = 0;
+    printf("--PARALLEL TESTS--");
+
+    size_t len = 10007; /* Not a multiple of the chunk size, so the last chunk is short.*/
+    float * expected = malloc(len * sizeof(float));
+    float * values = malloc(len * sizeof(float));
+    int * expected_scaled = malloc(len * sizeof(int));
+    int * scaled = malloc(len * sizeof(int));
+    float cubic[] = {0,1,18,1};
+
+    for (int threads = 1; threads <= 4; threads++)
+    {
+        TEST(threads, set_thread_count (threads));
+
+        /* Testing cosine with absolute indices in every chunk.*/
+        cosine (expected, len, 0.0015, 3.0);
+        cosine_parallel (values, len, 0.0015, 3.0);
+        TEST(0, memcmp(expected, values, len * sizeof(float)));
+
+        /* Testing range and scale on the cosine values.*/
+        float max_1;
+        float min_1;
+        float max_2;
+        float min_2;
+        range (expected, len, &max_1, &min_1);
+        range_parallel (values, len, &max_2, &min_2);
+        TEST(max_1, max_2);
+        TEST(min_1, min_2);
+        scale (expected, expected_scaled, len, 60, min_1, max_1);
+        scale_parallel (values, scaled, len, 60, min_2, max_2);
+        TEST(0, memcmp(expected_scaled, scaled, len * sizeof(int)));
+
+        /* Testing the cubic, and a length shorter than one chunk.*/
+        polynomial (cubic, 3, expected, len, 0.00375, 20);
+        polynomial_parallel (cubic, 3, values, len, 0.00375, 20);
+        TEST(0, memcmp(expected, values, len * sizeof(float)));
+        polynomial_parallel (cubic, 3, values, 5, 1, 2);
+        polynomial (cubic, 3, expected, 5, 1, 2);
+        TEST(0, memcmp(expected, values, 5 * sizeof(float)));
+    }
+    set_thread_count (1);
+
+    free(expected);
+    free(values);
+    free(expected_scaled);
+    free(scaled);
+    reportTests (numErrors);
+    return numErrors;
+} //testParallel
+
+/* Tests for pipeline_levels(), against the separate passes. */
+int
+testPipeline (void)
+{
+    int numErrors = 0;
+    printf("--PIPELINE TESTS--");
+
+    size_t len = 2500; /* Two full blocks and a partial one.*/
+    float * expected = malloc(len * sizeof(float));
+    float * values = malloc(len * sizeof(float));
+    int * expected_levels = malloc(len * sizeof(int));
+    int * levels = malloc(len * sizeof(int));
+    float cubic[] = {0,1,18,1};
+    struct function_spec functions[2] = { { FUNCTION_COSINE, NULL, 0 }, { FUNCTION_POLYNOMIAL, cubic, 3 } };
+    float max_1;
+    float min_1;
+    float max_2;
+    float min_2;
+
+    for (int f = 0; f < 2; f++)
+    {
+        if (functions[f].kind == FUNCTION_COSINE)
+        cosine (expected, len, 0.005, 0.0);
+        else
+        polynomial (cubic, 3, expected, len, 0.012, 20);
+        range (expected, len, &max_1, &min_1);
+        scale (expected, expected_levels, len, 60, min_1, max_1);
+        float x_scale = (functions[f].kind == FUNCTION_COSINE) ? 0.005 : 0.012;
+        float x_shift = (functions[f].kind == FUNCTION_COSINE) ? 0.0 : 20;
+
+        /* Testing without the intermediate float array.*/
+        pipeline_levels (&functions[f], len, x_scale, x_shift, 60, levels, NULL, &max_2, &min_2);
+        TEST(max_1, max_2);
+        TEST(min_1, min_2);
+        TEST(0, memcmp(expected_levels, levels, len * sizeof(int)));
+
+        /* Testing when the caller asks for the samples too.*/
+        memset(levels, 0, len * sizeof(int));
+        pipeline_levels (&functions[f], len, x_scale, x_shift, 60, levels, values, &max_2, &min_2);
+        TEST(0, memcmp(expected, values, len * sizeof(float)));
+        TEST(0, memcmp(expected_levels, levels, len * sizeof(int)));
+    }
+
+    free(expected);
+    free(values);
+    free(expected_levels);
+    free(levels);
+    reportTests (numErrors);
+    return numErrors;
+} //testPipeline
+
+/* Tests for expression_compile() and expression_fill(). */
+int
+testExpression (void)
+{
+    int numErrors = 0;
+    printf("--EXPRESSION TESTS--");
+
+    struct expression expr;
+    float expected[600];
+    float values[600];
+    float cubic[] = {0,1,18,1};
+
+    /* Testing cos(x) stores exactly what cosine() stores, over several batches.*/
+    TEST(0, expression_compile("cos(x)", &expr));
+    cosine (expected, 600, 0.15, 1.0);
+    expression_fill (&expr, values, 600, 0.15, 1.0);
+    TEST(0, memcmp(expected, values, sizeof(values)));
+
+    /* Testing the cubic from main() against polynomial().*/
+    TEST(0, expression_compile("y = x^3 + 18*x^2 + x", &expr));
+    polynomial (cubic, 3, expected, 600, 0.375, 20);
+    expression_fill (&expr, values, 600, 0.375, 20);
+    for (int i = 0; i < 600; i++)
+    {
+        FTEST(expected[i], values[i], 0.000001 * (1 + fabs(expected[i])));
+    }
+
+    /* Testing the README example, precedence, unary minus and constants.*/
+    TEST(0, expression_compile("y=2*sin(x)-x^3", &expr));
+    expression_fill (&expr, values, 5, 1, 2);
+    for (int i = 0; i < 5; i++)
+    {
+        float x = get_x(i, 1, 2);
+        TEST((float) (2 * (float) sin(x) - x * x * x), values[i]);
+    }
+    TEST(0, expression_compile("-2^2 + (1 - 3) * 4 / 8 + abs(-pi) - sqrt(4)", &expr));
+    expression_fill (&expr, values, 1, 0, 0);
+    FTEST(-4 - 1 + M_PI - 2, values[0], 0.000001);
+    TEST(0, expression_compile("exp(log(x)) + x^0.5 + 1e1", &expr));
+    expression_fill (&expr, values, 1, 0, -4);
+    FTEST(4 + 2 + 10, values[0], 0.00001);
+
+    /* Testing invalid text is rejected with the offset of the problem.*/
+    TEST(-1, expression_compile("2*", &expr));
+    TEST(2, expr.error);
+    TEST(-1, expression_compile("sin(x", &expr));
+    TEST(5, expr.error);
+    TEST(-1, expression_compile("foo(x)", &expr));
+    TEST(0, expr.error);
+    TEST(-1, expression_compile("x x", &expr));
+    TEST(2, expr.error);
+
+    /* Testing numbers are decimal only: hex, inf and nan are not numbers, and a lone point is not one.*/
+    TEST(-1, expression_compile("0x10", &expr));
+    TEST(1, expr.error);
+    TEST(-1, expression_compile("inf", &expr));
+    TEST(-1, expression_compile("nan", &expr));
+    TEST(-1, expression_compile(". + 1", &expr));
+    TEST(0, expression_compile("1.5e-1 + .25 + 2. + 3E+1", &expr));
+    expression_fill (&expr, values, 1, 0, 0);
+    FTEST(0.15 + 0.25 + 2 + 30, values[0], 0.00001);
+
+    /* Testing deep nesting is an error, not a crash, while the limit itself still compiles.*/
+    char deep[4 * EXPRESSION_MAX_NESTING];
+    memset(deep, '-', sizeof(deep) - 2);
+    strcpy(deep + sizeof(deep) - 2, "x");
+    TEST(-1, expression_compile(deep, &expr));
+    char * nested = malloc(200001);
+    memset(nested, '(', 100000);
+    memset(nested + 100000, ')', 100000);
+    nested[100000 - 1] = 'x';
+    nested[200000] = '\0';
+    TEST(-1, expression_compile(nested, &expr));
+    free(nested);
+    memset(deep, '-', EXPRESSION_MAX_NESTING - 1);
+    strcpy(deep + EXPRESSION_MAX_NESTING - 1, "x");
+    TEST(0, expression_compile(deep, &expr));
+
+    /* Testing a short last batch: one sample past a whole batch.*/
+    float tail[EXPRESSION_BATCH + 1];
+    TEST(0, expression_compile("1/(x - 3) + sqrt(x)", &expr));
+    expression_fill (&expr, tail, EXPRESSION_BATCH + 1, 1, 0);
+    FTEST(1.0 / (EXPRESSION_BATCH - 3) + sqrt(EXPRESSION_BATCH), tail[EXPRESSION_BATCH], 0.0001);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testExpression
+
+/* Tests for expression_jit(), against the interpreter. */
+int
+testJit (void)
+{
+    int numErrors = 0;
+    printf("--JIT TESTS--");
+
+    const char * supported[] = { "x^3 + 18*x^2 + x", "-(x - 1) / (abs(x) + 2) * sqrt(abs(x))", "x^0 + x^1 - 2.5", "7" };
+    const char * unsupported[] = { "2*sin(x)-x^3", "x^0.5" };
+    struct expression expr;
+    struct jit_function jit;
+    float expected[1003];
+    float values[1003];
+
+    for (int e = 0; e < 4; e++)
+    {
+        expression_compile (supported[e], &expr);
+#ifdef HAVE_JIT
+        TEST(0, expression_jit (&expr, &jit));
+#else
+        TEST(-1, expression_jit (&expr, &jit));
+#endif
+        /* Testing lengths which end on a full vector and partway through one.*/
+        for (size_t len = 1000; len <= 1003; len++)
+        {
+            memset(values, 0, sizeof(values));
+            expression_fill (&expr, expected, len, 0.0375, 20);
+            expression_fill_jit (&expr, &jit, values, len, 0.0375, 20);
+            for (size_t i = 0; i < len; i++)
+            {
+                FTEST(expected[i], values[i], 0.000001 * (1 + fabs(expected[i])));
+            }
+            TEST(0, (len < 1003) ? values[len] : 0);
+        }
+        jit_release (&jit);
+    }
+
+    /* Testing expressions the JIT leaves to the interpreter.*/
+    for (int e = 0; e < 2; e++)
+    {
+        expression_compile (unsupported[e], &expr);
+        TEST(-1, expression_jit (&expr, &jit));
+        TEST(NULL, jit.fill);
+        expression_fill (&expr, expected, 100, 0.1, 1);
+        expression_fill_jit (&expr, &jit, values, 100, 0.1, 1);
+        TEST(0, memcmp(expected, values, 100 * sizeof(float)));
+    }
+
+    reportTests (numErrors);
+    return numErrors;
+} //testJit
+
+/* Tests for viewport_pan() and viewport_render(). */
+int
+testViewport (void)
+{
+    int numErrors = 0;
+    printf("--VIEWPORT TESTS--");
+
+    struct function_spec functions[2] = { { FUNCTION_COSINE, NULL, 0 }, { FUNCTION_POLYNOMIAL, (float[]){0,1,18,1}, 3 } };
+    char symbols[2] = { '*', 'o' };
+    long pans[6] = { 5, -12, 1, 79, 200, -1000 };
+    FILE * out = fopen("/dev/null", "w");
+    float expected[80];
+    int scaled[80];
+    char frame[20 * 81];
+
+    for (int f = 0; f < 2; f++)
+    {
+        struct viewport view;
+        TEST(0, viewport_init (&view, &functions[f], symbols[f], 80, 20, 0.15, 20));
+        TEST(20, viewport_render (&view, out));
+        TEST(0, viewport_render (&view, out)); /* Nothing changed.*/
+
+        for (int p = 0; p < 6; p++)
+        {
+            size_t evaluations = view.evaluations;
+            long first = view.first + pans[p];
+            viewport_pan (&view, pans[p]);
+
+            /* Testing only the new columns are evaluated.*/
+            TEST((size_t) labs(pans[p]) < 80 ? (size_t) labs(pans[p]) : 80, view.evaluations - evaluations);
+            TEST(first, view.first);
+
+            /* Testing the range against a fresh evaluation of the columns in view.*/
+            float max_1;
+            float min_1;
+            float max_2;
+            float min_2;
+            for (int c = 0; c < 80; c++)
+            {
+                expected[c] = evaluate_function(&functions[f], get_x(first + c, 0.15, 20));
+            }
+            range (expected, 80, &max_1, &min_1);
+            viewport_range (&view, &max_2, &min_2);
+            TEST(max_1, max_2);
+            TEST(min_1, min_2);
+
+            /* Testing the drawn frame against a full render.*/
+            viewport_render (&view, out);
+            scale (expected, scaled, 80, 20, min_1, max_1);
+            fill_frame (scaled, symbols[f], 80, 20, frame);
+            TEST(0, memcmp(frame, view.frame, sizeof(frame)));
+        }
+        viewport_free (&view);
+    }
+
+    fclose(out);
+    reportTests (numErrors);
+    return numErrors;
+} //testViewport
+
+/* Tests for adaptive_fill(), which must land within one level of the uniform fill. */
+int
+testAdaptive (void)
+{
+    int numErrors = 0;
+    printf("--ADAPTIVE TESTS--");
+
+    struct function_spec functions[2] = { { FUNCTION_COSINE, NULL, 0 }, { FUNCTION_POLYNOMIAL, (float[]){0,1,18,1}, 3 } };
+    float x_scales[2] = { 0.15, 0.375 };
+    float x_shifts[2] = { 0.0, 20 };
+    size_t widths[2] = { 80, 8000 };
+    float * expected = malloc(8000 * sizeof(float));
+    float * values = malloc(8000 * sizeof(float));
+    int * expected_levels = malloc(8000 * sizeof(int));
+    int * levels = malloc(8000 * sizeof(int));
+
+    for (int f = 0; f < 2; f++)
+    {
+        for (int w = 0; w < 2; w++)
+        {
+            /* The same domain as main(), at 80 columns and at 100 times as many.*/
+            size_t len = widths[w];
+            float x_scale = x_scales[f] * 80 / len;
+            float max;
+            float min;
+            evaluate_block (&functions[f], expected, 0, len, x_scale, x_shifts[f]);
+            range (expected, len, &max, &min);
+            scale (expected, expected_levels, len, 60, min, max);
+
+            size_t evaluations = adaptive_fill (&functions[f], values, len, x_scale, x_shifts[f], 60);
+            TEST(1, evaluations <= ((len > 80) ? len / 2 : len));
+            scale (values, levels, len, 60, min, max);
+            for (size_t i = 0; i < len; i++)
+            {
+                TEST(1, abs(expected_levels[i] - levels[i]) <= 1);
+            }
+            /* Testing the sampled columns are exact.*/
+            for (size_t i = 0; i < len; i += ADAPTIVE_STRIDE)
+            {
+                TEST(expected[i], values[i]);
+            }
+        }
+    }
+
+    /* Testing lengths shorter than the stride.*/
+    TEST(1, adaptive_fill (&functions[0], values, 1, 0.1, 0, 10));
+    FTEST(1.0, values[0], 0.0000001);
+    TEST(3, adaptive_fill (&functions[1], values, 3, 1, 1, 10)); /* Both ends, then the middle.*/
+    FTEST(20, values[2], 0.0000001);
+
+    free(expected);
+    free(values);
+    free(expected_levels);
+    free(levels);
+    reportTests (numErrors);
+    return numErrors;
+} //testAdaptive
+
+/* Tests for envelope_add() and fill_span_frame(). */
+int
+testEnvelope (void)
+{
+    int numErrors = 0;
+    printf("--ENVELOPE TESTS--");
+
+    size_t total = 100003;
+    size_t columns = 80;
+    float * samples = malloc(total * sizeof(float));
+    struct envelope env;
+
+    /* A slow cosine with one spike, the kind of point decimation loses.*/
+    cosine (samples, total, 0.0001, 0);
+    samples[54321] = 5;
+
+    /* Testing chunks of uneven sizes land in the right columns.*/
+    TEST(0, envelope_init (&env, columns, total));
+    for (size_t begin = 0, count = 1; begin < total; begin += count, count = count * 3 % 4099 + 1)
+    {
+        envelope_add (&env, samples + begin, (begin + count < total) ? count : total - begin);
+    }
+    for (size_t c = 0; c < columns; c++)
+    {
+        float max;
+        float min;
+        size_t begin = (c * total + columns - 1) / columns;
+        size_t end = ((c + 1) * total + columns - 1) / columns;
+        range (samples + begin, end - begin, &max, &min);
+        TEST(max, env.max[c]);
+        TEST(min, env.min[c]);
+    }
+    TEST(5, env.max[54321 * columns / total]);
+
+    /* Testing spans are drawn from the low to the high level, and empty columns are blank.*/
+    int lows[4] = {0, 1, -1, 2};
+    int highs[4] = {2, 1, -1, 2};
+    char frame[3 * 5];
+    fill_span_frame (lows, highs, '*', 4, 3, frame);
+    TEST(0, memcmp(frame, "*  *\n**  \n*   \n", sizeof(frame)));
+    envelope_free (&env);
+
+    /* Testing fewer samples than columns leaves columns empty.*/
+    TEST(0, envelope_init (&env, 4, 2));
+    envelope_add (&env, (float[]){1, 2}, 2);
+    TEST(1, env.max[0]);
+    TEST(2, env.max[2]);
+    TEST(1, env.min[1] > env.max[1]);
+
+    /* Testing the plot of it, with the empty columns blank.*/
+    char * output = NULL;
+    size_t output_size = 0;
+    int plot_lows[4];
+    int plot_highs[4];
+    char plot_frame[2 * 5];
+    FILE * out = open_memstream(&output, &output_size);
+    plot_envelope (&env, out, 'o', 2, plot_lows, plot_highs, plot_frame);
+    fclose(out);
+    TEST(10, output_size);
+    TEST(0, memcmp(output, "  o \no   \n", 10));
+    free(output);
+    envelope_free (&env);
+
+    free(samples);
+    reportTests (numErrors);
+    return numErrors;
+} //testEnvelope
+
+/* Tests for stream_plot(), from a file that can seek and from a pipe that cannot. */
+int
+testStream (void)
+{
+    int numErrors = 0;
+    printf("--STREAM TESTS--");
+
+    float samples[200];
+    float chunk[80];
+    int scaled[80];
+    char frame[10 * 81];
+    char expected[3 * 10 * 81];
+    char * output;
+    size_t output_size;
+    int pipe_ends[2];
+    size_t bad_sample;
+    float max;
+    float min;
+
+    cosine (samples, 200, 0.05, 0);
+    samples[150] = 3;
+
+    for (int format = STREAM_TEXT; format <= STREAM_BINARY; format++)
+    {
+        /* Testing a file: three frames of 80, 80 and 40 columns sharing the range of the whole stream.*/
+        FILE * in = tmpfile();
+        for (int i = 0; i < 200; i++)
+        {
+            if (format == STREAM_TEXT)
+            fprintf(in, "%.9g\n", samples[i]);
+            else
+            fwrite(&samples[i], sizeof(float), 1, in);
+        }
+        rewind(in);
+        FILE * out = open_memstream(&output, &output_size);
+        TEST(3, stream_plot (in, format, out, '*', 80, 10, chunk, scaled, frame, &bad_sample));
+        fclose(out);
+        fclose(in);
+        range (samples, 200, &max, &min);
+        size_t used = 0;
+        for (int begin = 0; begin < 200; begin += 80)
+        {
+            int width = (200 - begin < 80) ? 200 - begin : 80;
+            scale (samples + begin, scaled, width, 10, min, max);
+            fill_frame (scaled, '*', width, 10, expected + used);
+            used += 10 * (width + 1);
+        }
+        TEST(used, output_size);
+        TEST(0, memcmp(expected, output, used));
+        free(output);
+
+        /* Testing a pipe: each frame scaled to its own range.*/
+        TEST(0, pipe(pipe_ends));
+        FILE * writer = fdopen(pipe_ends[1], "w");
+        for (int i = 0; i < 200; i++)
+        {
+            if (format == STREAM_TEXT)
+            fprintf(writer, "%.9g ", samples[i]);
+            else
+            fwrite(&samples[i], sizeof(float), 1, writer);
+        }
+        fclose(writer);
+        in = fdopen(pipe_ends[0], "r");
+        out = open_memstream(&output, &output_size);
+        TEST(3, stream_plot (in, format, out, '*', 80, 10, chunk, scaled, frame, &bad_sample));
+        fclose(out);
+        fclose(in);
+        used = 0;
+        for (int begin = 0; begin < 200; begin += 80)
+        {
+            int width = (200 - begin < 80) ? 200 - begin : 80;
+            range (samples + begin, width, &max, &min);
+            scale (samples + begin, scaled, width, 10, min, max);
+            fill_frame (scaled, '*', width, 10, expected + used);
+            used += 10 * (width + 1);
+        }
+        TEST(used, output_size);
+        TEST(0, memcmp(expected, output, used));
+        free(output);
+    }
+
+    /* Testing text that is not a number: the stream fails at it, before any frame when it can seek.*/
+    FILE * in = tmpfile();
+    fputs("1 2 x 3\n", in);
+    rewind(in);
+    FILE * out = open_memstream(&output, &output_size);
+    TEST(-1, stream_plot (in, STREAM_TEXT, out, '*', 80, 10, chunk, scaled, frame, &bad_sample));
+    fclose(out);
+    fclose(in);
+    TEST(2, bad_sample);
+    TEST(0, output_size);
+    free(output);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testStream
+
+/* Tests for table_export(), table_map() and plot_table(). */
+int
+testTable (void)
+{
+    int numErrors = 0;
+    printf("--TABLE TESTS--");
+
+    char path[] = "/tmp/plot_table_XXXXXX";
+    int descriptor = mkstemp(path);
+    float cubic[] = {0,1,18,1};
+    struct function_spec functions[2] = { { FUNCTION_COSINE, NULL, 0 }, { FUNCTION_POLYNOMIAL, cubic, 3 } };
+    size_t len = 2500;
+    float * expected = malloc(len * sizeof(float));
+    int * scaled = malloc(len * sizeof(int));
+    char * frame = malloc(20 * (len + 1));
+    char * expected_frame = malloc(20 * (len + 1));
+    struct sample_table table;
+    float max;
+    float min;
+    close(descriptor);
+
+    for (int f = 0; f < 2; f++)
+    {
+        TEST(0, table_export (path, &functions[f], len, 0.01, 3));
+        TEST(0, table_map (path, &table));
+
+        /* Testing the header and the aligned samples.*/
+        evaluate_block (&functions[f], expected, 0, len, 0.01, 3);
+        range (expected, len, &max, &min);
+        TEST(len, table.header->len);
+        TEST(functions[f].kind, table.header->function_kind);
+        TEST(max, table.header->max);
+        TEST(min, table.header->min);
+        TEST(functions[f].degree, table.header->degree);
+        TEST(0, table.header->payload_offset % TABLE_ALIGNMENT);
+        TEST(0, memcmp(expected, table.values, len * sizeof(float)));
+        if (functions[f].kind == FUNCTION_POLYNOMIAL)
+        {
+            TEST(0, memcmp(cubic, table.coeffs, sizeof(cubic)));
+        }
+
+        /* Testing the plot matches one with a scanned range.*/
+        char * output;
+        size_t output_size;
+        FILE * out = open_memstream(&output, &output_size);
+        TEST(0, plot_table (&table, out, '*', 20, scaled, frame));
+        fclose(out);
+        scale (expected, scaled, len, 20, min, max);
+        fill_frame (scaled, '*', len, 20, expected_frame);
+        TEST(20 * (len + 1), output_size);
+        TEST(0, memcmp(expected_frame, output, output_size));
+        free(output);
+        table_unmap (&table);
+        TEST(NULL, table.values);
+    }
+
+    /* Testing headers that place the coefficients or the samples past the end of the file are refused.*/
+    struct table_header good;
+    struct table_header bad;
+    FILE * file = fopen(path, "rb");
+    TEST(1, fread(&good, sizeof(good), 1, file));
+    fclose(file);
+    for (int field = 0; field < 3; field++)
+    {
+        bad = good;
+        if (field == 0)
+        bad.payload_offset = 1u << 30;
+        else if (field == 1)
+        bad.len = UINT64_MAX / sizeof(float) + 2; /* Wraps to a few bytes when multiplied.*/
+        else
+        bad.degree = TABLE_ALIGNMENT;
+        file = fopen(path, "r+b");
+        fwrite(&bad, sizeof(bad), 1, file);
+        fclose(file);
+        TEST(-1, table_map (path, &table));
+    }
+
+    /* Testing a table too long for an int is not plotted.*/
+    bad = good;
+    bad.len = (uint64_t) INT_MAX + 1;
+    table.header = &bad;
+    TEST(-1, plot_table (&table, stdout, '*', 20, scaled, frame));
+
+    /* Testing a file that is not a table is refused.*/
+    FILE * other = fopen(path, "w");
+    fprintf(other, "not a table, but long enough to hold a header of one\n");
+    fclose(other);
+    TEST(-1, table_map (path, &table));
+    unlink(path);
+    TEST(-1, table_map (path, &table));
+
+    free(expected);
+    free(scaled);
+    free(frame);
+    free(expected_frame);
+    reportTests (numErrors);
+    return numErrors;
+} //testTable
+
+/* Tests for cache_get(). */
+int
+testCache (void)
+{
+    int numErrors = 0;
+    printf("--CACHE TESTS--");
+
+    struct sample_cache cache;
+    struct function_spec cosine_function = { FUNCTION_COSINE, NULL, 0 };
+    float cubic[] = {0,1,18,1};
+    float other[] = {0,1,18,2};
+    struct function_spec cubic_function = { FUNCTION_POLYNOMIAL, cubic, 3 };
+    struct function_spec other_function = { FUNCTION_POLYNOMIAL, other, 3 };
+    const struct cache_entry * entry;
+    float values[80];
+    int scaled[80];
+    char frame[60 * 81];
+    float max;
+    float min;
+
+    /* Room for two 80 column entries, not three.*/
+    cache_init (&cache, 2 * (sizeof(struct cache_entry) + 80 * 8 + 60 * 81 + 64));
+
+    /* Testing a miss fills the entry like the separate passes.*/
+    entry = cache_get (&cache, &cosine_function, 80, 0.15, 0, 60, '*');
+    cosine (values, 80, 0.15, 0);
+    range (values, 80, &max, &min);
+    scale (values, scaled, 80, 60, min, max);
+    fill_frame (scaled, '*', 80, 60, frame);
+    TEST(0, memcmp(values, entry->values, sizeof(values)));
+    TEST(max, entry->max);
+    TEST(min, entry->min);
+    TEST(0, memcmp(scaled, entry->levels, sizeof(scaled)));
+    TEST(0, memcmp(frame, entry->frame, sizeof(frame)));
+    TEST(1, cache.misses);
+
+    /* Testing repeats hit, and any change to the key misses.*/
+    TEST(entry, cache_get (&cache, &cosine_function, 80, 0.15, 0, 60, '*'));
+    TEST(1, cache.hits);
+    cache_get (&cache, &cubic_function, 80, 0.375, 20, 60, '*');
+    cache_get (&cache, &cosine_function, 80, 0.15, 0, 60, '*');
+    TEST(2, cache.hits);
+    TEST(2, cache.misses);
+    TEST(0, cache.evictions);
+
+    /* Testing a cosine is the same key whatever degree and coefficients it carries.*/
+    struct function_spec cosine_with_degree = { FUNCTION_COSINE, other, 3 };
+    TEST(entry, cache_get (&cache, &cosine_with_degree, 80, 0.15, 0, 60, '*'));
+    TEST(3, cache.hits);
+    TEST(2, cache.misses);
+
+    /* Testing the least recently used entry, the cubic, is the one evicted.*/
+    cache_get (&cache, &other_function, 80, 0.375, 20, 60, '*');
+    TEST(1, cache.evictions);
+    cache_get (&cache, &cosine_function, 80, 0.15, 0, 60, '*');
+    TEST(4, cache.hits);
+    cache_get (&cache, &cubic_function, 80, 0.375, 20, 60, '*');
+    TEST(4, cache.misses);
+    TEST(2, cache.evictions);
+    TEST(1, cache.used <= cache.budget);
+
+    /* Testing an entry over the whole budget is refused.*/
+    TEST(NULL, cache_get (&cache, &cosine_function, 100000, 0.15, 0, 60, '*'));
+
+    cache_free (&cache);
+    TEST(0, cache.used);
+    reportTests (numErrors);
+    return numErrors;
+} //testCache
+
+/* Tests for the cosine tiers. */
+int
+testCosineTiers (void)
+{
+    int numErrors = 0;
+    printf("--COSINE TIER TESTS--");
+
+    float values[1003];
+    float exact[1003];
+    int scaled[80];
+    int scaled_exact[80];
+    float max;
+    float min;
+    size_t i;
+    enum cosine_tier tier;
+
+    /* Testing every tier measures within its bound, and the bounds are in order.*/
+    for (tier = COSINE_TABLE; tier <= COSINE_LIBM; tier++)
+    {
+        TEST(1, cosine_tier_measure (tier, 1 << 18) <= cosine_tier_bound (tier));
+        cosine_tiered (values, 1003, 7.9, -100.0, tier);
+        for (i = 0; i < 1003; i++)
+        FTEST(values[i], cos((double) get_x(i, 7.9, -100.0)), cosine_tier_bound (tier));
+    }
+    TEST(1, cosine_tier_bound (COSINE_TABLE) > cosine_tier_bound (COSINE_MINIMAX));
+    TEST(1, cosine_tier_bound (COSINE_MINIMAX) > cosine_tier_bound (COSINE_LIBM));
+
+    /* Testing the libm tier is cosine() itself.*/
+    cosine (exact, 1003, 0.15, 70.0);
+    cosine_tiered (values, 1003, 0.15, 70.0, COSINE_LIBM);
+    TEST(0, memcmp(values, exact, sizeof(exact)));
+
+    /* Testing the choice: a 60 row plot of a full swing takes the table,
+       a tiny span needs more, and the minimax one stops at COSINE_APPROX_LIMIT.*/
+    TEST(COSINE_TABLE, cosine_tier_choose (60, 2.0, 100));
+    TEST(COSINE_TABLE, cosine_tier_choose (60, 2.0, 1e5));
+    TEST(COSINE_MINIMAX, cosine_tier_choose (60, 1e-3, 100));
+    TEST(COSINE_LIBM, cosine_tier_choose (60, 1e-3, 1e5));
+    TEST(COSINE_LIBM, cosine_tier_choose (60, 1e-6, 100));
+
+    /* Testing the levels of the chosen tier are within one of the exact ones.*/
+    TEST(COSINE_TABLE, cosine_for_height (values, 80, 0.15, 0, 60));
+    range (values, 80, &max, &min);
+    scale (values, scaled, 80, 60, min, max);
+    cosine (exact, 80, 0.15, 0);
+    range (exact, 80, &max, &min);
+    scale (exact, scaled_exact, 80, 60, min, max);
+    for (i = 0; i < 80; i++)
+    TEST(1, abs(scaled[i] - scaled_exact[i]) <= 1);
+    TEST(COSINE_LIBM, cosine_for_height (values, 80, 1e-6, 0, 60));
+    TEST(COSINE_TABLE, cosine_for_height (values, 0, 0.15, 0, 60));
+
+    /* Testing a span too small for the table fills once with the minimax tier.*/
+    TEST(COSINE_MINIMAX, cosine_for_height (values, 80, 1e-4, 0, 60));
+    cosine_batch (exact, 80, 1e-4, 0);
+    TEST(0, memcmp(values, exact, 80 * sizeof(float)));
+
+    /* Testing thousands of periods, too many for the range oracle, still take the table from a prefix.*/
+    float * periods = malloc(100000 * sizeof(float));
+    TEST(COSINE_TABLE, cosine_for_height (periods, 100000, 0.15, 0, 60));
+    TEST(-1, range_oracle (&(struct function_spec){ FUNCTION_COSINE, NULL, 0 }, 100000, 0.15, 0, &max, &min));
+    free(periods);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testCosineTiers
+
+/* Tests for plot_overlay() and the procedures under it. */
+int
+testOverlay (void)
+{
+    int numErrors = 0;
+    printf("--OVERLAY TESTS--");
+
+    float rising[] = {0, 1, 2, 3};
+    float falling[] = {3, 2, 1, 0};
+    float small[] = {1, 1, 1, 1};
+    struct series pair[] = { { rising, 'x' }, { falling, 'o' } };
+    struct series three[] = { { rising, 'x' }, { falling, 'o' }, { small, '-' } };
+    float max;
+    float min;
+    int scaled[80];
+    char drawn[60 * 80];
+    char frame[60 * 81];
+    char single[60 * 81];
+
+    /* Testing the joint range covers every series.*/
+    range_series (pair, 2, 4, &max, &min);
+    TEST(3, max);
+    TEST(0, min);
+    range_series (&three[2], 1, 4, &max, &min);
+    TEST(1, max);
+    TEST(1, min);
+
+    /* Testing the crossing of two lines under each policy.*/
+    fill_overlay_frame (pair, 2, 4, 4, 0, 3, COLLISION_FIRST, scaled, drawn, frame);
+    TEST(0, memcmp(frame, "o  x\n ox \n xo \nx  o\n", 20));
+    fill_overlay_frame (pair, 2, 4, 4, 0, 3, COLLISION_LAST, scaled, drawn, frame);
+    TEST(0, memcmp(frame, "o  x\n ox \n xo \nx  o\n", 20));
+    fill_overlay_frame (three, 3, 4, 4, 0, 3, COLLISION_FIRST, scaled, drawn, frame);
+    TEST(0, memcmp(frame, "o  x\n ox \n-xo-\nx  o\n", 20));
+    fill_overlay_frame (three, 3, 4, 4, 0, 3, COLLISION_LAST, scaled, drawn, frame);
+    TEST(0, memcmp(frame, "o  x\n ox \n----\nx  o\n", 20));
+    fill_overlay_frame (three, 3, 4, 4, 0, 3, COLLISION_MARK, scaled, drawn, frame);
+    TEST(0, memcmp(frame, "o  x\n ox \n-##-\nx  o\n", 20));
+
+    /* Testing a series drawn with ' ' still takes its cells.*/
+    struct series hidden[] = { { rising, ' ' }, { rising, 'o' } };
+    fill_overlay_frame (hidden, 2, 4, 4, 0, 3, COLLISION_FIRST, scaled, drawn, frame);
+    TEST(0, memcmp(frame, "    \n    \n    \n    \n", 20));
+    fill_overlay_frame (hidden, 2, 4, 4, 0, 3, COLLISION_MARK, scaled, drawn, frame);
+    TEST(0, memcmp(frame, "   #\n  # \n #  \n#   \n", 20));
+
+    /* Testing one series alone draws what plot_buffered() draws.*/
+    float values[80];
+    cosine (values, 80, 0.15, 0);
+    struct series wave = { values, '*' };
+    range (values, 80, &max, &min);
+    scale (values, scaled, 80, 60, min, max);
+    fill_frame (scaled, '*', 80, 60, single);
+    fill_overlay_frame (&wave, 1, 80, 60, min, max, COLLISION_MARK, scaled, drawn, frame);
+    TEST(0, memcmp(frame, single, sizeof(frame)));
+
+    /* Testing plot_overlay() writes exactly one frame.*/
+    char * text = NULL;
+    size_t size = 0;
+    FILE * out = open_memstream(&text, &size);
+    plot_overlay (pair, 2, 4, 4, COLLISION_FIRST, out, scaled, drawn, frame);
+    fclose(out);
+    TEST(20, size);
+    TEST(0, memcmp(text, "o  x\n ox \n xo \nx  o\n", 20));
+    free(text);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testOverlay
+
+#ifdef INSTRUMENT
+/* Tests for the instrumentation. */
+int
+testInstrument (void)
+{
+    int numErrors = 0;
+    printf("--INSTRUMENT TESTS--");
+
+    float rising[] = {0, 1, 2, 3};
+    struct series line = { rising, 'x' };
+    float values[80];
+    int scaled[80];
+    char drawn[4 * 4];
+    char frame[4 * 5];
+    float max;
+    float min;
+
+    /* Testing the probes and counters of one pass through the plot path.*/
+    instrument_reset ();
+    cosine (values, 80, 0.15, 0);
+    range (values, 80, &max, &min);
+    scale (values, scaled, 80, 60, min, max);
+    TEST(1, instrument_totals.calls[PROBE_COSINE]);
+    TEST(1, instrument_totals.calls[PROBE_RANGE]);
+    TEST(1, instrument_totals.calls[PROBE_SCALE]);
+    TEST(0, instrument_totals.calls[PROBE_POLYNOMIAL]);
+    TEST(1, instrument_totals.ns[PROBE_COSINE] > 0);
+    TEST(80, instrument_totals.evaluations);
+    TEST(80, instrument_totals.quantize_calls);
+
+    /* Testing the bytes of a frame are counted, and its 4 quantize calls.*/
+    char * text = NULL;
+    size_t size = 0;
+    FILE * out = open_memstream(&text, &size);
+    plot_overlay (&line, 1, 4, 4, COLLISION_FIRST, out, scaled, drawn, frame);
+    fclose(out);
+    free(text);
+    TEST(20, instrument_totals.bytes_written);
+
+    /* Testing the summary names the probes that ran and the counters.*/
+    char summary[1024];
+    int pipe_ends[2];
+    TEST(0, pipe(pipe_ends));
+    instrument_dump (pipe_ends[1]);
+    close (pipe_ends[1]);
+    ssize_t got = read(pipe_ends[0], summary, sizeof(summary) - 1);
+    close (pipe_ends[0]);
+    summary[got > 0 ? got : 0] = '\0';
+    TEST(1, strstr(summary, "cosine calls 1 ") != NULL);
+    TEST(1, strstr(summary, "polynomial") == NULL);
+    TEST(1, strstr(summary, "quantize_calls 84\n") != NULL);
+    TEST(1, strstr(summary, "bytes_written 20 ") != NULL);
+
+    /* Testing every other fill counts its evaluations too.*/
+    float cubic[] = {0,1,18,1};
+    struct expression expr;
+    struct jit_function jit;
+    expression_compile ("x*x", &expr);
+    expression_jit (&expr, &jit);
+    instrument_reset ();
+    cosine_batch (values, 80, 0.15, 0);
+    TEST(80, instrument_totals.evaluations);
+    polynomial_batch (cubic, 3, values, 80, 0.375, 20);
+    TEST(160, instrument_totals.evaluations);
+    polynomial_parallel (cubic, 3, values, 80, 0.375, 20);
+    TEST(240, instrument_totals.evaluations);
+    expression_fill (&expr, values, 80, 0.15, 0);
+    TEST(320, instrument_totals.evaluations);
+    expression_fill_jit (&expr, &jit, values, 80, 0.15, 0);
+    TEST(400, instrument_totals.evaluations);
+    cosine_tiered (values, 80, 0.15, 0, COSINE_TABLE);
+    TEST(480, instrument_totals.evaluations);
+
+    /* Testing the paths that evaluate one sample at a time count each one.*/
+    struct function_spec cosine_function = { FUNCTION_COSINE, NULL, 0 };
+    struct viewport view;
+    TEST(0, viewport_init (&view, &cosine_function, '*', 80, 20, 0.15, 20));
+    TEST(560, instrument_totals.evaluations);
+    viewport_pan (&view, 7);
+    TEST(567, instrument_totals.evaluations);
+    viewport_pan (&view, -300);
+    TEST(647, instrument_totals.evaluations);
+    TEST(view.evaluations, instrument_totals.evaluations - 480);
+    viewport_free (&view);
+    instrument_reset ();
+    size_t evaluations = adaptive_fill (&cosine_function, values, 80, 0.15, 0, 60);
+    TEST(evaluations, instrument_totals.evaluations);
+    TEST(1, evaluations > 0 && evaluations <= 80);
+    jit_release (&jit);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testInstrument
+#endif
+
+/* Tests for the batch quantizers, with quantize() as the oracle. */
+int
+testQuantizeBatch (void)
+{
+    int numErrors = 0;
+    printf("--QUANTIZE BATCH TESTS--");
+
+    struct quantizer quantizer;
+    uint8_t narrow[4096];
+    uint16_t wide[4096];
+    float values[4096];
+    size_t i;
+    enum batch_kernel best = batch_kernel_select (KERNEL_AVX2);
+    enum batch_kernel kernel;
+
+    /* Testing the boundaries of testQuantize().*/
+    float negative[] = {-4, -1, -10};
+    TEST(0, quantizer_init (&quantizer, 10, -10, -1));
+    quantize_batch_u8 (&quantizer, negative, narrow, 3);
+    TEST(6, narrow[0]);
+    TEST(9, narrow[1]);
+    TEST(0, narrow[2]);
+    quantizer_free (&quantizer);
+    float positive[] = {46, 110, 10};
+    TEST(0, quantizer_init (&quantizer, 5, 10, 110));
+    quantize_batch_u16 (&quantizer, positive, wide, 3);
+    TEST(1, wide[0]);
+    TEST(4, wide[1]);
+    TEST(0, wide[2]);
+    quantizer_free (&quantizer);
+    float mixed[] = {10, -4, 20, -20};
+    TEST(0, quantizer_init (&quantizer, 4, -20, 20));
+    quantize_batch_u8 (&quantizer, mixed, narrow, 4);
+    TEST(3, narrow[0]);
+    TEST(1, narrow[1]);
+    TEST(3, narrow[2]);
+    TEST(0, narrow[3]);
+    quantizer_free (&quantizer);
+
+    /* Testing every value quantize() puts on either side of a level boundary, and a sweep between them,
+       for ranges and heights where the reciprocal rounds differently from the divide, on every kernel.*/
+    float mins[] = { -1, 0.1, -10, 3, 0, -3e-41, 0 }; /* The last three with a subnormal step.*/
+    float maxes[] = { 1, 0.7, -1, 1e6, 1e-40, 2e-41, 1e-36 };
+    int heights[] = { 3, 10, 60, 255, 1000 };
+    int h;
+    int r;
+    for (r = 0; r < 7; r++)
+    {
+        for (h = 0; h < 5; h++)
+        {
+            float min = mins[r];
+            float max = maxes[r];
+            int levels = heights[h];
+            size_t count = 0;
+            TEST(0, quantizer_init (&quantizer, levels, min, max));
+            for (i = 1; i < (size_t) levels && count + 4 <= 2048; i++)
+            {
+                float boundary = min + quantizer.thresholds[i];
+                values[count++] = nextafterf(boundary, -INFINITY);
+                values[count++] = boundary;
+                values[count++] = nextafterf(boundary, INFINITY);
+                values[count++] = min + (max - min) * i / levels;
+            }
+            for (i = 0; count < 4096; i++)
+            values[count++] = min + (max - min) * ((i * 2654435761u) % 100003) / 100002.0;
+            values[0] = min;
+            values[1] = max;
+            for (kernel = KERNEL_SCALAR; kernel <= best; kernel++)
+            {
+                batch_kernel_select (kernel);
+                quantize_batch_u16 (&quantizer, values, wide, count);
+                if (levels <= 256)
+                quantize_batch_u8 (&quantizer, values, narrow, count);
+                for (i = 0; i < count; i++)
+                {
+                    if (values[i] < min || values[i] > max)
+                    continue;
+                    int expected = quantize(values[i], levels, min, max);
+                    TEST(expected, wide[i]);
+                    if (levels <= 256)
+                    TEST(expected, narrow[i]);
+                }
+            }
+            quantizer_free (&quantizer);
+        }
+    }
+
+    /* Testing values outside the range clamp, and an empty range gives level 0.*/
+    float outside[] = {-30, 30, 5};
+    TEST(0, quantizer_init (&quantizer, 4, -20, 20));
+    quantize_batch_u8 (&quantizer, outside, narrow, 3);
+    TEST(0, narrow[0]);
+    TEST(3, narrow[1]);
+    quantizer_free (&quantizer);
+    TEST(0, quantizer_init (&quantizer, 60, 5, 5));
+    quantize_batch_u8 (&quantizer, outside, narrow, 3);
+    TEST(0, narrow[0]);
+    TEST(0, narrow[1]);
+    TEST(0, narrow[2]);
+    quantizer_free (&quantizer);
+    batch_kernel_select (best);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testQuantizeBatch
+
+/* Reads the levels back from a rendered frame, for testRender(). */
+static void
+read_render_frame (const char frame[], int len, int height, enum render_mode mode, int levels[])
+{
+    int subcells = render_subcells(mode);
+    const unsigned char * cursor = (const unsigned char *) frame;
+    int i;
+    int j;
+    for (i = 0; i < len; i++)
+    levels[i] = -1;
+    for (j = 0; j < height; j++)
+    {
+        int base = (height - 1 - j) * subcells; /* Level of the bottom of this row.*/
+        int cell = 0;
+        while (*cursor != '\n')
+        {
+            int bits = 0;
+            if (*cursor == ' ')
+            cursor++;
+            else if (mode == RENDER_ASCII)
+            {
+                bits = 1;
+                cursor++;
+            }
+            else
+            {
+                int code = ((cursor[0] & 0x0f) << 12) | ((cursor[1] & 0x3f) << 6) | (cursor[2] & 0x3f);
+                bits = code - ((mode == RENDER_BRAILLE) ? 0x2800 : 0);
+                cursor += 3;
+            }
+            if (mode == RENDER_ASCII && bits)
+            levels[cell] = base;
+            if (mode == RENDER_HALF_BLOCK && bits)
+            levels[cell] = base + (bits == 0x2580);
+            if (mode == RENDER_BRAILLE)
+            {
+                int dots[2][4] = { { 0x40, 0x04, 0x02, 0x01 }, { 0x80, 0x20, 0x10, 0x08 } };
+                int column;
+                int sub;
+                for (column = 0; column < 2; column++)
+                {
+                    for (sub = 0; sub < 4; sub++)
+                    {
+                        if (bits & dots[column][sub])
+                        levels[2 * cell + column] = base + sub;
+                    }
+                }
+            }
+            cell++;
+        }
+        cursor++;
+    }
+} //read_render_frame
+
+/* Tests for the render modes. */
+int
+testRender (void)
+{
+    int numErrors = 0;
+    printf("--RENDER TESTS--");
+
+    float values[81];
+    int scaled[81];
+    int levels[81];
+    char frame[60 * (81 * 3 + 1)];
+    char expected[60 * 82];
+    enum render_mode mode;
+    int i;
+
+    TEST(1, render_subcells (RENDER_ASCII));
+    TEST(2, render_subcells (RENDER_HALF_BLOCK));
+    TEST(4, render_subcells (RENDER_BRAILLE));
+
+    /* Testing small frames byte for byte.*/
+    int pair[] = { 0, 3 };
+    TEST(4, fill_render_frame (pair, 2, 1, RENDER_BRAILLE, '*', frame));
+    TEST(0, memcmp(frame, "\xe2\xa1\x88\n", 4));
+    int halves[] = { 0, 3, 2 };
+    TEST(14, fill_render_frame (halves, 3, 2, RENDER_HALF_BLOCK, '*', frame));
+    TEST(0, memcmp(frame, " \xe2\x96\x80\xe2\x96\x84\n\xe2\x96\x84  \n", 14));
+
+    /* Testing ASCII mode is fill_frame().*/
+    cosine (values, 81, 0.15, 0);
+    float max;
+    float min;
+    range (values, 81, &max, &min);
+    scale (values, scaled, 81, 60, min, max);
+    fill_frame (scaled, '*', 81, 60, expected);
+    TEST(60 * 82, fill_render_frame (scaled, 81, 60, RENDER_ASCII, '*', frame));
+    TEST(0, memcmp(frame, expected, 60 * 82));
+
+    /* Testing every mode keeps every level scale() gives at its resolution, on an odd width.*/
+    for (mode = RENDER_ASCII; mode <= RENDER_BRAILLE; mode++)
+    {
+        int height = 15;
+        scale (values, scaled, 81, height * render_subcells(mode), min, max);
+        TEST(1, fill_render_frame (scaled, 81, height, mode, '*', frame) <= render_frame_size (mode, 81, height));
+        read_render_frame (frame, 81, height, mode, levels);
+        for (i = 0; i < 81; i++)
+        TEST(scaled[i], levels[i]);
+    }
+
+    /* Testing plot_render() writes the frame once.*/
+    char * text = NULL;
+    size_t size = 0;
+    FILE * out = open_memstream(&text, &size);
+    plot_render (values, 81, 15, RENDER_BRAILLE, '*', out, scaled, frame);
+    fclose(out);
+    TEST(fill_render_frame (scaled, 81, 15, RENDER_BRAILLE, '*', frame), size);
+    TEST(0, memcmp(text, frame, size));
+    free(text);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testRender
+
+/* Plays ANSI output onto a virtual screen of height rows of len characters, for testDiff(). Understands
+   cursor positions, cursor forward, clearing and plain characters, which is all diff_render() writes. */
+static void
+replay_ansi (const char * text, size_t size, char screen[], int len, int height)
+{
+    int row = 0;
+    int column = 0;
+    size_t k = 0;
+    while (k < size)
+    {
+        if (text[k] != '\x1b')
+        {
+            if (row < height && column < len)
+            screen[row * len + column] = text[k];
+            column++;
+            k++;
+            continue;
+        }
+        int numbers[2] = { 0, 0 };
+        int count = 0;
+        for (k += 2; isdigit((unsigned char) text[k]) || text[k] == ';'; k++)
+        {
+            if (text[k] == ';')
+            count++;
+            else
+            numbers[count] = numbers[count] * 10 + text[k] - '0';
+        }
+        if (text[k] == 'H')
+        {
+            row = numbers[0] ? numbers[0] - 1 : 0;
+            column = numbers[1] ? numbers[1] - 1 : 0;
+        }
+        else if (text[k] == 'C')
+        column += numbers[0] ? numbers[0] : 1;
+        else if (text[k] == 'J')
+        memset(screen, ' ', (size_t) len * height);
+        k++;
+    }
+} //replay_ansi
+
+/* Tests for diff_render(), replaying its output against full frames. */
+int
+testDiff (void)
+{
+    int numErrors = 0;
+    printf("--DIFF TESTS--");
+
+    struct diff_renderer renderer;
+    float values[80];
+    int scaled[80];
+    char frame[60 * 81];
+    char screen[60 * 80];
+    char * text = NULL;
+    size_t size = 0;
+    float max;
+    float min;
+    int step;
+    int j;
+
+    memset(screen, '?', sizeof(screen));
+    TEST(0, diff_init (&renderer, 80, 60));
+    for (step = 0; step < 40; step++)
+    {
+        /* Panning the cosine a little each frame, with a new symbol halfway.*/
+        char symbol = (step < 20) ? '*' : 'o';
+        cosine (values, 80, 0.15, -0.05 * step);
+        range (values, 80, &max, &min);
+        scale (values, scaled, 80, 60, min, max);
+        FILE * out = open_memstream(&text, &size);
+        size_t written = diff_render (&renderer, scaled, symbol, out);
+        fclose(out);
+        TEST(written, size);
+        replay_ansi (text, size, screen, 80, 60);
+        free(text);
+        text = NULL;
+
+        /* Testing the screen holds the full frame, and panned frames take far fewer bytes.*/
+        fill_frame (scaled, symbol, 80, 60, frame);
+        for (j = 0; j < 60; j++)
+        TEST(0, memcmp(screen + j * 80, frame + j * 81, 80));
+        if (step != 0 && step != 20)
+        TEST(1, written < sizeof(frame) / 4);
+    }
+
+    /* Testing an unchanged frame writes nothing.*/
+    FILE * out = open_memstream(&text, &size);
+    TEST(0, diff_render (&renderer, scaled, 'o', out));
+    fclose(out);
+    TEST(0, size);
+    free(text);
+
+    diff_free (&renderer);
+
+    /* Testing coordinates of many digits: every cell on its own row, so each one takes a full cursor move.*/
+    int wide = 20000;
+    int tall = 100000000;
+    int gap = tall / wide;
+    int * levels = malloc(wide * sizeof(int));
+    char move[32];
+    size_t expected = snprintf(move, sizeof(move), "\x1b[%d;1H", tall + 1);
+    TEST(0, diff_init (&renderer, wide, tall));
+    for (step = 0; step < 2; step++)
+    {
+        for (j = 0; j < wide; j++)
+        levels[j] = j * gap + step * gap / 2;
+        FILE * out = open_memstream(&text, &size);
+        size_t written = diff_render (&renderer, levels, '*', out);
+        fclose(out);
+        free(text);
+        text = NULL;
+        if (step == 1)
+        {
+            /* Blanking the old cell and drawing the new one of every column.*/
+            for (j = 0; j < wide; j++)
+            {
+                expected += snprintf(move, sizeof(move), "\x1b[%d;%dH", tall - j * gap, j + 1) + 1;
+                expected += snprintf(move, sizeof(move), "\x1b[%d;%dH", tall - levels[j], j + 1) + 1;
+            }
+            TEST(expected, written);
+        }
+    }
+    diff_free (&renderer);
+    free(levels);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testDiff
+
+/* Tests for the batch mode and its arena. */
+int
+testBatchMode (void)
+{
+    int numErrors = 0;
+    printf("--BATCH MODE TESTS--");
+
+    struct arena arena;
+    struct plot_job job;
+    struct plot_job * jobs;
+    size_t count;
+    size_t bad_line;
+
+    /* Testing the arena aligns, refuses what does not fit and starts over on reset.*/
+    TEST(0, arena_init (&arena, 256));
+    char * first = arena_alloc (&arena, 10);
+    char * second = arena_alloc (&arena, 10);
+    TEST(0, ((uintptr_t) first) % 64);
+    TEST(64, second - first);
+    TEST(NULL, arena_alloc (&arena, 200));
+    arena_reset (&arena);
+    TEST(first, arena_alloc (&arena, 200));
+    arena_free (&arena);
+
+    /* Testing the job lines.*/
+    TEST(1, batch_parse ("cosine 0.15 0 80 60", &job));
+    TEST(FUNCTION_COSINE, job.function.kind);
+    TEST(80, job.width);
+    TEST('*', job.symbol);
+    TEST(1, batch_parse ("polynomial 0,1,18,1 0.375 20 80 60 o\n", &job));
+    TEST(FUNCTION_POLYNOMIAL, job.function.kind);
+    TEST(3, job.function.degree);
+    TEST(18, job.coeffs[2]);
+    TEST('o', job.symbol);
+    TEST(0, batch_parse ("# a comment", &job));
+    TEST(0, batch_parse ("   \n", &job));
+    TEST(-1, batch_parse ("sine 0.15 0 80 60", &job));
+    TEST(-1, batch_parse ("cosine 0.15 0 0 60", &job));
+    TEST(-1, batch_parse ("polynomial 1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17 1 0 80 60", &job));
+
+    /* Testing a bad line is reported by its number.*/
+    char bad_text[] = "cosine 0.15 0 80 60\n\npolynomial 1,2 1 0 x 60\n";
+    FILE * in = fmemopen(bad_text, strlen(bad_text), "r");
+    TEST(-1, batch_read (in, &jobs, &count, &bad_line));
+    TEST(3, bad_line);
+    fclose(in);
+
+    /* Testing sizes over JOB_MAX_SIZE and lines over JOB_MAX_LINE are refused, and the last line needs no newline.*/
+    TEST(-1, batch_parse ("cosine 0.15 0 65537 60", &job));
+    TEST(-1, batch_parse ("cosine 0.15 0 80 2147483647", &job));
+    TEST(-1, batch_parse ("cosine 0.15 0 80 99999999999999999999", &job));
+    TEST(-1, batch_parse ("cosine 0.15 0 65536 65536", &job)); /* Over JOB_MAX_FRAME.*/
+    TEST(1, batch_parse ("cosine 0.15 0 65535 1024", &job));
+
+    /* Testing junk after a field or after the symbol is refused.*/
+    TEST(-1, batch_parse ("cosine 0.15 0 80 60 ox", &job));
+    TEST(-1, batch_parse ("cosine 0.15 0 80 60 o x", &job));
+    TEST(-1, batch_parse ("cosine 0.15 0 80x 60", &job));
+    TEST(-1, batch_parse ("cosine 0.15y 0 80 60", &job));
+    TEST(-1, batch_parse ("cosine 0.15 0 80", &job));
+    TEST(1, batch_parse ("cosine 0.15 0 80 60 o \n", &job));
+    TEST('o', job.symbol);
+
+    /* Testing a list whose frames pass BATCH_MAX_BYTES is refused at the job that passes it.*/
+    char big_text[40 * 32] = "";
+    for (size_t j = 0; j < 20; j++)
+    strcat(big_text, "cosine 0.15 0 65535 1000\n");
+    in = fmemopen(big_text, strlen(big_text), "r");
+    TEST(-1, batch_read (in, &jobs, &count, &bad_line));
+    TEST(BATCH_MAX_BYTES / (65536 * 1000) + 1, bad_line);
+    fclose(in);
+    TEST(1, batch_parse ("cosine 0.15 0 65535 1000", &job));
+    struct plot_job big_jobs[20];
+    for (size_t j = 0; j < 20; j++)
+    big_jobs[j] = job;
+    TEST(-1, batch_render (big_jobs, 20, stdout));
+    char long_text[2 * JOB_MAX_LINE + 64];
+    snprintf(long_text, sizeof(long_text), "cosine 0.15 0 80 60%*s\ncosine 0.15 0 80 60\n", 2 * JOB_MAX_LINE, "");
+    in = fmemopen(long_text, strlen(long_text), "r");
+    TEST(-1, batch_read (in, &jobs, &count, &bad_line));
+    TEST(1, bad_line);
+    fclose(in);
+    char last_text[] = "cosine 0.15 0 80 60\ncosine 0.15 0 80 60";
+    in = fmemopen(last_text, strlen(last_text), "r");
+    TEST(0, batch_read (in, &jobs, &count, &bad_line));
+    TEST(2, count);
+    fclose(in);
+    free(jobs);
+
+    /* Testing the frames come out in order, the same on one thread as on several.*/
+    char text[4096] = "# the plots of main()\n";
+    int k;
+    for (k = 0; k < 40; k++)
+    {
+        size_t used = strlen(text);
+        if (k % 2)
+        snprintf(text + used, sizeof(text) - used, "polynomial 0,1,18,1 %g 20 %d %d x\n", 0.375 + k * 0.01, 20 + k, 5 + k);
+        else
+        snprintf(text + used, sizeof(text) - used, "cosine 0.15 %d %d 10 *\n", k, 30 + k);
+    }
+    in = fmemopen(text, strlen(text), "r");
+    TEST(0, batch_read (in, &jobs, &count, &bad_line));
+    fclose(in);
+    TEST(40, count);
+
+    char * expected = NULL;
+    size_t expected_size = 0;
+    FILE * out = open_memstream(&expected, &expected_size);
+    for (k = 0; k < 40; k++)
+    {
+        float values[80];
+        int scaled[80];
+        char frame[45 * 81];
+        float max;
+        float min;
+        jobs[k].function.coeffs = jobs[k].coeffs;
+        evaluate_block (&jobs[k].function, values, 0, jobs[k].width, jobs[k].x_scale, jobs[k].x_shift);
+        range (values, jobs[k].width, &max, &min);
+        scale (values, scaled, jobs[k].width, jobs[k].height, min, max);
+        fill_frame (scaled, jobs[k].symbol, jobs[k].width, jobs[k].height, frame);
+        fwrite (frame, 1, (size_t) jobs[k].height * (jobs[k].width + 1), out);
+    }
+    fclose(out);
+
+    int threads[] = { 1, 4 };
+    for (k = 0; k < 2; k++)
+    {
+        char * rendered = NULL;
+        size_t rendered_size = 0;
+        out = open_memstream(&rendered, &rendered_size);
+        set_thread_count (threads[k]);
+        TEST(0, batch_render (jobs, count, out));
+        fclose(out);
+        TEST(expected_size, rendered_size);
+        TEST(0, memcmp(expected, rendered, expected_size));
+        free(rendered);
+    }
+    set_thread_count (1);
+    free(expected);
+    free(jobs);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testBatchMode
+
+/* Tests for range_oracle(), with range() over the filled values as the oracle's oracle. */
+int
+testRangeOracle (void)
+{
+    int numErrors = 0;
+    printf("--RANGE ORACLE TESTS--");
+
+    static float values[2000];
+    float max;
+    float min;
+    float scan_max;
+    float scan_min;
+    uint32_t seed = 12345;
+    int answered = 0;
+    int sweep;
+    size_t i;
+
+    /* A small generator of uniform floats in [-1, 1).*/
+    #define NEXT_UNIFORM() ((seed = seed * 1664525u + 1013904223u), (seed >> 8) / 8388608.0f - 1.0f)
+
+    /* Testing cosine: the same max and min as range() whenever the oracle answers.*/
+    for (sweep = 0; sweep < 2000; sweep++)
+    {
+        size_t len = 2 + (seed % 1999);
+        float x_scale = 0.05f * NEXT_UNIFORM();
+        float x_shift = 50 * NEXT_UNIFORM();
+        struct function_spec cosine_function = { FUNCTION_COSINE, NULL, 0 };
+        cosine (values, len, x_scale, x_shift);
+        range (values, len, &scan_max, &scan_min);
+        if (range_oracle (&cosine_function, len, x_scale, x_shift, &max, &min) == 0)
+        {
+            answered++;
+            TEST(scan_max, max);
+            TEST(scan_min, min);
+        }
+        cosine_ranged (values, len, x_scale, x_shift, &max, &min);
+        TEST(scan_max, max);
+        TEST(scan_min, min);
+    }
+    TEST(1, answered > 1000);
+
+    /* Testing polynomials up to degree 3: the same max and min as range() whenever the oracle answers.*/
+    answered = 0;
+    for (sweep = 0; sweep < 2000; sweep++)
+    {
+        size_t degree = sweep % 4;
+        size_t len = 2 + (seed % 1999);
+        float coeffs[4];
+        float x_scale = 0.02f * NEXT_UNIFORM();
+        float x_shift = 10 * NEXT_UNIFORM();
+        struct function_spec function = { FUNCTION_POLYNOMIAL, coeffs, degree };
+        for (i = 0; i <= degree; i++)
+        coeffs[i] = 5 * NEXT_UNIFORM();
+        polynomial (coeffs, degree, values, len, x_scale, x_shift);
+        range (values, len, &scan_max, &scan_min);
+        if (range_oracle (&function, len, x_scale, x_shift, &max, &min) == 0)
+        {
+            answered++;
+            TEST(scan_max, max);
+            TEST(scan_min, min);
+        }
+        polynomial_ranged (coeffs, degree, values, len, x_scale, x_shift, &max, &min);
+        TEST(scan_max, max);
+        TEST(scan_min, min);
+    }
+    TEST(1, answered > 1900);
+
+    /* Testing a flat minimum, where a float sample away from the critical point wobbles below the ones around it.*/
+    float flat[] = {20.3070602, 3.9622736, 1, 0.000815552019};
+    struct function_spec flat_function = { FUNCTION_POLYNOMIAL, flat, 3 };
+    polynomial (flat, 3, values, 2000, 8.25552e-05, 2.06786);
+    range (values, 2000, &scan_max, &scan_min);
+    TEST(0, range_oracle (&flat_function, 2000, 8.25552e-05, 2.06786, &max, &min));
+    TEST(scan_max, max);
+    TEST(scan_min, min);
+    #undef NEXT_UNIFORM
+
+    /* Testing the cases left to range().*/
+    float quartic[] = {0, 0, 0, 0, 1};
+    struct function_spec quartic_function = { FUNCTION_POLYNOMIAL, quartic, 4 };
+    struct function_spec cosine_function = { FUNCTION_COSINE, NULL, 0 };
+    TEST(-1, range_oracle (&quartic_function, 80, 0.1, 4, &max, &min));
+    TEST(-1, range_oracle (&cosine_function, 80, 3.0, 0, &max, &min));
+    polynomial_ranged (quartic, 4, values, 80, 0.1, 4, &max, &min);
+    range (values, 80, &scan_max, &scan_min);
+    TEST(scan_max, max);
+    TEST(scan_min, min);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testRangeOracle
+
+/* Tests for polynomial_with() by forward differences, against Horner in double at the exact x over a long sweep. */
+int
+testForward (void)
+{
+    int numErrors = 0;
+    printf("--FORWARD DIFFERENCE TESTS--");
+
+    size_t len = 10000000;
+    float * values = malloc(len * sizeof(float));
+    float cubic[] = {0,1,18,1};
+    float wavy[] = {0.5, -3, 0.25, 2, -0.125};
+    float * coeffs[] = { cubic, wavy };
+    size_t degrees[] = { 3, 4 };
+    float x_scales[] = { 0.0000075, 0.0000008 };
+    float x_shifts[] = { 20, 4 };
+    size_t i;
+    size_t k;
+    int f;
+
+    for (f = 0; f < 2; f++)
+    {
+        /* Testing every sample is the polynomial at the exact x, in double, rounded to float: within half a float
+           ulp and the drift of the differences between two anchors, a bound that does not grow along the sweep.*/
+        double drift = 16; /* The rounding of a difference reaches a value C(steps, degree) times over a lane's steps.*/
+        for (k = 1; k <= degrees[f]; k++)
+        drift = drift * (FORWARD_ANCHOR / FORWARD_LANES - k + 1) / k;
+        polynomial_with (coeffs[f], degrees[f], values, len, x_scales[f], x_shifts[f], POLY_FORWARD);
+        for (i = 0; i < len; i++)
+        {
+            double x = (double) i * x_scales[f] - x_shifts[f];
+            double exact = 0;
+            double size = 0;
+            for (k = degrees[f] + 1; k > 0; k--)
+            {
+                exact = exact * x + coeffs[f][k - 1];
+                size = size * fabs(x) + fabs(coeffs[f][k - 1]);
+            }
+            double tolerance = FLT_EPSILON / 2 * fabs(exact) + drift * DBL_EPSILON * size + FLT_TRUE_MIN;
+            TEST(1, fabs(values[i] - exact) <= tolerance);
+        }
+    }
+
+    /* Testing short lengths and the tail after the last full step of the lanes.*/
+    float short_values[37];
+    float horner[37];
+    for (i = 1; i <= 37; i++)
+    {
+        polynomial_with (cubic, 3, short_values, i, 0.375, 20, POLY_FORWARD);
+        polynomial_with (cubic, 3, horner, i, 0.375, 20, POLY_HORNER);
+        for (k = 0; k < i; k++)
+        FTEST(short_values[k], horner[k], fabs(horner[k]) * 0.00001 + 0.0001);
+    }
+
+    /* Testing degrees over FORWARD_MAX_DEGREE fall back to Horner.*/
+    float high[12] = {1,1,1,1,1,1,1,1,1,1,1,1};
+    polynomial_with (high, 11, short_values, 37, 0.01, 0, POLY_FORWARD);
+    polynomial_with (high, 11, horner, 37, 0.01, 0, POLY_HORNER);
+    TEST(0, memcmp(short_values, horner, sizeof(horner)));
+
+    free(values);
+    reportTests (numErrors);
+    return numErrors;
+} //testForward
+
+/* True when every one of len floats is finite. */
+static int
+all_finite (const float values[], size_t len)
+{
+    size_t i;
+    for (i = 0; i < len; i++)
+    {
+        if (!isfinite(values[i]))
+        return 0;
+    }
+    return 1;
+} //all_finite
+
+/* Checks what quantizes or summarizes a finite fill of a function: the batch quantizer kernels, the viewport's
+   segment trees, the envelope's columns and the exact columns of adaptive_fill(). scratch[] holds len floats. */
+static int
+check_summaries (const struct function_spec * function, const float reference[], size_t len,
+                 float x_scale, float x_shift, int height, float scratch[])
+{
+    int numErrors = 0;
+    float max;
+    float min;
+    float fast_max;
+    float fast_min;
+    size_t c;
+    size_t i;
+
+    /* Every batch quantizer kernel the CPU has against scale(), then the widest again.*/
+    struct quantizer quantizer;
+    enum batch_kernel best = batch_kernel_select (KERNEL_AVX2);
+    enum batch_kernel kernel;
+    int * levels = malloc(len * sizeof(int));
+    uint16_t * narrow = malloc(len * sizeof(uint16_t));
+    uint8_t * bytes = malloc(len * sizeof(uint8_t));
+    range (reference, len, &max, &min);
+    if (height <= 65536 && quantizer_init(&quantizer, height, min, max) == 0)
+    {
+        scale (reference, levels, len, height, min, max);
+        for (kernel = KERNEL_SCALAR; kernel <= best; kernel++)
+        {
+            batch_kernel_select (kernel);
+            quantize_batch_u16 (&quantizer, reference, narrow, len);
+            for (i = 0; i < len; i++)
+            TEST(levels[i], narrow[i]);
+            if (height <= 256)
+            {
+                quantize_batch_u8 (&quantizer, reference, bytes, len);
+                for (i = 0; i < len; i++)
+                TEST(levels[i], bytes[i]);
+            }
+        }
+        batch_kernel_select (best);
+        quantizer_free (&quantizer);
+    }
+    free(levels);
+    free(narrow);
+    free(bytes);
+
+    /* The viewport, panned right then partly back, against range() over the window it shows.*/
+    struct viewport view;
+    if (viewport_init(&view, function, '*', len, 1, x_scale, x_shift) == 0)
+    {
+        viewport_range (&view, &fast_max, &fast_min);
+        range (reference, len, &max, &min);
+        TEST(max, fast_max);
+        TEST(min, fast_min);
+        viewport_pan (&view, len / 3 + 1);
+        viewport_pan (&view, -(long) (len / 5));
+        evaluate_block (function, scratch, view.first, len, x_scale, x_shift);
+        if (all_finite(scratch, len))
+        {
+            viewport_range (&view, &fast_max, &fast_min);
+            range (scratch, len, &max, &min);
+            TEST(max, fast_max);
+            TEST(min, fast_min);
+        }
+        viewport_free (&view);
+    }
+
+    /* The envelope, fed in uneven runs, against range() over the samples of each column.*/
+    struct envelope env;
+    size_t columns = 1 + height % len;
+    size_t run = 1 + height % 13;
+    if (envelope_init(&env, columns, len) == 0)
+    {
+        for (i = 0; i < len; i += run)
+        envelope_add (&env, reference + i, (len - i < run) ? len - i : run);
+        for (c = 0; c < columns; c++)
+        {
+            size_t begin = (c * len + columns - 1) / columns;
+            size_t end = ((c + 1) * len + columns - 1) / columns;
+            range (reference + begin, end - begin, &max, &min);
+            TEST(max, env.max[c]);
+            TEST(min, env.min[c]);
+        }
+        envelope_free (&env);
+    }
+
+    /* adaptive_fill(): exact on the columns it samples, and the lines between them within the range.*/
+    range (reference, len, &max, &min);
+    if ((double) max - min < FLT_MAX / ADAPTIVE_STRIDE)
+    {
+        double slack = 4 * FLT_EPSILON * fmax(fabs(max), fabs(min)) + FLT_TRUE_MIN;
+        size_t evaluations = adaptive_fill (function, scratch, len, x_scale, x_shift, height);
+        TEST(1, evaluations <= len);
+        for (i = 0; i < len; i += ADAPTIVE_STRIDE)
+        TEST(reference[i], scratch[i]);
+        TEST(reference[len - 1], scratch[len - 1]);
+        for (i = 0; i < len; i++)
+        TEST(1, scratch[i] <= max + slack && scratch[i] >= min - slack);
+    }
+    return numErrors;
+} //check_summaries
+
+int
+check_fast_paths (const struct check_case * test)
+{
+    int numErrors = 0;
+    size_t len = test->len;
+    size_t degree = test->degree;
+    int height = test->height;
+    float x_scale = test->x_scale;
+    float x_shift = test->x_shift;
+    size_t room = len + 1; /* One more than len, as a canary that len 0 writes nothing.*/
+    float * reference = malloc(room * sizeof(float));
+    float * fast = malloc(room * sizeof(float));
+    int * levels = malloc(room * sizeof(int));
+    int * fast_levels = malloc(room * sizeof(int));
+    struct function_spec cosine_function = { FUNCTION_COSINE, NULL, 0 };
+    struct function_spec polynomial_function = { FUNCTION_POLYNOMIAL, test->coeffs, degree };
+    float max;
+    float min;
+    float fast_max;
+    float fast_min;
+    size_t i;
+    int method;
+    enum cosine_tier tier;
+
+    /* Bounds of the grid, and the size of the polynomial on it, for the tolerances.*/
+    float first_x = get_x(0, x_scale, x_shift);
+    float last_x = get_x(len ? len - 1 : 0, x_scale, x_shift);
+    double reach = fmax(fabs(first_x), fabs(last_x));
+    double size = 0;
+    double slope = 0;
+    double widest = 0;
+    double powers = 0;
+    for (i = degree + 1; i > 0; i--)
+    {
+        size = size * reach + fabs(test->coeffs[i - 1]);
+        powers = powers * reach + 1;
+        if (i > 1)
+        slope = slope * reach + (i - 1) * fabs(test->coeffs[i - 1]);
+        widest = fmax(widest, fabs(test->coeffs[i - 1]));
+    }
+    /* A power of x that underflows to a subnormal keeps only an absolute accuracy, times its coefficient, and
+       a sum that rounds to a subnormal is off by up to FLT_TRUE_MIN / 2, times the powers of x after it.*/
+    double tolerance = 4 * (degree + 1) * (FLT_EPSILON * size + FLT_TRUE_MIN * (widest + powers));
+    double x_error = FLT_EPSILON * (fabs((double) len * x_scale) + fabs(x_shift));
+    int finite_grid = isfinite(first_x) && isfinite(last_x) && isfinite(size) && isfinite(slope * x_error);
+    int no_overflow = size < FLT_MAX && pow(reach, degree) < FLT_MAX; /* Estrin's powers of x, too.*/
+
+    /* Cosine: the parallel fill exactly, the batch kernel within its bound.*/
+    fast[len] = reference[len] = 7;
+    cosine (reference, len, x_scale, x_shift);
+    cosine_parallel (fast, len, x_scale, x_shift);
+    TEST(0, memcmp(reference, fast, room * sizeof(float)));
+    if (finite_grid && reach <= COSINE_APPROX_LIMIT)
+    {
+        cosine_batch (fast, len, x_scale, x_shift);
+        for (i = 0; i < len; i++)
+        FTEST(fast[i], reference[i], 2e-7);
+        TEST(7, fast[len]);
+    }
+    if (len > 0 && finite_grid && all_finite(reference, len))
+    {
+        /* The levels of the exact fill, and those of the approximation on the same scale.*/
+        range (reference, len, &max, &min);
+        range_parallel (reference, len, &fast_max, &fast_min);
+        TEST(max, fast_max);
+        TEST(min, fast_min);
+        scale (reference, levels, len, height, min, max);
+        scale_parallel (reference, fast_levels, len, height, min, max);
+        TEST(0, memcmp(levels, fast_levels, len * sizeof(int)));
+        pipeline_levels (&cosine_function, len, x_scale, x_shift, height, fast_levels, NULL, &fast_max, &fast_min);
+        TEST(max, fast_max);
+        TEST(min, fast_min);
+        TEST(0, memcmp(levels, fast_levels, len * sizeof(int)));
+        if (range_oracle(&cosine_function, len, x_scale, x_shift, &fast_max, &fast_min) == 0)
+        {
+            TEST(max, fast_max);
+            TEST(min, fast_min);
+        }
+        if (reach <= COSINE_APPROX_LIMIT && 2 * 2e-7 < (max - min) / height)
+        {
+            cosine_batch (fast, len, x_scale, x_shift);
+            scale (fast, fast_levels, len, height, min, max);
+            for (i = 0; i < len; i++)
+            TEST(1, abs(levels[i] - fast_levels[i]) <= 1 || (fast[i] < min || fast[i] > max));
+        }
+        /* Every tier within its bound of the exact cosine, and the tier chosen for the height within its own.*/
+        for (tier = COSINE_TABLE; tier <= COSINE_LIBM && reach <= COSINE_APPROX_LIMIT; tier++)
+        {
+            cosine_tiered (fast, len, x_scale, x_shift, tier);
+            for (i = 0; i < len; i++)
+            TEST(1, fabs(fast[i] - cos((double) get_x(i, x_scale, x_shift))) <= cosine_tier_bound(tier));
+            TEST(7, fast[len]);
+        }
+        if (reach <= COSINE_APPROX_LIMIT)
+        {
+            tier = cosine_for_height (fast, len, x_scale, x_shift, height);
+            for (i = 0; i < len; i++)
+            TEST(1, fabs(fast[i] - cos((double) get_x(i, x_scale, x_shift))) <= cosine_tier_bound(tier));
+            TEST(7, fast[len]);
+        }
+        numErrors += check_summaries (&cosine_function, reference, len, x_scale, x_shift, height, fast);
+    }
+
+    /* Polynomials: the parallel fill exactly, the other methods and the batch kernel within rounding.*/
+    fast[len] = reference[len] = 7;
+    polynomial ((float *) test->coeffs, degree, reference, len, x_scale, x_shift);
+    polynomial_parallel (test->coeffs, degree, fast, len, x_scale, x_shift);
+    TEST(0, memcmp(reference, fast, room * sizeof(float)));
+    for (method = POLY_ESTRIN; method <= POLY_FORWARD + 1; method++)
+    {
+        double allowed = tolerance + ((method == POLY_FORWARD) ? slope * x_error : 0);
+        if (method > POLY_FORWARD)
+        polynomial_batch (test->coeffs, degree, fast, len, x_scale, x_shift);
+        else
+        polynomial_with (test->coeffs, degree, fast, len, x_scale, x_shift, method);
+        TEST(7, fast[len]);
+        for (i = 0; finite_grid && no_overflow && i < len; i++)
+        {
+            if (isfinite(reference[i]) && fabs(fast[i] - reference[i]) > allowed)
+            {
+                ++numErrors;
+                printf("  Error for method %d at %zu: %.9g against %.9g\n", method, i, fast[i], reference[i]);
+                break;
+            }
+        }
+    }
+    if (len > 0 && finite_grid && all_finite(reference, len))
+    {
+        range (reference, len, &max, &min);
+        scale (reference, levels, len, height, min, max);
+        pipeline_levels (&polynomial_function, len, x_scale, x_shift, height, fast_levels, NULL, &fast_max, &fast_min);
+        TEST(max, fast_max);
+        TEST(min, fast_min);
+        TEST(0, memcmp(levels, fast_levels, len * sizeof(int)));
+        if (range_oracle(&polynomial_function, len, x_scale, x_shift, &fast_max, &fast_min) == 0)
+        {
+            TEST(max, fast_max);
+            TEST(min, fast_min);
+        }
+        numErrors += check_summaries (&polynomial_function, reference, len, x_scale, x_shift, height, fast);
+    }
+
+    /* Any values at all: scale() gives a level in range, or -1 for what has none, never anything else.*/
+    if (len > 0)
+    {
+        range (reference, len, &max, &min);
+        scale (reference, levels, len, height, min, max);
+        for (i = 0; i < len; i++)
+        TEST(1, levels[i] >= -1);
+        if (isfinite(max) && isfinite(min))
+        {
+            for (i = 0; i < len; i++)
+            TEST(1, levels[i] < height || !(reference[i] <= max));
+        }
+    }
+
+    /* Expressions: whatever compiles, the native code and the interpreter agree bit for bit.*/
+    struct expression expr;
+    struct jit_function jit;
+    if (expression_compile(test->text, &expr) == 0)
+    {
+        expression_fill (&expr, reference, len, x_scale, x_shift);
+        if (expression_jit(&expr, &jit) == 0)
+        {
+            jit.fill (fast, len, x_scale, x_shift);
+            TEST(0, memcmp(reference, fast, len * sizeof(float)));
+            jit_release (&jit);
+        }
+    }
+
+    free(reference);
+    free(fast);
+    free(levels);
+    free(fast_levels);
+    return numErrors;
+} //check_fast_paths
+
+/* Property tests: the degenerate inputs, then check_fast_paths() on random cases. */
+int
+testProperties (void)
+{
+    int numErrors = 0;
+    printf("--PROPERTY TESTS--");
+
+    /* Testing max == min, NaN and infinity have defined levels.*/
+    TEST(0, quantize(5, 10, 5, 5));
+    TEST(0, quantize(-3, 10, 5, 5));
+    TEST(-1, quantize(NAN, 10, 0, 1));
+    TEST(-1, quantize(INFINITY, 10, 0, 1));
+    TEST(-1, quantize(-INFINITY, 10, 0, 1));
+    TEST(-1, quantize(1e30, 10, 0, 1e-10));
+    TEST(-1, quantize(0.5, 10, NAN, 1));
+    TEST(299, quantize(1e-40f, 300, 0, 1e-40f)); /* A subnormal level.*/
+    float flat[] = {2, 2, 2};
+    int flat_levels[] = {9, 9, 9};
+    scale (flat, flat_levels, 3, 60, 2, 2);
+    TEST(0, flat_levels[0] + flat_levels[1] + flat_levels[2]);
+    float holes[] = {1, NAN, 3, INFINITY};
+    float max;
+    float min;
+    range (holes, 3, &max, &min);
+    TEST(3, max);
+    TEST(1, min);
+
+    /* Testing random cases, about a quarter of them with an edge: len 0 or 1, a flat grid, NaN and infinity,
+       or a line so shallow its range and its quantization step are subnormal.*/
+    uint32_t seed = 2024;
+    struct check_case test;
+    int threads = set_thread_count (4);
+    int sweep;
+    size_t i;
+    const char * texts[] = { "2*sin(x)-x^3", "cos(x)", "x^2/(1+abs(x))", "exp(-x*x)", "sqrt(x)+log(x)", "1/x", "x" };
+    #define NEXT_RANDOM() (seed = seed * 1664525u + 1013904223u, seed >> 8)
+    #define NEXT_UNIFORM() (NEXT_RANDOM() / 8388608.0f - 1.0f)
+    for (sweep = 0; sweep < 400 && threads; sweep++)
+    {
+        memset(&test, 0, sizeof(test));
+        test.len = NEXT_RANDOM() % 2000;
+        test.height = 1 + NEXT_RANDOM() % 300;
+        test.degree = NEXT_RANDOM() % (CHECK_MAX_DEGREE + 1);
+        test.x_scale = NEXT_UNIFORM();
+        if (NEXT_RANDOM() % 2)
+        test.x_scale *= 0.01f;
+        test.x_shift = 30 * NEXT_UNIFORM();
+        for (i = 0; i <= test.degree; i++)
+        test.coeffs[i] = 4 * NEXT_UNIFORM();
+        strcpy(test.text, texts[NEXT_RANDOM() % 7]);
+        switch (sweep % 25)
+        {
+            case 0: test.len = 0; break;
+            case 1: test.len = 1; break;
+            case 2: test.x_scale = 0; break;
+            case 3: test.x_shift = NAN; break;
+            case 4: test.x_scale = INFINITY; break;
+            case 5: test.degree = 1; test.coeffs[0] *= 1e-42f; test.coeffs[1] *= 1e-42f; break;
+        }
+        numErrors += check_fast_paths (&test);
+    }
+    #undef NEXT_UNIFORM
+    #undef NEXT_RANDOM
+    set_thread_count (1);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testProperties
+
+#ifdef FUZZING
+/* Entry point for libFuzzer: the first bytes are the grid, height and polynomial of a check_case, the rest its
+   expression. Build with -DFUZZING -fsanitize=fuzzer,address,undefined; main() is left out. */
+int
+LLVMFuzzerTestOneInput (const uint8_t * data, size_t size)
+{
+    struct check_case test;
+    uint16_t len;
+    uint16_t height;
+    uint8_t degree;
+    size_t header = 2 * sizeof(float) + sizeof(len) + sizeof(height) + sizeof(degree);
+    static int started;
+    if (!started)
+    started = set_thread_count (2);
+    if (size < header)
+    return 0;
+
+    memset(&test, 0, sizeof(test));
+    memcpy(&test.x_scale, data, sizeof(float));
+    memcpy(&test.x_shift, data + sizeof(float), sizeof(float));
+    memcpy(&len, data + 2 * sizeof(float), sizeof(len));
+    memcpy(&height, data + 2 * sizeof(float) + sizeof(len), sizeof(height));
+    degree = data[header - 1];
+    data += header;
+    size -= header;
+    test.len = len % (CHECK_MAX_LEN + 1);
+    test.height = 1 + height;
+    test.degree = degree % (CHECK_MAX_DEGREE + 1);
+    size_t coeff_bytes = (test.degree + 1) * sizeof(float);
+    if (size < coeff_bytes)
+    return 0;
+    memcpy(test.coeffs, data, coeff_bytes);
+    data += coeff_bytes;
+    size -= coeff_bytes;
+    memcpy(test.text, data, (size < CHECK_MAX_TEXT - 1) ? size : CHECK_MAX_TEXT - 1);
+
+    if (check_fast_paths(&test) != 0)
+    {
+        fflush(stdout); /* The broken rules, before the crash libFuzzer saves the input for.*/
+        abort();
+    }
+    return 0;
+} //LLVMFuzzerTestOneInput
+#endif
+
+/* Tests for the numeric cores: each type on its own, then the three against each other. */
+int
+testNumeric (void)
+{
+    int numErrors = 0;
+    printf("--NUMERIC CORE TESTS--");
+
+    /* Testing the fixed-point conversions round and saturate.*/
+    TEST(Q16_ONE, q16_from_double(1));
+    TEST(-Q16_ONE / 2, q16_from_double(-0.5));
+    TEST(1, q16_from_double(1.0 / 65536));
+    TEST(INT32_MAX, q16_from_double(1e6));
+    TEST(INT32_MIN, q16_from_double(-1e6));
+    TEST(0, q16_from_double(NAN));
+    TEST(-2.25, q16_to_double(q16_from_double(-2.25)));
+
+    /* Testing a line: values 0..9 on 10 levels are the same levels in every type.*/
+    float line[] = {0, 1};
+    struct function_spec line_function = { FUNCTION_POLYNOMIAL, line, 1 };
+    int expected[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    int levels_f32[10];
+    int levels_f64[10];
+    int levels_q16[10];
+    float values_f32[10];
+    double values_f64[10];
+    q16 values_q16[10];
+    float max_f32;
+    float min_f32;
+    double max_f64;
+    double min_f64;
+    q16 max_q16;
+    q16 min_q16;
+    numeric_levels_f32 (&line_function, 10, 1, 0, 10, levels_f32, values_f32, &max_f32, &min_f32);
+    numeric_levels_f64 (&line_function, 10, 1, 0, 10, levels_f64, values_f64, &max_f64, &min_f64);
+    numeric_levels_q16 (&line_function, 10, 1, 0, 10, levels_q16, values_q16, &max_q16, &min_q16);
+    for (int i = 0; i < 10; i++)
+    {
+        TEST(expected[i] * 10 / 9 > 9 ? 9 : expected[i] * 10 / 9, levels_f64[i]);
+        TEST(levels_f64[i], levels_f32[i]);
+        TEST(levels_f64[i], levels_q16[i]);
+    }
+    TEST(9, max_f32);
+    TEST(0, min_f64);
+    TEST(9 * Q16_ONE, max_q16);
+    TEST(0, min_q16);
+
+    /* Testing a flat line is all level 0, and saturating keeps a fixed-point overflow at the top.*/
+    float flat[] = {3};
+    struct function_spec flat_function = { FUNCTION_POLYNOMIAL, flat, 0 };
+    numeric_levels_q16 (&flat_function, 10, 1, 0, 60, levels_q16, values_q16, &max_q16, &min_q16);
+    for (int i = 0; i < 10; i++)
+    TEST(0, levels_q16[i]);
+    float steep[] = {0, 0, 0, 1};
+    struct function_spec steep_function = { FUNCTION_POLYNOMIAL, steep, 3 };
+    numeric_evaluate_q16 (&steep_function, values_q16, 10, q16_from_double(10), 0);
+    TEST(0, values_q16[0]);
+    TEST(1000 * Q16_ONE, values_q16[1]);
+    TEST(INT32_MAX, values_q16[4]);
+
+    /* Testing a degree above NUMERIC_MAX_DEGREE, x^20 + 1, evaluates like the array would.*/
+    float high[21] = {1};
+    high[20] = 1;
+    struct function_spec high_function = { FUNCTION_POLYNOMIAL, high, 20 };
+    numeric_evaluate_f64 (&high_function, values_f64, 3, 1, 0);
+    TEST(1, values_f64[0]);
+    TEST(2, values_f64[1]);
+    TEST(1048577, values_f64[2]);
+    numeric_evaluate_q16 (&high_function, values_q16, 2, Q16_ONE, 0);
+    TEST(2 * Q16_ONE, values_q16[1]);
+
+    /* Testing len 0 reads and writes nothing, the range left as it was.*/
+    max_f32 = 7;
+    min_f32 = -7;
+    levels_f32[0] = 9;
+    numeric_levels_f32 (&line_function, 0, 1, 0, 10, levels_f32, values_f32, &max_f32, &min_f32);
+    numeric_range_f32 (NULL, 0, &max_f32, &min_f32);
+    TEST(7, max_f32);
+    TEST(-7, min_f32);
+    TEST(9, levels_f32[0]);
+
+    /* Testing the fixed-point cosine against cos() over many periods.*/
+    struct function_spec cosine_function = { FUNCTION_COSINE, NULL, 0 };
+    q16 cosines[1000];
+    q16 x_scale = q16_from_double(0.0731);
+    q16 x_shift = q16_from_double(20);
+    numeric_evaluate_q16 (&cosine_function, cosines, 1000, x_scale, x_shift);
+    for (int i = 0; i < 1000; i++)
+    FTEST(q16_to_double(cosines[i]), cos(i * q16_to_double(x_scale) - q16_to_double(x_shift)), 4.0 / Q16_ONE);
+
+    /* Testing the plots of main() in every type: levels at most one apart, and nearly all equal. The polynomial is
+       drawn nearer 0, as on main()'s domain it passes 32768 and the fixed-point one saturates.*/
+    const float main_coeffs[] = {0, 1, 18, 1, 0.5};
+    struct function_spec functions[] = { { FUNCTION_COSINE, NULL, 0 }, { FUNCTION_POLYNOMIAL, main_coeffs, 4 } };
+    float x_scales[] = {0.1, 0.075};
+    float x_shifts[] = {0, 3};
+    size_t len = 4000;
+    float * plot_f32 = malloc(len * sizeof(float));
+    double * plot_f64 = malloc(len * sizeof(double));
+    q16 * plot_q16 = malloc(len * sizeof(q16));
+    int * scaled_f32 = malloc(len * sizeof(int));
+    int * scaled_f64 = malloc(len * sizeof(int));
+    int * scaled_q16 = malloc(len * sizeof(int));
+    for (int f = 0; f < 2; f++)
+    {
+        double x_scale = q16_to_double(q16_from_double(x_scales[f] * 80 / len)); /* The same grid in every type.*/
+        size_t same_f32 = 0;
+        size_t same_q16 = 0;
+        numeric_levels_f32 (&functions[f], len, x_scale, x_shifts[f], 60, scaled_f32, plot_f32, &max_f32, &min_f32);
+        numeric_levels_f64 (&functions[f], len, x_scale, x_shifts[f], 60, scaled_f64, plot_f64, &max_f64, &min_f64);
+        numeric_levels_q16 (&functions[f], len, x_scale, x_shifts[f], 60, scaled_q16, plot_q16, &max_q16, &min_q16);
+        for (size_t i = 0; i < len; i++)
+        {
+            TEST(1, abs(scaled_f32[i] - scaled_f64[i]) <= 1);
+            TEST(1, abs(scaled_q16[i] - scaled_f64[i]) <= 1);
+            same_f32 += (scaled_f32[i] == scaled_f64[i]);
+            same_q16 += (scaled_q16[i] == scaled_f64[i]);
+        }
+        TEST(1, same_f32 >= len * 99 / 100);
+        TEST(1, same_q16 >= len * 99 / 100);
+    }
+    free(plot_f32);
+    free(plot_f64);
+    free(plot_q16);
+    free(scaled_f32);
+    free(scaled_f64);
+    free(scaled_q16);
+
+    reportTests (numErrors);
+    return numErrors;
+} //testNumeric
+
+int
+testAll (void)
+{
+  int numErrors = 0;
+
+  numErrors += testGetX();
+  numErrors += testCosine();
+  numErrors += testPolynomial();
+  numErrors += testRange();
+  numErrors += testQuantize();
+  numErrors += testScale();
+  numErrors += testFrame();
+  numErrors += testBatch();
+  numErrors += testPolynomialEngine();
+  numErrors += testParallel();
+  numErrors += testPipeline();
+  numErrors += testExpression();
+  numErrors += testJit();
+  numErrors += testViewport();
+  numErrors += testAdaptive();
+  numErrors += testEnvelope();
+  numErrors += testStream();
+  numErrors += testTable();
+  numErrors += testCache();
+  numErrors += testCosineTiers();
+  numErrors += testOverlay();
+  #ifdef INSTRUMENT
+  numErrors += testInstrument();
+  #endif
+  numErrors += testQuantizeBatch();
+  numErrors += testRender();
+  numErrors += testDiff();
+  numErrors += testBatchMode();
+  numErrors += testRangeOracle();
+  numErrors += testForward();
+  numErrors += testProperties();
+  numErrors += testNumeric();
+  
+  testPlot(); 
+  
+  if (numErrors==0)
+    printf ("TESTS PASSED\n");
+  else
+    printf ("TOTAL ERRORS: %d\n",numErrors);
+  return numErrors;
+
+} //testAll
+
+/**************************** BENCHMARKS ****************************/
+
+/* Returns a monotonic time in nanoseconds. */
+double
+now_ns (void)
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+} //now_ns
+
+/* Benchmarks for expression_fill(): parse once against parse every frame, and against the native fills. */
+void
+benchExpression (void)
+{
+    int frames = 20000;
+    int width = 80;
+    size_t len = 1000000;
+    float frame[80];
+    float * values = malloc(len * sizeof(float));
+    float cubic[] = {0,1,18,1};
+    struct expression expr;
+    double start;
+
+    printf("--EXPRESSION BENCHMARKS--\n");
+
+    /* Many 80 column frames of the README example, compiled every frame or once.*/
+    start = now_ns();
+    for (int f = 0; f < frames; f++)
+    {
+        expression_compile ("y=2*sin(x)-x^3", &expr);
+        expression_fill (&expr, frame, width, 0.1, f * 0.01);
+    }
+    printf("  parse every frame: %8.1f ns/frame\n", (now_ns() - start) / frames);
+    start = now_ns();
+    expression_compile ("y=2*sin(x)-x^3", &expr);
+    for (int f = 0; f < frames; f++)
+    {
+        expression_fill (&expr, frame, width, 0.1, f * 0.01);
+    }
+    printf("  parse once:        %8.1f ns/frame\n", (now_ns() - start) / frames);
+
+    /* One large fill of each function: compiled C, the bytecode a sample at a time, batched, and native.*/
+    const char * texts[2] = { "cos(x)", "x^3 + 18*x^2 + x" };
+    const char * names[2] = { "cos(x)", "cubic" };
+    float x_scales[2] = { 0.0001, 0.00003 };
+    float x_shifts[2] = { 0, 20 };
+    for (int f = 0; f < 2; f++)
+    {
+        start = now_ns();
+        if (f == 0)
+        cosine (values, len, x_scales[f], x_shifts[f]);
+        else
+        polynomial (cubic, 3, values, len, x_scales[f], x_shifts[f]);
+        double compiled = (now_ns() - start) / len;
+        expression_compile (texts[f], &expr);
+        start = now_ns();
+        for (size_t i = 0; i < len; i++)
+        expression_fill_span (&expr, values, i, i + 1, x_scales[f], x_shifts[f]);
+        double single = (now_ns() - start) / len;
+        start = now_ns();
+        expression_fill (&expr, values, len, x_scales[f], x_shifts[f]);
+        double batched = (now_ns() - start) / len;
+        printf("  %-6s C %6.2f, bytecode one at a time %6.2f, batched %6.2f ns/element: %5.2fx from batching%s\n",
+               names[f], compiled, single, batched, single / batched,
+               (batched < single) ? "" : ", NO SPEEDUP");
+    }
+    struct jit_function jit;
+    if (expression_jit (&expr, &jit) == 0)
+    {
+        start = now_ns();
+        jit.fill (values, len, x_scales[1], x_shifts[1]);
+        printf("  cubic  JIT %6.2f ns/element\n", (now_ns() - start) / len);
+        jit_release (&jit);
+    }
+
+    free(values);
+} //benchExpression
+
+/* Benchmarks for pipeline_levels() against separate evaluate, range and scale passes on the functions of main().
+   Without values[] the pipeline evaluates every sample twice unless range_oracle() answers, which the evaluations
+   column shows. */
+void
+benchPipeline (void)
+{
+    const float coeffs[] = {0, 1, 18, 1};
+    struct function_spec functions[2] = { { FUNCTION_COSINE, NULL, 0 }, { FUNCTION_POLYNOMIAL, coeffs, 3 } };
+    const char * names[2] = { "cosine", "cubic" };
+    const char * modes[3] = { "separate", "pipeline", "pipeline NULL" };
+    float x_scales[2] = { 0.1, 0.0075 };
+    float x_shifts[2] = { 0.0, 20 };
+    size_t len = 10000000;
+    float * values = malloc(len * sizeof(float));
+    int * levels = malloc(len * sizeof(int));
+    float max;
+    float min;
+
+    printf("--PIPELINE BENCHMARKS--\n");
+    for (int f = 0; f < 2; f++)
+    {
+        float x_scale = x_scales[f] * 80 / len;
+        int one_pass = range_oracle(&functions[f], len, x_scale, x_shifts[f], &max, &min) == 0;
+        for (int m = 0; m < 3; m++)
+        {
+            double best = 1e30;
+            for (int run = 0; run < 3; run++)
+            {
+                double start = now_ns();
+                if (m == 0)
+                {
+                    evaluate_block (&functions[f], values, 0, len, x_scale, x_shifts[f]);
+                    range (values, len, &max, &min);
+                    scale (values, levels, len, 60, min, max);
+                }
+                else
+                pipeline_levels (&functions[f], len, x_scale, x_shifts[f], 60, levels, (m == 1) ? values : NULL,
+                                 &max, &min);
+                double elapsed = now_ns() - start;
+                if (elapsed < best)
+                best = elapsed;
+            }
+            printf("  %-6s %-13s %8.3f ns/element, %d evaluations per sample\n",
+                   names[f], modes[m], best / len, (m == 2 && !one_pass) ? 2 : 1);
+        }
+    }
+    free(values);
+    free(levels);
+} //benchPipeline
+
+/* Benchmarks for adaptive_fill(): evaluations saved against the uniform fill on the cosine and cubic of main(). */
+void
+benchAdaptive (void)
+{
+    struct function_spec functions[2] = { { FUNCTION_COSINE, NULL, 0 }, { FUNCTION_POLYNOMIAL, (float[]){0,1,18,1}, 3 } };
+    const char * names[2] = { "cosine", "cubic" };
+    float x_scales[2] = { 0.15, 0.375 };
+    float x_shifts[2] = { 0.0, 20 };
+    size_t widths[3] = { 80, 8000, 800000 };
+    float * values = malloc(800000 * sizeof(float));
+    double start;
+
+    printf("--ADAPTIVE BENCHMARKS--\n");
+    for (int f = 0; f < 2; f++)
+    {
+        for (int w = 0; w < 3; w++)
+        {
+            /* The domain of main(), sampled at more and more columns.*/
+            size_t len = widths[w];
+            float x_scale = x_scales[f] * 80 / len;
+            start = now_ns();
+            evaluate_block (&functions[f], values, 0, len, x_scale, x_shifts[f]);
+            double uniform = now_ns() - start;
+            start = now_ns();
+            size_t evaluations = adaptive_fill (&functions[f], values, len, x_scale, x_shifts[f], 60);
+            double adaptive = now_ns() - start;
+            printf("  %-6s len %7zu: %7zu evaluations (%5.1f%% saved), uniform %10.0f ns, adaptive %10.0f ns\n",
+                   names[f], len, evaluations, 100.0 * (len - evaluations) / len, uniform, adaptive);
+        }
+    }
+    free(values);
+} //benchAdaptive
+
+/* Benchmarks for polynomial_with(): forward differences against Horner's rule, the best of a few runs each. */
+void
+benchForward (void)
+{
+    size_t len = 10000000;
+    float * values = malloc(len * sizeof(float));
+    float coeffs[] = {0, 1, 18, 1, 0.5};
+    const char * names[] = { "horner", "forward" };
+    enum poly_method methods[] = { POLY_HORNER, POLY_FORWARD };
+    size_t degree;
+    int m;
+
+    printf("--FORWARD DIFFERENCE BENCHMARKS--\n");
+    for (degree = 1; degree <= FORWARD_MAX_DEGREE; degree++)
+    {
+        for (m = 0; m < 2; m++)
+        {
+            double best = 1e30;
+            for (int run = 0; run < 5; run++)
+            {
+                double start = now_ns();
+                polynomial_with (coeffs, degree, values, len, 0.0000075, 20, methods[m]);
+                double elapsed = now_ns() - start;
+                if (elapsed < best)
+                best = elapsed;
+            }
+            printf("  degree %zu %-8s %8.3f ns/element\n", degree, names[m], best / len);
+        }
+    }
+    free(values);
+} //benchForward
+
+/* Benchmarks for the numeric cores: each type's time for the functions of main(), and how many of its levels are the
+   ones of the double core. The grid steps by 1/65536 over [-8, 8), which every type holds exactly; main()'s own
+   steps round in 16.16, and its polynomial domain passes 32768, where the fixed-point core saturates. */
+void
+benchNumeric (void)
+{
+    size_t len = 1 << 20;
+    const float coeffs[] = {0, 1, 18, 1, 0.5};
+    struct function_spec functions[] = { { FUNCTION_COSINE, NULL, 0 }, { FUNCTION_POLYNOMIAL, coeffs, 4 } };
+    const char * names[] = { "cosine", "polynomial" };
+    const char * types[] = { "f64", "f32", "q16" };
+    double x_scale = 1.0 / Q16_ONE;
+    double x_shift = 8;
+    void * values = malloc(len * sizeof(double));
+    int * reference = malloc(len * sizeof(int));
+    int * levels = malloc(len * sizeof(int));
+
+    printf("--NUMERIC CORE BENCHMARKS--\n");
+    for (int f = 0; f < 2; f++)
+    {
+        for (int t = 0; t < 3; t++)
+        {
+            int * out = (t == 0) ? reference : levels;
+            double best = 1e30;
+            for (int run = 0; run < 5; run++)
+            {
+                double max_f64, min_f64;
+                float max_f32, min_f32;
+                q16 max_q16, min_q16;
+                double start = now_ns();
+                if (t == 0)
+                numeric_levels_f64 (&functions[f], len, x_scale, x_shift, 60, out, values, &max_f64, &min_f64);
+                else if (t == 1)
+                numeric_levels_f32 (&functions[f], len, x_scale, x_shift, 60, out, values, &max_f32, &min_f32);
+                else
+                numeric_levels_q16 (&functions[f], len, x_scale, x_shift, 60, out, values, &max_q16, &min_q16);
+                double elapsed = now_ns() - start;
+                if (elapsed < best)
+                best = elapsed;
+            }
+            size_t same = 0;
+            int worst = 0;
+            for (size_t i = 0; i < len; i++)
+            {
+                same += (out[i] == reference[i]);
+                if (abs(out[i] - reference[i]) > worst)
+                worst = abs(out[i] - reference[i]);
+            }
+            printf("  %-10s %s %8.3f ns/element, %7.3f%% of levels equal to f64, at most %d apart\n",
+                   names[f], types[t], best / len, 100.0 * same / len, worst);
+        }
+    }
+    free(values);
+    free(reference);
+    free(levels);
+} //benchNumeric
+
+/* Stages of the plot path timed by benchStages(). */
+enum bench_stage { STAGE_GET_X, STAGE_COSINE, STAGE_POLYNOMIAL, STAGE_RANGE, STAGE_SCALE, STAGE_PLOT, STAGE_PLOT_BUFFERED };
+static const char * bench_stage_names[] = { "get_x", "cosine", "polynomial", "range", "scale", "plot", "plot_buffered" };
+
+/* Report formats of benchStages(). */
+enum bench_format { BENCH_CSV, BENCH_JSON };
+
+/* Largest frame plot_buffered() is run with, in bytes, and the smaller one for plot(), one character at a time. */
+#define BENCH_FRAME_LIMIT (1 << 26)
+#define BENCH_PLOT_LIMIT (1 << 22)
+/* Time each stage is given for its repetitions, in nanoseconds. */
+#define BENCH_BUDGET_NS 2e8
+
+/* Where results the stages would otherwise drop are stored, so they are not optimized away. */
+static volatile float bench_sink;
+
+/* Buffers and parameters shared by the runs of one stage. */
+struct bench_case
+{
+    enum bench_stage stage;
+    size_t len;
+    int height;
+    size_t degree;
+    const float * coeffs;
+    float * values;
+    int * scaled;
+    char * frame;
+};
+
+static int
+compare_doubles (const void * a, const void * b)
+{
+    double left = *(const double *) a;
+    double right = *(const double *) b;
+    return (left > right) - (left < right);
+} //compare_doubles
+
+/* Runs a stage once over the whole length. */
+static void
+bench_run (const struct bench_case * run)
+{
+    float max;
+    float min;
+    size_t i;
+    switch (run->stage)
+    {
+        case STAGE_GET_X:
+        for (i = 0; i < run->len; i++)
+        run->values[i] = get_x(i, 2.0f / run->len, 1);
+        break;
+        case STAGE_COSINE:
+        cosine (run->values, run->len, 12.0f / run->len, 0);
+        break;
+        case STAGE_POLYNOMIAL:
+        polynomial ((float *) run->coeffs, run->degree, run->values, run->len, 2.0f / run->len, 1);
+        break;
+        case STAGE_RANGE:
+        range (run->values, run->len, &max, &min);
+        bench_sink = max - min;
+        break;
+        case STAGE_SCALE:
+        scale (run->values, run->scaled, run->len, run->height, -1, 1);
+        break;
+        case STAGE_PLOT:
+        plot (run->values, '*', run->len, run->height);
+        break;
+        case STAGE_PLOT_BUFFERED:
+        plot_buffered (run->values, '*', run->len, run->height, run->scaled, run->frame);
+        break;
+    }
+} //bench_run
+
+/* Times a stage after warmup runs and prints its median and 99th percentile as one record. */
+static void
+bench_time (const struct bench_case * run, enum bench_format format, int * records)
+{
+    int warmup = 2;
+    int saved = -1;
+    double start = 0;
+    int reps;
+    int r;
+
+    /* The plot stages write to /dev/null, so the terminal is not what gets timed.*/
+    if (run->stage >= STAGE_PLOT)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        fflush (stdout);
+        saved = dup(STDOUT_FILENO);
+        dup2 (null, STDOUT_FILENO);
+        close (null);
+    }
+    for (r = 0; r < warmup; r++)
+    {
+        start = now_ns();
+        bench_run (run);
+    }
+    /* As many repetitions as fit in BENCH_BUDGET_NS going by the last warmup run, between 11 and 1001.*/
+    reps = BENCH_BUDGET_NS / (now_ns() - start + 1);
+    if (reps < 11)
+    reps = 11;
+    if (reps > 1001)
+    reps = 1001;
+    double * samples = malloc(reps * sizeof(double));
+    for (r = 0; r < reps; r++)
+    {
+        start = now_ns();
+        bench_run (run);
+        samples[r] = now_ns() - start;
+    }
+    if (saved >= 0)
+    {
+        fflush (stdout);
+        dup2 (saved, STDOUT_FILENO);
+        close (saved);
+    }
+
+    qsort (samples, reps, sizeof(double), compare_doubles);
+    double median = samples[reps / 2];
+    double p99 = samples[(reps * 99 + 99) / 100 - 1];
+    /* Bytes each run reads and writes: the floats, the levels for scale and plot, the frame for plot.*/
+    double bytes = run->len * sizeof(float);
+    if (run->stage >= STAGE_SCALE)
+    bytes += run->len * sizeof(int);
+    if (run->stage >= STAGE_PLOT)
+    bytes += (double) run->height * (run->len + 1);
+    if (format == BENCH_JSON)
+    printf("%s  {\"stage\": \"%s\", \"len\": %zu, \"height\": %d, \"degree\": %zu, \"reps\": %d, "
+           "\"median_ns\": %.0f, \"p99_ns\": %.0f, \"ns_per_element\": %.4f, \"gb_per_s\": %.3f}",
+           *records ? ",\n" : "", bench_stage_names[run->stage], run->len, run->height, run->degree, reps,
+           median, p99, median / run->len, bytes / median);
+    else
+    printf("%s,%zu,%d,%zu,%d,%.0f,%.0f,%.4f,%.3f\n", bench_stage_names[run->stage], run->len, run->height,
+           run->degree, reps, median, p99, median / run->len, bytes / median);
+    fflush (stdout);
+    ++*records;
+    free(samples);
+} //bench_time
+
+/* Benchmarks for each stage of the plot path on their own, swept over len, height and degree up to max_len. */
+void
+benchStages (enum bench_format format, size_t max_len)
+{
+    size_t lens[] = { 80, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+    int heights[] = { 10, 60, 240 };
+    size_t degrees[] = { 1, 3, 8 };
+    float coeffs[] = { 0.5, -1, 0.25, 1, -0.5, 0.125, 2, -0.75, 1 };
+    size_t longest = 80;
+    int records = 0;
+    size_t l;
+    int k;
+
+    for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+    {
+        if (lens[l] <= max_len)
+        longest = lens[l];
+    }
+    struct bench_case run = { 0, 0, 0, 0, coeffs, malloc(longest * sizeof(float)), malloc(longest * sizeof(int)),
+                              malloc(BENCH_FRAME_LIMIT) };
+
+    if (format == BENCH_JSON)
+    printf("[\n");
+    else
+    printf("stage,len,height,degree,reps,median_ns,p99_ns,ns_per_element,gb_per_s\n");
+    for (l = 0; l < sizeof(lens) / sizeof(lens[0]) && lens[l] <= max_len; l++)
+    {
+        run.len = lens[l];
+        run.height = 0;
+        run.degree = 0;
+        run.stage = STAGE_GET_X;
+        bench_time (&run, format, &records);
+        for (k = 0; k < 3; k++)
+        {
+            run.stage = STAGE_POLYNOMIAL;
+            run.degree = degrees[k];
+            bench_time (&run, format, &records);
+        }
+        run.degree = 0;
+        /* Cosine last, so range, scale and plot see a full swing between -1 and 1.*/
+        run.stage = STAGE_COSINE;
+        bench_time (&run, format, &records);
+        run.stage = STAGE_RANGE;
+        bench_time (&run, format, &records);
+        for (k = 0; k < 3; k++)
+        {
+            run.height = heights[k];
+            run.stage = STAGE_SCALE;
+            bench_time (&run, format, &records);
+            if ((size_t) run.height * (run.len + 1) > BENCH_FRAME_LIMIT)
+            continue;
+            run.stage = STAGE_PLOT;
+            if ((size_t) run.height * (run.len + 1) <= BENCH_PLOT_LIMIT)
+            bench_time (&run, format, &records);
+            run.stage = STAGE_PLOT_BUFFERED;
+            bench_time (&run, format, &records);
+        }
+    }
+    if (format == BENCH_JSON)
+    printf("\n]\n");
+
+    free(run.values);
+    free(run.scaled);
+    free(run.frame);
+} //benchStages
+
+/* Runs every benchmark. With --csv or --json only the stage benchmarks run, printing nothing else;
+   --max-len N stops their sweep at N elements. */
+int
+benchAll (int argc, char * argv[])
+{
+  enum bench_format format = BENCH_CSV;
+  int stages_only = 0;
+  size_t max_len = 100000000;
+  for (int a = 1; a < argc; a++)
+  {
+      if (strcmp(argv[a], "--csv") == 0 || strcmp(argv[a], "--json") == 0)
+      {
+          format = (argv[a][2] == 'j') ? BENCH_JSON : BENCH_CSV;
+          stages_only = 1;
+      }
+      else if (strcmp(argv[a], "--max-len") == 0 && a + 1 < argc)
+      max_len = strtoull(argv[++a], NULL, 10);
+  }
+  if (!stages_only)
+  {
+      benchPipeline();
+      benchExpression();
+      benchAdaptive();
+      benchForward();
+      benchNumeric();
+      printf("--STAGE BENCHMARKS--\n");
+  }
+  benchStages(format, max_len);
+  return 0;
+} //benchAll
+
+/***************************** FUNCTIONS *****************************/
+
+/* Main program entry.*/
+#ifndef FUZZING
+int
+main (int argc, char * argv[])
+{
+  #ifdef INSTRUMENT
+    instrument_init();
+  #endif
+  #ifdef TESTING
+    return testAll();
+  #endif
+  #ifdef BENCHMARK
+    return benchAll(argc, argv);
+  #endif
+
+  int SCREEN_HEIGHT = 60;
+  int SCREEN_WIDTH = 80;
+
+  float values[SCREEN_WIDTH];
+  int scaled[SCREEN_WIDTH];
+  char frame[SCREEN_HEIGHT * (SCREEN_WIDTH + 1)];
+
+  /* Plotting floats from a file or from stdin: plot --stream text|binary [file].*/
+  if (argc >= 3 && strcmp(argv[1], "--stream") == 0)
+  {
+      enum stream_format format = (strcmp(argv[2], "binary") == 0) ? STREAM_BINARY : STREAM_TEXT;
+      FILE * in = (argc >= 4) ? fopen(argv[3], "rb") : stdin;
+      if (!in)
+      {
+          perror(argv[3]);
+          return 1;
+      }
+      size_t bad_sample;
+      int frames = stream_plot (in, format, stdout, '*', SCREEN_WIDTH, SCREEN_HEIGHT, values, scaled, frame, &bad_sample);
+      if (in != stdin)
+      fclose(in);
+      if (frames < 0)
+      {
+          fprintf(stderr, "stream: sample %zu is not a number\n", bad_sample);
+          return 1;
+      }
+      return 0;
+  }
+
+  /* Plotting every job of a list from a file or from stdin: plot --batch [file].*/
+  if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+  {
+      struct plot_job * jobs;
+      size_t count;
+      size_t bad_line;
+      FILE * in = (argc >= 3) ? fopen(argv[2], "r") : stdin;
+      if (!in)
+      {
+          perror(argv[2]);
+          return 1;
+      }
+      int read_status = batch_read (in, &jobs, &count, &bad_line);
+      if (in != stdin)
+      fclose(in);
+      if (read_status < 0)
+      {
+          fprintf(stderr, bad_line ? "batch: cannot read line %zu\n" : "batch: out of memory\n", bad_line);
+          return 1;
+      }
+      set_thread_count (0);
+      int status = batch_render (jobs, count, stdout);
+      free(jobs);
+      return status < 0;
+  }
+
+  cosine (values, SCREEN_WIDTH, 0.15, 0.0);
+  printf("Cosine\n");
+  plot_buffered (values, '*', SCREEN_WIDTH, SCREEN_HEIGHT, scaled, frame);
+  
+  float cubic[] = {0,1,18,1};  
+  polynomial(cubic, 3, values, SCREEN_WIDTH, 0.375, 20);
+  printf("Cubic\n");
+  plot_buffered (values, '*', SCREEN_WIDTH, SCREEN_HEIGHT, scaled, frame);
+
+  return 0;
+} //main
+#endif
+
+
+float 
+get_x (int index, float x_scale, float x_shift) 
+{
+    float continuous_x_value; 
+    continuous_x_value = (index * x_scale) - x_shift; 
+    /* Using the transformation formula.*/
+
+    return continuous_x_value;
+} //get_x
+
+
+void
+cosine_span (float values[], size_t begin, size_t end, float x_scale, float x_shift)
+{
+    float value_of_x_after_transformation;
+    size_t i;
+    for (i = begin; i < end; i++)
+    {
+        value_of_x_after_transformation = get_x(i, x_scale, x_shift); /* Applying get_x on domain.*/
+        values[i] = cos(value_of_x_after_transformation); 
+        /* Doing cos(x) on new values of domain and storing in values[].*/
+    }
+    COUNT(evaluations, end - begin);
+} //cosine_span
+
+void
+cosine (float values[], size_t len, float x_scale, float x_shift)
+{
+    PROBE_BEGIN();
+    cosine_span (values, 0, len, x_scale, x_shift);
+    PROBE_END(PROBE_COSINE);
+} //cosine
+
+float
+power_function (float value_of_x_after_transformation, int j)
+{
+    int k;
+    float x_with_power = 1;
+    for (k = 1; k <= j; k++)
+    x_with_power *= value_of_x_after_transformation;
+    return x_with_power;
+} //power_function
+
+float
+f_of_x_of_polynomial (float coeffs[], size_t degree, float value_of_x_after_transformation)
+{
+    float sum = 0;
+    size_t j;
+    for (j= 0; j <= degree; j++)
+    sum += (coeffs[j] * power_function(value_of_x_after_transformation, j)); 
+    return sum; /* sum = c0*(x^0)+ c1*(x^1) + c2*(x^2) + c3*(x^3). */
+} //f_of_x_of_polynomial 
+
+void
+polynomial (float coeffs[], size_t degree, float values[], size_t len,
+            float x_scale, float x_shift )
+{
+    PROBE_BEGIN();
+    /* Updating values[], evaluating in Horner form instead of summing powers from power_function().*/
+    polynomial_with (coeffs, degree, values, len, x_scale, x_shift, POLY_HORNER);
+    PROBE_END(PROBE_POLYNOMIAL);
+} //polynomial
+
+void
+range (const float values[], size_t len, float * p_max, float * p_min)
+{
+    PROBE_BEGIN();
+    size_t i;
+    *p_max = values[0]; /* Initializing the content of the pointers.*/
+    *p_min = values[0]; /* Initializing the content of the pointers.*/
+    for (i = 1; i < len ; i++)
+    {
+        /* Updating content of pointers to actual max and min by looping through array.*/
+        if (values[i] > *p_max)
+        (*p_max = values[i]); 
+        if (values[i] < *p_min)
+        (*p_min = values[i]);
+    }
+    PROBE_END(PROBE_RANGE);
+} //range
+
+int
+quantize (double value, int levels, float min, float max )
+{
+    float distance_between_min_max;
+    float value_of_level;
+    float y_value;
+    int  level_number;
+
+    COUNT(quantize_calls, 1);
+    distance_between_min_max = (max - min); /* Distance between given min and max*/
+    value_of_level = distance_between_min_max / levels; /* Value that makes up each level.*/
+    if (value_of_level == 0) /* One level when max == min, and nothing to divide by.*/
+    {
+        return 0;
+    }
+    y_value = (value - min); /* Distance bewteen given value and minimum value.*/
+    double quotient = floor(y_value / value_of_level); /* Rounds down to the lowest integer.*/
+    if (!(quotient > INT_MIN && quotient < INT_MAX)) /* NaN, or no int can hold it.*/
+    {
+        return -1;
+    }
+    level_number = quotient;
+    if (level_number == levels || (level_number > levels && value <= max)) /* The returned value has to be between 0 and level-1; a subnormal level can round past it.*/
+    {
+        level_number = (levels-1); 
+    }
+
+    return level_number;
+} //quantize
+
+void
+scale (const float values[], int scaled[], size_t len, size_t height, float min, float max)
+{
+    PROBE_BEGIN();
+    size_t i;
+    for (i = 0; i < len; i++)
+    {
+        /* Updating array, scaled[], by looping through each value in the array.*/
+        scaled[i] = quantize(values[i], height, min, max); 
+    }
+    PROBE_END(PROBE_SCALE);
+} //scale
+
+void
+plot (const float values[], char symbol, int len, int height)
+{
+    PROBE_BEGIN();
+    float min;
+    float max;
+    range (values, len, &max, &min);
+    int * scaled_values = malloc(len * sizeof(int)); /* On the heap, so a wide plot cannot overflow the stack.*/
+    if (!scaled_values)
+    {
+        fprintf(stderr, "plot: no memory for %d columns\n", len);
+        PROBE_END(PROBE_PLOT);
+        return;
+    }
+    scale(values, scaled_values, len, height, min, max);
+    
+    for (int j = (height- 1); j >= 0; j--)
+    {
+        for (int i = 0; i < len; i++)
+        {
+            if (scaled_values[i] == j)
+            printf("%c", symbol);
+            else
+            printf(" ");
+        }
+        printf("\n");
+    }
+    free(scaled_values);
+    COUNT(bytes_written, (size_t) height * (len + 1));
+    PROBE_END(PROBE_PLOT);
+} //plot
+
+void
+fill_frame (const int scaled[], char symbol, int len, int height, char frame[])
+{
+    int row_length = len + 1; /* Each row is followed by a newline.*/
+    int j;
+    int i;
+    for (j = 0; j < height; j++)
+    {
+        /* Blanking each row and ending it with a newline.*/
+        memset(frame + j * row_length, ' ', len);
+        frame[j * row_length + len] = '\n';
+    }
+    for (i = 0; i < len; i++)
+    {
+        /* Scattering each column's level into its row, the top row holds level height-1.*/
+        if (scaled[i] >= 0 && scaled[i] < height)
+        frame[(height - 1 - scaled[i]) * row_length + i] = symbol;
+    }
+} //fill_frame
+
+void
+plot_buffered (const float values[], char symbol, int len, int height, int scaled[], char frame[])
+{
+    PROBE_BEGIN();
+    float min;
+    float max;
+    range (values, len, &max, &min);
+    scale (values, scaled, len, height, min, max);
+    fill_frame (scaled, symbol, len, height, frame);
+    fwrite (frame, 1, (size_t) height * (len + 1), stdout); /* One write for the whole frame.*/
+    COUNT(bytes_written, (size_t) height * (len + 1));
+    PROBE_END(PROBE_PLOT_BUFFERED);
+} //plot_buffered
+
+/* Cody-Waite split of pi/2, exact when multiplied by quadrant numbers below 2^13. */
+static const float PIO2_HIGH = 1.5703125f;
+static const float PIO2_MIDDLE = 4.837512969970703125e-4f;
+static const float PIO2_LOW = 7.54978995489188216e-8f;
+static const float TWO_OVER_PI = 0.636619772367581343f;
+/* Minimax coefficients for sin and cos on [-pi/4, pi/4]. */
+static const float SIN_C1 = -1.6666654611e-1f;
+static const float SIN_C2 = 8.3321608736e-3f;
+static const float SIN_C3 = -1.9515295891e-4f;
+static const float COS_C1 = 4.166664568298827e-2f;
+static const float COS_C2 = -1.388731625493765e-3f;
+static const float COS_C3 = 2.443315711809948e-5f;
+
+float
+cosine_approx (float x)
+{
+    float quadrant = nearbyintf(x * TWO_OVER_PI); /* Nearest multiple of pi/2.*/
+    int n = (int) quadrant;
+    float r = ((x - quadrant * PIO2_HIGH) - quadrant * PIO2_MIDDLE) - quadrant * PIO2_LOW;
+    float r2 = r * r;
+    float sine = r + r * r2 * (SIN_C1 + r2 * (SIN_C2 + r2 * SIN_C3));
+    float cosine_of_r = (1.0f - 0.5f * r2) + r2 * r2 * (COS_C1 + r2 * (COS_C2 + r2 * COS_C3));
+    /* cos(x) is cos(r), -sin(r), -cos(r), sin(r) for quadrants 0 to 3.*/
+    float result = (n & 1) ? sine : cosine_of_r;
+    return ((n + 1) & 2) ? -result : result;
+} //cosine_approx
+
+static void
+cosine_batch_scalar (float values[], size_t begin, size_t end, float x_scale, float x_shift)
+{
+    size_t i;
+    for (i = begin; i < end; i++)
+    values[i] = cosine_approx(get_x(i, x_scale, x_shift));
+} //cosine_batch_scalar
+
+static void
+polynomial_batch_scalar (const float coeffs[], size_t degree, float values[], size_t begin, size_t end,
+                         float x_scale, float x_shift)
+{
+    size_t i;
+    size_t j;
+    for (i = begin; i < end; i++)
+    {
+        float x = get_x(i, x_scale, x_shift);
+        float sum = coeffs[degree];
+        for (j = degree; j > 0; j--)
+        sum = sum * x + coeffs[j - 1]; /* Horner form, one multiply and add per coefficient.*/
+        values[i] = sum;
+    }
+} //polynomial_batch_scalar
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse4.1"))) static void
+cosine_batch_sse (float values[], size_t len, float x_scale, float x_shift)
+{
+    size_t i;
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128 scale_vector = _mm_set1_ps(x_scale);
+    const __m128 shift_vector = _mm_set1_ps(x_shift);
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        /* Same transformation as get_x, then the same reduction as cosine_approx.*/
+        __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(index), scale_vector), shift_vector);
+        __m128 quadrant = _mm_round_ps(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)),
+                                       _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m128i n = _mm_cvtps_epi32(quadrant);
+        __m128 r = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(PIO2_HIGH)));
+        r = _mm_sub_ps(r, _mm_mul_ps(quadrant, _mm_set1_ps(PIO2_MIDDLE)));
+        r = _mm_sub_ps(r, _mm_mul_ps(quadrant, _mm_set1_ps(PIO2_LOW)));
+        __m128 r2 = _mm_mul_ps(r, r);
+        __m128 sine = _mm_add_ps(_mm_set1_ps(SIN_C2), _mm_mul_ps(r2, _mm_set1_ps(SIN_C3)));
+        sine = _mm_add_ps(_mm_set1_ps(SIN_C1), _mm_mul_ps(r2, sine));
+        sine = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), sine));
+        __m128 cosine_of_r = _mm_add_ps(_mm_set1_ps(COS_C2), _mm_mul_ps(r2, _mm_set1_ps(COS_C3)));
+        cosine_of_r = _mm_add_ps(_mm_set1_ps(COS_C1), _mm_mul_ps(r2, cosine_of_r));
+        cosine_of_r = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)),
+                                 _mm_mul_ps(_mm_mul_ps(r2, r2), cosine_of_r));
+        __m128 odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(n, one), one));
+        __m128 result = _mm_blendv_ps(cosine_of_r, sine, odd);
+        __m128i sign = _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(n, one), two), 30);
+        _mm_storeu_ps(values + i, _mm_xor_ps(result, _mm_castsi128_ps(sign)));
+        index = _mm_add_epi32(index, step);
+    }
+    cosine_batch_scalar (values, i, len, x_scale, x_shift);
+} //cosine_batch_sse
+
+__attribute__((target("avx2"))) static void
+cosine_batch_avx2 (float values[], size_t len, float x_scale, float x_shift)
+{
+    size_t i;
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(8);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256 scale_vector = _mm256_set1_ps(x_scale);
+    const __m256 shift_vector = _mm256_set1_ps(x_shift);
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        /* Same transformation as get_x, then the same reduction as cosine_approx.*/
+        __m256 x = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(index), scale_vector), shift_vector);
+        __m256 quadrant = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)),
+                                          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256i n = _mm256_cvtps_epi32(quadrant);
+        __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(quadrant, _mm256_set1_ps(PIO2_HIGH)));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(quadrant, _mm256_set1_ps(PIO2_MIDDLE)));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(quadrant, _mm256_set1_ps(PIO2_LOW)));
+        __m256 r2 = _mm256_mul_ps(r, r);
+        __m256 sine = _mm256_add_ps(_mm256_set1_ps(SIN_C2), _mm256_mul_ps(r2, _mm256_set1_ps(SIN_C3)));
+        sine = _mm256_add_ps(_mm256_set1_ps(SIN_C1), _mm256_mul_ps(r2, sine));
+        sine = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), sine));
+        __m256 cosine_of_r = _mm256_add_ps(_mm256_set1_ps(COS_C2), _mm256_mul_ps(r2, _mm256_set1_ps(COS_C3)));
+        cosine_of_r = _mm256_add_ps(_mm256_set1_ps(COS_C1), _mm256_mul_ps(r2, cosine_of_r));
+        cosine_of_r = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)),
+                                    _mm256_mul_ps(_mm256_mul_ps(r2, r2), cosine_of_r));
+        __m256 odd = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(n, one), one));
+        __m256 result = _mm256_blendv_ps(cosine_of_r, sine, odd);
+        __m256i sign = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(n, one), two), 30);
+        _mm256_storeu_ps(values + i, _mm256_xor_ps(result, _mm256_castsi256_ps(sign)));
+        index = _mm256_add_epi32(index, step);
+    }
+    cosine_batch_scalar (values, i, len, x_scale, x_shift);
+} //cosine_batch_avx2
+
+__attribute__((target("sse4.1"))) static void
+polynomial_batch_sse (const float coeffs[], size_t degree, float values[], size_t len,
+                      float x_scale, float x_shift)
+{
+    size_t i;
+    size_t j;
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+    const __m128 scale_vector = _mm_set1_ps(x_scale);
+    const __m128 shift_vector = _mm_set1_ps(x_shift);
+    for (i = 0; i + 4 <= len; i += 4)
+    {
+        __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(index), scale_vector), shift_vector);
+        __m128 sum = _mm_set1_ps(coeffs[degree]);
+        for (j = degree; j > 0; j--)
+        sum = _mm_add_ps(_mm_mul_ps(sum, x), _mm_set1_ps(coeffs[j - 1]));
+        _mm_storeu_ps(values + i, sum);
+        index = _mm_add_epi32(index, step);
+    }
+    polynomial_batch_scalar (coeffs, degree, values, i, len, x_scale, x_shift);
+} //polynomial_batch_sse
+
+__attribute__((target("avx2"))) static void
+polynomial_batch_avx2 (const float coeffs[], size_t degree, float values[], size_t len,
+                       float x_scale, float x_shift)
+{
+    size_t i;
+    size_t j;
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(8);
+    const __m256 scale_vector = _mm256_set1_ps(x_scale);
+    const __m256 shift_vector = _mm256_set1_ps(x_shift);
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m256 x = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(index), scale_vector), shift_vector);
+        __m256 sum = _mm256_set1_ps(coeffs[degree]);
+        for (j = degree; j > 0; j--)
+        sum = _mm256_add_ps(_mm256_mul_ps(sum, x), _mm256_set1_ps(coeffs[j - 1]));
+        _mm256_storeu_ps(values + i, sum);
+        index = _mm256_add_epi32(index, step);
+    }
+    polynomial_batch_scalar (coeffs, degree, values, i, len, x_scale, x_shift);
+} //polynomial_batch_avx2
+#endif
+
+/* Kernel chosen by batch_kernel_select(), -1 until the first batch call. */
+static int active_batch_kernel = -1;
+
+enum batch_kernel
+batch_kernel_select (enum batch_kernel requested)
+{
+    enum batch_kernel supported = KERNEL_SCALAR;
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    supported = KERNEL_AVX2;
+    else if (__builtin_cpu_supports("sse4.1"))
+    supported = KERNEL_SSE;
+#endif
+    active_batch_kernel = (requested < supported) ? requested : supported;
+    return active_batch_kernel;
+} //batch_kernel_select
+
+void
+cosine_batch (float values[], size_t len, float x_scale, float x_shift)
+{
+    COUNT(evaluations, len);
+    if (active_batch_kernel < 0)
+    batch_kernel_select (KERNEL_AVX2); /* Runtime dispatch on first use.*/
+#ifdef HAVE_X86_KERNELS
+    if (active_batch_kernel == KERNEL_AVX2)
+    {
+        cosine_batch_avx2 (values, len, x_scale, x_shift);
+        return;
+    }
+    if (active_batch_kernel == KERNEL_SSE)
+    {
+        cosine_batch_sse (values, len, x_scale, x_shift);
+        return;
+    }
+#endif
+    cosine_batch_scalar (values, 0, len, x_scale, x_shift);
+} //cosine_batch
+
+void
+polynomial_batch (const float coeffs[], size_t degree, float values[], size_t len, float x_scale, float x_shift)
+{
+    COUNT(evaluations, len);
+    if (active_batch_kernel < 0)
+    batch_kernel_select (KERNEL_AVX2); /* Runtime dispatch on first use.*/
+#ifdef HAVE_X86_KERNELS
+    if (active_batch_kernel == KERNEL_AVX2)
+    {
+        polynomial_batch_avx2 (coeffs, degree, values, len, x_scale, x_shift);
+        return;
+    }
+    if (active_batch_kernel == KERNEL_SSE)
+    {
+        polynomial_batch_sse (coeffs, degree, values, len, x_scale, x_shift);
+        return;
+    }
+#endif
+    polynomial_batch_scalar (coeffs, degree, values, 0, len, x_scale, x_shift);
+} //polynomial_batch
+
+float
+polynomial_eval (const float coeffs[], size_t degree, float x, enum poly_method method)
+{
+    size_t j;
+    float sum = coeffs[degree];
+    if (method == POLY_ESTRIN)
+    {
+        /* Each ESTRIN_CHUNK coefficients in turn, from the highest: combining neighbours pairwise, squaring x each
+           round, until one is left, then joining it to the chunks above by Horner's rule in x^ESTRIN_CHUNK.
+           The first round pairs straight from coeffs[], so nothing is copied.*/
+        float terms[ESTRIN_CHUNK / 2];
+        float stride = x;
+        size_t last = degree / ESTRIN_CHUNK;
+        size_t chunk;
+        if (last > 0)
+        {
+            for (j = 1; j < ESTRIN_CHUNK; j *= 2)
+            stride *= stride;
+        }
+        for (chunk = last + 1; chunk > 0; chunk--)
+        {
+            const float * first = coeffs + (chunk - 1) * ESTRIN_CHUNK;
+            size_t count = (chunk - 1 == last) ? degree + 1 - last * ESTRIN_CHUNK : ESTRIN_CHUNK;
+            float power = x * x;
+            for (j = 0; j < count / 2; j++)
+            terms[j] = first[2 * j] + first[2 * j + 1] * x;
+            if (count % 2)
+            terms[count / 2] = first[count - 1];
+            count = (count + 1) / 2;
+            while (count > 1)
+            {
+                for (j = 0; j < count / 2; j++)
+                terms[j] = terms[2 * j] + terms[2 * j + 1] * power;
+                if (count % 2)
+                terms[count / 2] = terms[count - 1];
+                count = (count + 1) / 2;
+                power *= power;
+            }
+            sum = (chunk - 1 == last) ? terms[0] : sum * stride + terms[0];
+        }
+        return sum;
+    }
+    if (method == POLY_COMPENSATED)
+    {
+        /* Horner, with the exact error of every product and sum summed into a second Horner.*/
+        float correction = 0;
+        for (j = degree; j > 0; j--)
+        {
+            float product = sum * x;
+            float product_error = fmaf(sum, x, -product);
+            float next = product + coeffs[j - 1];
+            float rounded = next - product;
+            float sum_error = (product - (next - rounded)) + (coeffs[j - 1] - rounded);
+            correction = correction * x + (product_error + sum_error);
+            sum = next;
+        }
+        return sum + correction;
+    }
+    for (j = degree; j > 0; j--)
+    sum = sum * x + coeffs[j - 1]; /* Horner form, one multiply and add per coefficient.*/
+    return sum;
+} //polynomial_eval
+
+/* Fills values[] for POLY_FORWARD. Lane r of each anchored run holds the samples r, r + FORWARD_LANES, ... after
+   the anchor, so the lanes' additions are independent and the compiler can run them side by side. */
+static void
+polynomial_forward (const float coeffs[], size_t degree, float values[], size_t len, float x_scale, float x_shift)
+{
+    double differences[FORWARD_MAX_DEGREE + 1][FORWARD_LANES];
+    size_t anchor;
+    size_t i;
+    size_t k;
+    size_t m;
+    int lane;
+    for (anchor = 0; anchor < len; anchor += FORWARD_ANCHOR)
+    {
+        size_t end = (len - anchor < FORWARD_ANCHOR) ? len : anchor + FORWARD_ANCHOR;
+        for (lane = 0; lane < FORWARD_LANES; lane++)
+        {
+            /* Re-anchoring: the lane's next degree + 1 samples by Horner in double, then their differences.*/
+            for (m = 0; m <= degree; m++)
+            {
+                double x = (double) (anchor + lane + m * FORWARD_LANES) * x_scale - x_shift;
+                double sum = coeffs[degree];
+                for (k = degree; k > 0; k--)
+                sum = sum * x + coeffs[k - 1];
+                differences[m][lane] = sum;
+            }
+            for (k = 1; k <= degree; k++)
+            {
+                for (m = degree; m >= k; m--)
+                differences[m][lane] -= differences[m - 1][lane];
+            }
+        }
+        for (i = anchor; i + FORWARD_LANES <= end; i += FORWARD_LANES)
+        {
+            for (lane = 0; lane < FORWARD_LANES; lane++)
+            values[i + lane] = (float) differences[0][lane];
+            for (k = 0; k < degree; k++)
+            {
+                for (lane = 0; lane < FORWARD_LANES; lane++)
+                differences[k][lane] += differences[k + 1][lane];
+            }
+        }
+        for (lane = 0; i + lane < end; lane++)
+        values[i + lane] = (float) differences[0][lane];
+    }
+} //polynomial_forward
+
+void
+polynomial_with (const float coeffs[], size_t degree, float values[], size_t len,
+                 float x_scale, float x_shift, enum poly_method method)
+{
+    size_t i;
+    COUNT(evaluations, len);
+    if (method == POLY_FORWARD && degree <= FORWARD_MAX_DEGREE)
+    {
+        polynomial_forward (coeffs, degree, values, len, x_scale, x_shift);
+        return;
+    }
+    for (i = 0; i < len; i++)
+    values[i] = polynomial_eval(coeffs, degree, get_x(i, x_scale, x_shift), method);
+} //polynomial_with
+
+/* Workers of the pool, and the job they are all working on. */
+static struct
+{
+    pthread_t workers[MAX_THREADS];
+    int worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation; /* Bumped for every job, so workers know a new one has started.*/
+    unsigned long created;    /* The generation when the workers were started; jobs up to it are not theirs.*/
+    int busy;                 /* Workers still inside the current job.*/
+    int stop;
+    void (*task) (void * context, size_t begin, size_t end);
+    void * context;
+    size_t len;
+    size_t chunk;
+    size_t next_chunk;        /* Shared counter the threads claim chunks from.*/
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .start = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+/* Claims and runs chunks of a job until none are left; the job is passed in, read under the pool's lock. */
+static void
+run_chunks (void (*task) (void * context, size_t begin, size_t end), void * context, size_t len, size_t chunk)
+{
+    size_t begin;
+    while ((begin = __atomic_fetch_add(&pool.next_chunk, 1, __ATOMIC_RELAXED) * chunk) < len)
+    {
+        size_t end = (begin + chunk < len) ? begin + chunk : len;
+        task (context, begin, end);
+    }
+} //run_chunks
+
+static void *
+pool_worker (void * unused)
+{
+    (void) unused;
+    pthread_mutex_lock(&pool.lock);
+    /* Not pool.generation: a worker that is slow to start could read a job's generation and miss it.*/
+    unsigned long seen = pool.created;
+    for (;;)
+    {
+        while (pool.generation == seen && !pool.stop)
+        pthread_cond_wait(&pool.start, &pool.lock);
+        if (pool.stop)
+        break;
+        seen = pool.generation;
+        void (*task) (void * context, size_t begin, size_t end) = pool.task;
+        void * context = pool.context;
+        size_t len = pool.len;
+        size_t chunk = pool.chunk;
+        pthread_mutex_unlock(&pool.lock);
+        run_chunks (task, context, len, chunk);
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.busy == 0)
+        pthread_cond_signal(&pool.done);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+} //pool_worker
+
+int
+set_thread_count (int count)
+{
+    int i;
+    if (count <= 0)
+    count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+    count = 1;
+    if (count > MAX_THREADS)
+    count = MAX_THREADS;
+
+    /* Joining the old workers before starting the new ones.*/
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+    for (i = 0; i < pool.worker_count; i++)
+    pthread_join(pool.workers[i], NULL);
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 0;
+    pool.worker_count = 0;
+    pool.created = pool.generation;
+    pthread_mutex_unlock(&pool.lock);
+
+    for (i = 0; i < count - 1; i++)
+    {
+        if (pthread_create(&pool.workers[i], NULL, pool_worker, NULL) != 0)
+        break;
+        pool.worker_count++;
+    }
+    return pool.worker_count + 1;
+} //set_thread_count
+
+/* Runs task over [0, len) in chunks of the given size, claimed by the calling thread and the pool's workers. */
+static void
+parallel_run (size_t len, size_t chunk, void (*task) (void * context, size_t begin, size_t end), void * context)
+{
+    if (pool.worker_count == 0)
+    {
+        task (context, 0, len);
+        return;
+    }
+    pthread_mutex_lock(&pool.lock);
+    pool.task = task;
+    pool.context = context;
+    pool.len = len;
+    pool.chunk = chunk;
+    pool.next_chunk = 0;
+    pool.busy = pool.worker_count;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_chunks (task, context, len, chunk); /* The calling thread works too.*/
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy > 0)
+    pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+} //parallel_run
+
+void
+parallel_for (size_t len, void (*task) (void * context, size_t begin, size_t end), void * context)
+{
+    size_t participants = pool.worker_count + 1;
+    size_t chunk;
+    if (pool.worker_count == 0 || len <= CACHE_LINE_FLOATS)
+    {
+        task (context, 0, len);
+        return;
+    }
+    /* About four chunks per thread for balance, rounded up to whole cache lines.*/
+    chunk = (len + 4 * participants - 1) / (4 * participants);
+    chunk = (chunk + CACHE_LINE_FLOATS - 1) / CACHE_LINE_FLOATS * CACHE_LINE_FLOATS;
+    parallel_run (len, chunk, task, context);
+} //parallel_for
+
+/* Arguments of the fill, range and scale procedures, handed to their chunk tasks. */
+struct parallel_job
+{
+    const float * coeffs;
+    size_t degree;
+    const float * input;
+    float * values;
+    int * scaled;
+    float x_scale;
+    float x_shift;
+    size_t height;
+    float min;
+    float max;
+    pthread_mutex_t lock;
+};
+
+static void
+cosine_chunk (void * context, size_t begin, size_t end)
+{
+    struct parallel_job * job = context;
+    cosine_span (job->values, begin, end, job->x_scale, job->x_shift);
+} //cosine_chunk
+
+static void
+polynomial_chunk (void * context, size_t begin, size_t end)
+{
+    struct parallel_job * job = context;
+    size_t i;
+    for (i = begin; i < end; i++)
+    job->values[i] = polynomial_eval(job->coeffs, job->degree, get_x(i, job->x_scale, job->x_shift), POLY_HORNER);
+    COUNT(evaluations, end - begin);
+} //polynomial_chunk
+
+static void
+range_chunk (void * context, size_t begin, size_t end)
+{
+    struct parallel_job * job = context;
+    float max;
+    float min;
+    range (job->input + begin, end - begin, &max, &min);
+    /* Merging this chunk's max and min into the job's.*/
+    pthread_mutex_lock(&job->lock);
+    if (max > job->max)
+    job->max = max;
+    if (min < job->min)
+    job->min = min;
+    pthread_mutex_unlock(&job->lock);
+} //range_chunk
+
+static void
+scale_chunk (void * context, size_t begin, size_t end)
+{
+    struct parallel_job * job = context;
+    scale (job->input + begin, job->scaled + begin, end - begin, job->height, job->min, job->max);
+} //scale_chunk
+
+void
+cosine_parallel (float values[], size_t len, float x_scale, float x_shift)
+{
+    struct parallel_job job = { .values = values, .x_scale = x_scale, .x_shift = x_shift };
+    parallel_for (len, cosine_chunk, &job);
+} //cosine_parallel
+
+void
+polynomial_parallel (const float coeffs[], size_t degree, float values[], size_t len, float x_scale, float x_shift)
+{
+    struct parallel_job job = { .coeffs = coeffs, .degree = degree, .values = values,
+                                .x_scale = x_scale, .x_shift = x_shift };
+    parallel_for (len, polynomial_chunk, &job);
+} //polynomial_parallel
+
+void
+range_parallel (const float values[], size_t len, float * p_max, float * p_min)
+{
+    struct parallel_job job = { .input = values, .max = values[0], .min = values[0],
+                                .lock = PTHREAD_MUTEX_INITIALIZER };
+    parallel_for (len, range_chunk, &job);
+    *p_max = job.max;
+    *p_min = job.min;
+} //range_parallel
+
+void
+scale_parallel (const float values[], int scaled[], size_t len, size_t height, float min, float max)
+{
+    struct parallel_job job = { .input = values, .scaled = scaled, .height = height, .min = min, .max = max };
+    parallel_for (len, scale_chunk, &job);
+} //scale_parallel
+
+float
+evaluate_function (const struct function_spec * function, float x)
+{
+    if (function->kind == FUNCTION_COSINE)
+    return cos(x);
+    return polynomial_eval(function->coeffs, function->degree, x, POLY_HORNER);
+} //evaluate_function
+
+void
+evaluate_block (const struct function_spec * function, float block[], size_t first_index, size_t count,
+                float x_scale, float x_shift)
+{
+    size_t k;
+    for (k = 0; k < count; k++)
+    block[k] = evaluate_function(function, get_x(first_index + k, x_scale, x_shift));
+    COUNT(evaluations, count);
+} //evaluate_block
+
+void
+pipeline_levels (const struct function_spec * function, size_t len, float x_scale, float x_shift,
+                 size_t height, int levels[], float values[], float * p_max, float * p_min)
+{
+    float buffer[PIPELINE_BLOCK];
+    float max;
+    float min;
+    size_t begin;
+    size_t count;
+    size_t k;
+
+    /* With the range from the oracle, one pass evaluates and quantizes each block.*/
+    if (range_oracle(function, len, x_scale, x_shift, &max, &min) == 0)
+    {
+        for (begin = 0; begin < len; begin += count)
+        {
+            float * block = values ? values + begin : buffer;
+            count = (len - begin < PIPELINE_BLOCK) ? len - begin : PIPELINE_BLOCK;
+            evaluate_block (function, block, begin, count, x_scale, x_shift);
+            scale (block, levels + begin, count, height, min, max);
+        }
+        *p_max = max;
+        *p_min = min;
+        return;
+    }
+
+    /* First pass: evaluating each block and folding it into the max and min.*/
+    for (begin = 0; begin < len; begin += count)
+    {
+        float * block = values ? values + begin : buffer;
+        count = (len - begin < PIPELINE_BLOCK) ? len - begin : PIPELINE_BLOCK;
+        evaluate_block (function, block, begin, count, x_scale, x_shift);
+        if (begin == 0)
+        {
+            max = block[0]; /* Initializing with the first sample.*/
+            min = max;
+        }
+        for (k = 0; k < count; k++)
+        {
+            if (block[k] > max)
+            max = block[k];
+            if (block[k] < min)
+            min = block[k];
+        }
+    }
+
+    /* Second pass: quantizing each block, read back from values[] or evaluated again into the buffer.*/
+    for (begin = 0; begin < len; begin += count)
+    {
+        float * block = values ? values + begin : buffer;
+        count = (len - begin < PIPELINE_BLOCK) ? len - begin : PIPELINE_BLOCK;
+        if (!values)
+        evaluate_block (function, block, begin, count, x_scale, x_shift);
+        scale (block, levels + begin, count, height, min, max);
+    }
+    *p_max = max;
+    *p_min = min;
+} //pipeline_levels
+
+/* State of expression_compile() while it descends the grammar. */
+struct parser
+{
+    const char * text;
+    size_t position;
+    struct expression * expr;
+    int depth;
+    int nesting; /* parse_unary() calls in progress; every recursion of the grammar passes through it.*/
+    int failed;
+};
+
+/* Records the first error, at the current position. */
+static void
+parse_error (struct parser * parser)
+{
+    if (!parser->failed)
+    parser->expr->error = (int) parser->position;
+    parser->failed = 1;
+} //parse_error
+
+static void
+skip_spaces (struct parser * parser)
+{
+    while (isspace((unsigned char) parser->text[parser->position]))
+    parser->position++;
+} //skip_spaces
+
+/* Appends an instruction, keeping track of how deep the stack gets. */
+static void
+emit (struct parser * parser, enum opcode op, int operand, int stack_change)
+{
+    struct expression * expr = parser->expr;
+    if (expr->length >= EXPRESSION_MAX_CODE || parser->depth + stack_change > EXPRESSION_MAX_DEPTH)
+    {
+        parse_error (parser);
+        return;
+    }
+    expr->code[expr->length] = op;
+    expr->operand[expr->length] = operand;
+    expr->length++;
+    parser->depth += stack_change;
+    if (parser->depth > expr->max_depth)
+    expr->max_depth = parser->depth;
+} //emit
+
+static void
+emit_constant (struct parser * parser, float constant)
+{
+    struct expression * expr = parser->expr;
+    if (expr->constant_count >= EXPRESSION_MAX_CONSTANTS)
+    {
+        parse_error (parser);
+        return;
+    }
+    expr->constants[expr->constant_count] = constant;
+    emit (parser, OP_CONST, expr->constant_count++, 1);
+} //emit_constant
+
+static void parse_sum (struct parser * parser);
+static void parse_unary (struct parser * parser);
+
+/* primary := number | x | pi | e | function '(' sum ')' | '(' sum ')' */
+static void
+parse_primary (struct parser * parser)
+{
+    static const char * names[] = { "sin", "cos", "tan", "exp", "log", "sqrt", "abs" };
+    static const enum opcode ops[] = { OP_SIN, OP_COS, OP_TAN, OP_EXP, OP_LOG, OP_SQRT, OP_ABS };
+    const char * start;
+    size_t length = 0;
+    size_t k;
+
+    skip_spaces (parser);
+    start = parser->text + parser->position;
+    if (isdigit((unsigned char) *start) || *start == '.')
+    {
+        /* Only digits [. digits] [e [sign] digits]: strtof() alone would take hex, inf and nan too.*/
+        char number[EXPRESSION_MAX_NUMBER + 1];
+        length = strspn(start, "0123456789");
+        if (start[length] == '.')
+        length += 1 + strspn(start + length + 1, "0123456789");
+        if (length == 1 && *start == '.')
+        {
+            parse_error (parser);
+            return;
+        }
+        if ((start[length] == 'e' || start[length] == 'E')
+            && (isdigit((unsigned char) start[length + 1])
+                || ((start[length + 1] == '+' || start[length + 1] == '-') && isdigit((unsigned char) start[length + 2]))))
+        {
+            length += 2;
+            length += strspn(start + length, "0123456789");
+        }
+        if (length > EXPRESSION_MAX_NUMBER)
+        {
+            parse_error (parser);
+            return;
+        }
+        memcpy(number, start, length);
+        number[length] = '\0';
+        parser->position += length;
+        emit_constant (parser, strtof(number, NULL));
+        return;
+    }
+    if (*start == '(')
+    {
+        parser->position++;
+        parse_sum (parser);
+        skip_spaces (parser);
+        if (parser->text[parser->position] != ')')
+        {
+            parse_error (parser);
+            return;
+        }
+        parser->position++;
+        return;
+    }
+    while (isalpha((unsigned char) start[length]))
+    length++;
+    if (length == 1 && *start == 'x')
+    {
+        parser->position++;
+        emit (parser, OP_X, 0, 1);
+        return;
+    }
+    if ((length == 2 && strncmp(start, "pi", 2) == 0) || (length == 1 && *start == 'e'))
+    {
+        parser->position += length;
+        emit_constant (parser, (length == 2) ? M_PI : M_E);
+        return;
+    }
+    for (k = 0; k < sizeof(names) / sizeof(names[0]); k++)
+    {
+        if (length == strlen(names[k]) && strncmp(start, names[k], length) == 0)
+        {
+            parser->position += length;
+            skip_spaces (parser);
+            if (parser->text[parser->position] != '(')
+            {
+                parse_error (parser);
+                return;
+            }
+            parse_primary (parser); /* The parenthesized argument.*/
+            emit (parser, ops[k], 0, 0);
+            return;
+        }
+    }
+    parse_error (parser);
+} //parse_primary
+
+/* power := primary [ '^' unary ], right associative, with small integer exponents strength reduced. */
+static void
+parse_power (struct parser * parser)
+{
+    struct expression * expr = parser->expr;
+    parse_primary (parser);
+    skip_spaces (parser);
+    if (parser->failed || parser->text[parser->position] != '^')
+    return;
+    parser->position++;
+    int exponent_start = expr->length;
+    parse_unary (parser);
+    if (parser->failed)
+    return;
+    if (expr->length == exponent_start + 1 && expr->code[exponent_start] == OP_CONST)
+    {
+        float exponent = expr->constants[expr->operand[exponent_start]];
+        if (exponent >= 0 && exponent <= 32 && exponent == (int) exponent)
+        {
+            /* Replacing the pushed constant with a multiplication loop.*/
+            expr->length--;
+            expr->constant_count--;
+            parser->depth--;
+            emit (parser, OP_POWI, (int) exponent, 0);
+            return;
+        }
+    }
+    emit (parser, OP_POW, 0, -1);
+} //parse_power
+
+/* unary := ('-' | '+') unary | power */
+static void
+parse_unary (struct parser * parser)
+{
+    skip_spaces (parser);
+    if (parser->failed || parser->nesting >= EXPRESSION_MAX_NESTING) /* Before the C stack runs out.*/
+    {
+        parse_error (parser);
+        return;
+    }
+    parser->nesting++;
+    if (parser->text[parser->position] == '-')
+    {
+        parser->position++;
+        parse_unary (parser);
+        emit (parser, OP_NEG, 0, 0);
+    }
+    else if (parser->text[parser->position] == '+')
+    {
+        parser->position++;
+        parse_unary (parser);
+    }
+    else
+    parse_power (parser);
+    parser->nesting--;
+} //parse_unary
+
+/* product := unary (('*' | '/') unary)* */
+static void
+parse_product (struct parser * parser)
+{
+    parse_unary (parser);
+    for (;;)
+    {
+        skip_spaces (parser);
+        char op = parser->text[parser->position];
+        if (parser->failed || (op != '*' && op != '/'))
+        return;
+        parser->position++;
+        parse_unary (parser);
+        emit (parser, (op == '*') ? OP_MUL : OP_DIV, 0, -1);
+    }
+} //parse_product
+
+/* sum := product (('+' | '-') product)* */
+static void
+parse_sum (struct parser * parser)
+{
+    parse_product (parser);
+    for (;;)
+    {
+        skip_spaces (parser);
+        char op = parser->text[parser->position];
+        if (parser->failed || (op != '+' && op != '-'))
+        return;
+        parser->position++;
+        parse_product (parser);
+        emit (parser, (op == '+') ? OP_ADD : OP_SUB, 0, -1);
+    }
+} //parse_sum
+
+int
+expression_compile (const char * text, struct expression * expr)
+{
+    struct parser parser = { text, 0, expr, 0, 0, 0 };
+    expr->length = 0;
+    expr->constant_count = 0;
+    expr->max_depth = 0;
+    expr->error = -1;
+
+    /* Skipping an optional "y =" before the expression.*/
+    skip_spaces (&parser);
+    if (text[parser.position] == 'y')
+    {
+        parser.position++;
+        skip_spaces (&parser);
+        if (text[parser.position] != '=')
+        {
+            parse_error (&parser);
+            return -1;
+        }
+        parser.position++;
+    }
+    parse_sum (&parser);
+    skip_spaces (&parser);
+    if (text[parser.position] != '\0')
+    parse_error (&parser);
+    return parser.failed ? -1 : 0;
+} //expression_compile
+
+void
+expression_fill_span (const struct expression * expr, float values[], size_t begin, size_t end,
+                      float x_scale, float x_shift)
+{
+    float stack[EXPRESSION_MAX_DEPTH][EXPRESSION_BATCH];
+    size_t first;
+    size_t count;
+    size_t k;
+    int pc;
+    int top;
+    int j;
+
+    for (first = begin; first < end; first += count)
+    {
+        count = (end - first < EXPRESSION_BATCH) ? end - first : EXPRESSION_BATCH;
+        top = -1;
+        for (pc = 0; pc < expr->length; pc++)
+        {
+            /* Dispatching once per instruction, then running it over the batch. Every loop stops at count,
+               so a short last batch never reads lanes no instruction wrote.*/
+            float * a = stack[top > 0 ? top - 1 : 0];
+            float * b = stack[top > 0 ? top : 0];
+            int operand = expr->operand[pc]; /* Loaded once, so the loops below are not tied to expr.*/
+            switch (expr->code[pc])
+            {
+            case OP_CONST:
+            {
+                float constant = expr->constants[operand];
+                top++;
+                b = stack[top];
+                for (k = 0; k < count; k++)
+                b[k] = constant;
+                break;
+            }
+            case OP_X:
+                top++;
+                b = stack[top];
+                for (k = 0; k < count; k++)
+                b[k] = get_x((int) (first + k), x_scale, x_shift);
+                break;
+            case OP_ADD:
+                for (k = 0; k < count; k++)
+                a[k] = a[k] + b[k];
+                top--;
+                break;
+            case OP_SUB:
+                for (k = 0; k < count; k++)
+                a[k] = a[k] - b[k];
+                top--;
+                break;
+            case OP_MUL:
+                for (k = 0; k < count; k++)
+                a[k] = a[k] * b[k];
+                top--;
+                break;
+            case OP_DIV:
+                for (k = 0; k < count; k++)
+                a[k] = a[k] / b[k];
+                top--;
+                break;
+            case OP_POW:
+                for (k = 0; k < count; k++)
+                a[k] = pow(a[k], b[k]);
+                top--;
+                break;
+            case OP_POWI:
+                for (k = 0; k < count; k++)
+                {
+                    float base = b[k];
+                    float power = (operand == 0) ? 1.0f : base;
+                    for (j = 1; j < operand; j++)
+                    power *= base;
+                    b[k] = power;
+                }
+                break;
+            case OP_NEG:
+                for (k = 0; k < count; k++)
+                b[k] = -b[k];
+                break;
+            case OP_SIN:
+                for (k = 0; k < count; k++)
+                b[k] = sin(b[k]);
+                break;
+            case OP_COS:
+                for (k = 0; k < count; k++)
+                b[k] = cos(b[k]);
+                break;
+            case OP_TAN:
+                for (k = 0; k < count; k++)
+                b[k] = tan(b[k]);
+                break;
+            case OP_EXP:
+                for (k = 0; k < count; k++)
+                b[k] = exp(b[k]);
+                break;
+            case OP_LOG:
+                for (k = 0; k < count; k++)
+                b[k] = log(b[k]);
+                break;
+            case OP_SQRT:
+                for (k = 0; k < count; k++)
+                b[k] = sqrt(b[k]);
+                break;
+            case OP_ABS:
+                for (k = 0; k < count; k++)
+                b[k] = fabsf(b[k]);
+                break;
+            }
+        }
+        memcpy(values + first, stack[0], count * sizeof(float));
+    }
+    COUNT(evaluations, end - begin);
+} //expression_fill_span
+
+void
+expression_fill (const struct expression * expr, float values[], size_t len, float x_scale, float x_shift)
+{
+    expression_fill_span (expr, values, 0, len, x_scale, x_shift);
+} //expression_fill
+
+#ifdef HAVE_JIT
+/* Layout of the constant table placed after the generated code, 16 bytes per entry. */
+enum { JIT_INDEX = 0, JIT_STEP = 16, JIT_SIGN = 32, JIT_ABS = 48, JIT_ONE = 64, JIT_CONSTANTS = 80 };
+/* Registers of the generated code: the expression stack is xmm0 to xmm10. */
+enum { JIT_STACK_SLOTS = 11, JIT_TEMP = 11, JIT_INDEX_REG = 12, JIT_SCALE_REG = 13, JIT_SHIFT_REG = 14, JIT_STEP_REG = 15 };
+/* SSE opcodes, after the 0x0F escape byte. */
+enum { SSE_MOVUPS_LOAD = 0x10, SSE_MOVUPS_STORE = 0x11, SSE_MOVAPS = 0x28, SSE_SQRTPS = 0x51, SSE_ANDPS = 0x54,
+       SSE_XORPS = 0x57, SSE_ADDPS = 0x58, SSE_MULPS = 0x59, SSE_CVTDQ2PS = 0x5B, SSE_SUBPS = 0x5C,
+       SSE_DIVPS = 0x5E, SSE_SHUFPS = 0xC6, SSE_PADDD = 0xFE };
+
+/* Machine code being generated. */
+struct jit_buffer
+{
+    unsigned char * bytes;
+    size_t length;
+};
+
+static void
+emit_bytes (struct jit_buffer * buffer, const unsigned char * bytes, size_t count)
+{
+    memcpy(buffer->bytes + buffer->length, bytes, count);
+    buffer->length += count;
+} //emit_bytes
+
+/* Emits an SSE instruction on two xmm registers, reg being the destination. */
+static void
+emit_sse (struct jit_buffer * buffer, unsigned char opcode, int reg, int rm)
+{
+    if (opcode == SSE_PADDD)
+    buffer->bytes[buffer->length++] = 0x66;
+    if (reg >= 8 || rm >= 8)
+    buffer->bytes[buffer->length++] = 0x40 | ((reg >> 3) << 2) | (rm >> 3);
+    buffer->bytes[buffer->length++] = 0x0F;
+    buffer->bytes[buffer->length++] = opcode;
+    buffer->bytes[buffer->length++] = 0xC0 | ((reg & 7) << 3) | (rm & 7);
+} //emit_sse
+
+/* Emits an SSE instruction on an xmm register and the table entry at [rax + offset]. */
+static void
+emit_sse_table (struct jit_buffer * buffer, unsigned char opcode, int reg, int offset)
+{
+    if (reg >= 8)
+    buffer->bytes[buffer->length++] = 0x44;
+    buffer->bytes[buffer->length++] = 0x0F;
+    buffer->bytes[buffer->length++] = opcode;
+    buffer->bytes[buffer->length++] = 0x80 | ((reg & 7) << 3);
+    memcpy(buffer->bytes + buffer->length, &offset, 4);
+    buffer->length += 4;
+} //emit_sse_table
+
+/* Emits code leaving the expression for the 4 indices in JIT_INDEX_REG in xmm0. */
+static void
+emit_expression (struct jit_buffer * buffer, const struct expression * expr)
+{
+    static const unsigned char binary[] = { [OP_ADD] = SSE_ADDPS, [OP_SUB] = SSE_SUBPS,
+                                            [OP_MUL] = SSE_MULPS, [OP_DIV] = SSE_DIVPS };
+    int top = -1;
+    int pc;
+    int j;
+    for (pc = 0; pc < expr->length; pc++)
+    {
+        switch (expr->code[pc])
+        {
+        case OP_CONST:
+            emit_sse_table (buffer, SSE_MOVUPS_LOAD, ++top, JIT_CONSTANTS + 16 * expr->operand[pc]);
+            break;
+        case OP_X:
+            /* Same steps as get_x: the index as a float, times x_scale, minus x_shift.*/
+            emit_sse (buffer, SSE_CVTDQ2PS, ++top, JIT_INDEX_REG);
+            emit_sse (buffer, SSE_MULPS, top, JIT_SCALE_REG);
+            emit_sse (buffer, SSE_SUBPS, top, JIT_SHIFT_REG);
+            break;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+            emit_sse (buffer, binary[expr->code[pc]], top - 1, top);
+            top--;
+            break;
+        case OP_POWI:
+            /* The same multiplication order as the interpreter.*/
+            if (expr->operand[pc] == 0)
+            emit_sse_table (buffer, SSE_MOVUPS_LOAD, top, JIT_ONE);
+            if (expr->operand[pc] >= 2)
+            emit_sse (buffer, SSE_MOVAPS, JIT_TEMP, top);
+            for (j = 1; j < expr->operand[pc]; j++)
+            emit_sse (buffer, SSE_MULPS, top, JIT_TEMP);
+            break;
+        case OP_NEG:
+            emit_sse_table (buffer, SSE_XORPS, top, JIT_SIGN);
+            break;
+        case OP_ABS:
+            emit_sse_table (buffer, SSE_ANDPS, top, JIT_ABS);
+            break;
+        case OP_SQRT:
+            emit_sse (buffer, SSE_SQRTPS, top, top);
+            break;
+        }
+    }
+} //emit_expression
+
+/* Points the rel32 of a jump ending at from to target. */
+static void
+patch_jump (struct jit_buffer * buffer, size_t from, size_t target)
+{
+    int displacement = (int) (target - from);
+    memcpy(buffer->bytes + from - 4, &displacement, 4);
+} //patch_jump
+#endif
+
+int
+expression_jit (const struct expression * expr, struct jit_function * jit)
+{
+    jit->fill = NULL;
+    jit->memory = NULL;
+    jit->size = 0;
+#ifdef HAVE_JIT
+    int pc;
+    if (expr->max_depth > JIT_STACK_SLOTS)
+    return -1;
+    for (pc = 0; pc < expr->length; pc++)
+    {
+        enum opcode op = expr->code[pc];
+        if (op == OP_POW || (op >= OP_SIN && op <= OP_LOG))
+        return -1; /* Left to the interpreter, which calls libm.*/
+    }
+
+    /* Room for two copies of the expression, the fixed instructions, and the table after them.*/
+    size_t code_capacity = 2 * (size_t) expr->length * 32 * 5 + 256;
+    size_t table_offset = (code_capacity + 15) / 16 * 16;
+    size_t size = table_offset + JIT_CONSTANTS + 16 * EXPRESSION_MAX_CONSTANTS;
+    struct jit_buffer buffer = { malloc(size), 0 };
+    size_t loop_start;
+    size_t skip_loop;
+    size_t skip_tail;
+    size_t copy_start;
+    uint64_t table_address;
+    int k;
+
+    if (!buffer.bytes)
+    return -1;
+    void * memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        free(buffer.bytes);
+        return -1;
+    }
+    table_address = (uint64_t) memory + table_offset;
+
+    /* Broadcasting x_scale and x_shift, and loading the indices and their step from the table.*/
+    emit_sse (&buffer, SSE_MOVAPS, JIT_SCALE_REG, 0);
+    emit_sse (&buffer, SSE_SHUFPS, JIT_SCALE_REG, JIT_SCALE_REG);
+    buffer.bytes[buffer.length++] = 0;
+    emit_sse (&buffer, SSE_MOVAPS, JIT_SHIFT_REG, 1);
+    emit_sse (&buffer, SSE_SHUFPS, JIT_SHIFT_REG, JIT_SHIFT_REG);
+    buffer.bytes[buffer.length++] = 0;
+    emit_bytes (&buffer, (const unsigned char[]) { 0x48, 0xB8 }, 2);          /* mov rax, table */
+    emit_bytes (&buffer, (const unsigned char *) &table_address, 8);
+    emit_sse_table (&buffer, SSE_MOVUPS_LOAD, JIT_INDEX_REG, JIT_INDEX);
+    emit_sse_table (&buffer, SSE_MOVUPS_LOAD, JIT_STEP_REG, JIT_STEP);
+    emit_bytes (&buffer, (const unsigned char[]) { 0x48, 0x89, 0xF1,          /* mov rcx, rsi */
+                                                   0x48, 0x83, 0xE1, 0x03,    /* and rcx, 3 */
+                                                   0x48, 0xC1, 0xEE, 0x02,    /* shr rsi, 2 */
+                                                   0x48, 0x85, 0xF6,          /* test rsi, rsi */
+                                                   0x0F, 0x84, 0, 0, 0, 0 }, 20); /* jz tail */
+    skip_loop = buffer.length;
+
+    /* Main loop, 4 samples per iteration.*/
+    loop_start = buffer.length;
+    emit_expression (&buffer, expr);
+    emit_bytes (&buffer, (const unsigned char[]) { 0x0F, 0x11, 0x07,          /* movups [rdi], xmm0 */
+                                                   0x48, 0x83, 0xC7, 0x10 }, 7); /* add rdi, 16 */
+    emit_sse (&buffer, SSE_PADDD, JIT_INDEX_REG, JIT_STEP_REG);
+    emit_bytes (&buffer, (const unsigned char[]) { 0x48, 0xFF, 0xCE,          /* dec rsi */
+                                                   0x0F, 0x85, 0, 0, 0, 0 }, 9); /* jnz loop */
+    patch_jump (&buffer, buffer.length, loop_start);
+
+    /* Tail: one more vector into the red zone, then copying the 1 to 3 samples that are kept.*/
+    patch_jump (&buffer, skip_loop, buffer.length);
+    emit_bytes (&buffer, (const unsigned char[]) { 0x48, 0x85, 0xC9,          /* test rcx, rcx */
+                                                   0x0F, 0x84, 0, 0, 0, 0 }, 9); /* jz done */
+    skip_tail = buffer.length;
+    emit_expression (&buffer, expr);
+    emit_bytes (&buffer, (const unsigned char[]) { 0x0F, 0x11, 0x44, 0x24, 0xF0, /* movups [rsp-16], xmm0 */
+                                                   0x4C, 0x8D, 0x44, 0x24, 0xF0 }, 10); /* lea r8, [rsp-16] */
+    copy_start = buffer.length;
+    emit_bytes (&buffer, (const unsigned char[]) { 0x41, 0x8B, 0x10,          /* mov edx, [r8] */
+                                                   0x89, 0x17,                /* mov [rdi], edx */
+                                                   0x49, 0x83, 0xC0, 0x04,    /* add r8, 4 */
+                                                   0x48, 0x83, 0xC7, 0x04,    /* add rdi, 4 */
+                                                   0x48, 0xFF, 0xC9,          /* dec rcx */
+                                                   0x0F, 0x85, 0, 0, 0, 0 }, 22); /* jnz copy */
+    patch_jump (&buffer, buffer.length, copy_start);
+    patch_jump (&buffer, skip_tail, buffer.length);
+    buffer.bytes[buffer.length++] = 0xC3;                                     /* ret */
+
+    /* The table: first indices, their step, sign and abs masks, 1.0, then each constant 4 times.*/
+    unsigned char * table = buffer.bytes + table_offset;
+    for (k = 0; k < 4; k++)
+    {
+        int32_t index = k;
+        int32_t step = 4;
+        uint32_t sign = 0x80000000u;
+        uint32_t magnitude = 0x7FFFFFFFu;
+        float one = 1.0f;
+        memcpy(table + JIT_INDEX + 4 * k, &index, 4);
+        memcpy(table + JIT_STEP + 4 * k, &step, 4);
+        memcpy(table + JIT_SIGN + 4 * k, &sign, 4);
+        memcpy(table + JIT_ABS + 4 * k, &magnitude, 4);
+        memcpy(table + JIT_ONE + 4 * k, &one, 4);
+    }
+    for (k = 0; k < 4 * expr->constant_count; k++)
+    memcpy(table + JIT_CONSTANTS + 4 * k, &expr->constants[k / 4], 4);
+
+    /* Copying into the mapping and making it executable instead of writable.*/
+    memcpy(memory, buffer.bytes, buffer.length);
+    memcpy((unsigned char *) memory + table_offset, table, size - table_offset);
+    free(buffer.bytes);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, size);
+        return -1;
+    }
+    jit->memory = memory;
+    jit->size = size;
+    jit->fill = (fill_function) memory;
+    return 0;
+#else
+    (void) expr;
+    return -1;
+#endif
+} //expression_jit
+
+void
+expression_fill_jit (const struct expression * expr, const struct jit_function * jit,
+                     float values[], size_t len, float x_scale, float x_shift)
+{
+    if (jit->fill)
+    {
+        jit->fill (values, len, x_scale, x_shift);
+        COUNT(evaluations, len);
+    }
+    else
+    expression_fill (expr, values, len, x_scale, x_shift);
+} //expression_fill_jit
+
+void
+jit_release (struct jit_function * jit)
+{
+#ifdef HAVE_JIT
+    if (jit->memory)
+    munmap(jit->memory, jit->size);
+#endif
+    jit->fill = NULL;
+    jit->memory = NULL;
+    jit->size = 0;
+} //jit_release
+
+/* Returns the ring buffer slot of an absolute index. */
+static int
+viewport_slot (const struct viewport * view, long index)
+{
+    long slot = index % view->len;
+    return (int) (slot < 0 ? slot + view->len : slot);
+} //viewport_slot
+
+/* Evaluates the sample of an absolute index into its slot and updates the trees above it. */
+static void
+viewport_sample (struct viewport * view, long index)
+{
+    int slot = viewport_slot(view, index);
+    int node = view->tree_size + slot;
+    view->samples[slot] = evaluate_function(&view->function, get_x(index, view->x_scale, view->x_shift));
+    view->evaluations++;
+    COUNT(evaluations, 1);
+    view->tree_max[node] = view->samples[slot];
+    view->tree_min[node] = view->samples[slot];
+    for (node /= 2; node >= 1; node /= 2)
+    {
+        view->tree_max[node] = fmaxf(view->tree_max[2 * node], view->tree_max[2 * node + 1]);
+        view->tree_min[node] = fminf(view->tree_min[2 * node], view->tree_min[2 * node + 1]);
+    }
+} //viewport_sample
+
+int
+viewport_init (struct viewport * view, const struct function_spec * function, char symbol, int len, int height,
+               float x_scale, float x_shift)
+{
+    int k;
+    view->function = *function;
+    view->symbol = symbol;
+    view->x_scale = x_scale;
+    view->x_shift = x_shift;
+    view->first = 0;
+    view->len = len;
+    view->height = height;
+    view->rendered = 0;
+    view->evaluations = 0;
+    for (view->tree_size = 1; view->tree_size < len; view->tree_size *= 2)
+    ;
+    view->samples = malloc(len * sizeof(float));
+    view->tree_max = malloc(2 * view->tree_size * sizeof(float));
+    view->tree_min = malloc(2 * view->tree_size * sizeof(float));
+    view->scaled = malloc(len * sizeof(int));
+    view->frame = malloc((size_t) height * (len + 1));
+    view->shown = malloc((size_t) height * (len + 1));
+    view->output = malloc((size_t) height * (len + 1 + 16)); /* Each row may need a cursor move.*/
+    if (!view->samples || !view->tree_max || !view->tree_min || !view->scaled
+        || !view->frame || !view->shown || !view->output)
+    {
+        viewport_free (view);
+        return -1;
+    }
+    /* Empty leaves never win a max or min.*/
+    for (k = 0; k < 2 * view->tree_size; k++)
+    {
+        view->tree_max[k] = -INFINITY;
+        view->tree_min[k] = INFINITY;
+    }
+    for (k = 0; k < len; k++)
+    viewport_sample (view, k);
+    return 0;
+} //viewport_init
+
+void
+viewport_pan (struct viewport * view, long columns)
+{
+    long index;
+    long count = labs(columns) < view->len ? labs(columns) : view->len;
+    view->first += columns;
+    /* Only the columns that came into view, at the right end when panning right, at the left otherwise.*/
+    for (index = 0; index < count; index++)
+    viewport_sample (view, columns > 0 ? view->first + view->len - 1 - index : view->first + index);
+} //viewport_pan
+
+void
+viewport_range (const struct viewport * view, float * p_max, float * p_min)
+{
+    *p_max = view->tree_max[1];
+    *p_min = view->tree_min[1];
+} //viewport_range
+
+int
+viewport_render (struct viewport * view, FILE * out)
+{
+    int row_length = view->len + 1;
+    size_t used = 0;
+    int rows_written = 0;
+    float max;
+    float min;
+    int c;
+    int j;
+
+    viewport_range (view, &max, &min);
+    for (c = 0; c < view->len; c++)
+    view->scaled[c] = quantize(view->samples[viewport_slot(view, view->first + c)], view->height, min, max);
+    fill_frame (view->scaled, view->symbol, view->len, view->height, view->frame);
+
+    for (j = 0; j < view->height; j++)
+    {
+        /* Moving the cursor to each changed row and writing it.*/
+        const char * row = view->frame + j * row_length;
+        if (view->rendered && memcmp(row, view->shown + j * row_length, view->len) == 0)
+        continue;
+        used += sprintf(view->output + used, "\x1b[%d;1H", j + 1);
+        memcpy(view->output + used, row, view->len);
+        used += view->len;
+        rows_written++;
+    }
+    fwrite (view->output, 1, used, out);
+    COUNT(bytes_written, used);
+    memcpy(view->shown, view->frame, (size_t) view->height * row_length);
+    view->rendered = 1;
+    return rows_written;
+} //viewport_render
+
+void
+viewport_free (struct viewport * view)
+{
+    free(view->samples);
+    free(view->tree_max);
+    free(view->tree_min);
+    free(view->scaled);
+    free(view->frame);
+    free(view->shown);
+    free(view->output);
+    view->samples = NULL;
+    view->tree_max = NULL;
+    view->tree_min = NULL;
+    view->scaled = NULL;
+    view->frame = NULL;
+    view->shown = NULL;
+    view->output = NULL;
+} //viewport_free
+
+/* Settles the interval between sampled columns a and b, evaluating its middle and halving it if needed. */
+static size_t
+adaptive_refine (const struct function_spec * function, float values[], size_t a, size_t b,
+                 float x_scale, float x_shift, float step)
+{
+    size_t middle = a + (b - a) / 2;
+    size_t i;
+    if (b - a < 2)
+    return 0;
+    values[middle] = evaluate_function(function, get_x(middle, x_scale, x_shift));
+    float line = values[a] + (values[b] - values[a]) * (middle - a) / (b - a);
+    if (fabsf(values[middle] - line) <= step / 2 && fabsf(values[b] - values[a]) <= step)
+    {
+        /* Straight enough: filling the rest of the interval from the line.*/
+        for (i = a + 1; i < b; i++)
+        {
+            if (i != middle)
+            values[i] = values[a] + (values[b] - values[a]) * (i - a) / (b - a);
+        }
+        return 1;
+    }
+    return 1 + adaptive_refine (function, values, a, middle, x_scale, x_shift, step)
+             + adaptive_refine (function, values, middle, b, x_scale, x_shift, step);
+} //adaptive_refine
+
+size_t
+adaptive_fill (const struct function_spec * function, float values[], size_t len,
+               float x_scale, float x_shift, size_t height)
+{
+    size_t evaluations = 1;
+    size_t i;
+    values[0] = evaluate_function(function, get_x(0, x_scale, x_shift));
+    float max = values[0]; /* Initializing with the first sample.*/
+    float min = max;
+
+    /* Coarse pass, always including the last column.*/
+    for (i = ADAPTIVE_STRIDE; i < len; i += ADAPTIVE_STRIDE)
+    {
+        values[i] = evaluate_function(function, get_x(i, x_scale, x_shift));
+        evaluations++;
+        max = (values[i] > max) ? values[i] : max;
+        min = (values[i] < min) ? values[i] : min;
+    }
+    if ((len - 1) % ADAPTIVE_STRIDE != 0)
+    {
+        values[len - 1] = evaluate_function(function, get_x(len - 1, x_scale, x_shift));
+        evaluations++;
+        max = (values[len - 1] > max) ? values[len - 1] : max;
+        min = (values[len - 1] < min) ? values[len - 1] : min;
+    }
+
+    /* Refining every coarse interval against the level size of the coarse range.*/
+    float step = (max - min) / height;
+    for (i = 0; i + 1 < len; i += ADAPTIVE_STRIDE)
+    {
+        size_t end = (i + ADAPTIVE_STRIDE < len) ? i + ADAPTIVE_STRIDE : len - 1;
+        evaluations += adaptive_refine (function, values, i, end, x_scale, x_shift, step);
+    }
+    COUNT(evaluations, evaluations);
+    return evaluations;
+} //adaptive_fill
+
+int
+envelope_init (struct envelope * env, size_t columns, size_t total)
+{
+    size_t c;
+    env->max = malloc(columns * sizeof(float));
+    env->min = malloc(columns * sizeof(float));
+    env->columns = columns;
+    env->total = total;
+    env->seen = 0;
+    env->column = 0;
+    env->column_end = (total + columns - 1) / columns;
+    if (!env->max || !env->min)
+    {
+        envelope_free (env);
+        return -1;
+    }
+    /* An empty column has its min above its max.*/
+    for (c = 0; c < columns; c++)
+    {
+        env->max[c] = -INFINITY;
+        env->min[c] = INFINITY;
+    }
+    return 0;
+} //envelope_init
+
+void
+envelope_add (struct envelope * env, const float samples[], size_t count)
+{
+    size_t k = 0;
+    while (k < count)
+    {
+        /* Moving on to the column the next sample belongs to.*/
+        while (env->seen >= env->column_end)
+        {
+            env->column++;
+            env->column_end = ((env->column + 1) * env->total + env->columns - 1) / env->columns;
+        }
+        size_t run = env->column_end - env->seen;
+        float max = env->max[env->column];
+        float min = env->min[env->column];
+        if (run > count - k)
+        run = count - k;
+        for (size_t end = k + run; k < end; k++)
+        {
+            if (samples[k] > max)
+            max = samples[k];
+            if (samples[k] < min)
+            min = samples[k];
+        }
+        env->max[env->column] = max;
+        env->min[env->column] = min;
+        env->seen += run;
+    }
+} //envelope_add
 
-    /* Testing negative min and positive max.*/
-    TEST(3, quantize(10, 4, -20, 20));
-    TEST(1, quantize(-4, 4, -20, 20));
-    TEST(3, quantize(20, 4, -20, 20)); //max
-    TEST(0, quantize(-20, 4, -20, 20)); //min
+void
+fill_span_frame (const int lows[], const int highs[], char symbol, int len, int height, char frame[])
+{
+    int row_length = len + 1;
+    int i;
+    int j;
+    for (j = 0; j < height; j++)
+    {
+        memset(frame + j * row_length, ' ', len);
+        frame[j * row_length + len] = '\n';
+    }
+    for (i = 0; i < len; i++)
+    {
+        /* Filling the column from its low level up to its high level, clipped to the screen.*/
+        int low = (lows[i] > 0) ? lows[i] : 0;
+        int high = (highs[i] < height) ? highs[i] : height - 1;
+        if (lows[i] < 0 && highs[i] < 0)
+        continue;
+        for (j = low; j <= high; j++)
+        frame[(height - 1 - j) * row_length + i] = symbol;
+    }
+} //fill_span_frame
 
-    reportTests (numErrors);
-    return numErrors;
-} //testQuantize
+void
+plot_envelope (const struct envelope * env, FILE * out, char symbol, int height,
+               int lows[], int highs[], char frame[])
+{
+    float max = -INFINITY;
+    float min = INFINITY;
+    size_t c;
+    for (c = 0; c < env->columns; c++)
+    {
+        if (env->max[c] > max)
+        max = env->max[c];
+        if (env->min[c] < min)
+        min = env->min[c];
+    }
+    for (c = 0; c < env->columns; c++)
+    {
+        /* Quantizing both ends of each non-empty column.*/
+        if (env->min[c] > env->max[c])
+        {
+            lows[c] = -1;
+            highs[c] = -1;
+            continue;
+        }
+        lows[c] = quantize(env->min[c], height, min, max);
+        highs[c] = quantize(env->max[c], height, min, max);
+    }
+    fill_span_frame (lows, highs, symbol, env->columns, height, frame);
+    fwrite (frame, 1, (size_t) height * (env->columns + 1), out);
+    COUNT(bytes_written, (size_t) height * (env->columns + 1));
+} //plot_envelope
 
-/* Tests for scale(). */
-int 
-testScale (void)
+void
+envelope_free (struct envelope * env)
 {
-    int numErrors = 0;
-    printf("--QUANTIZE SCALE--");
+    free(env->max);
+    free(env->min);
+    env->max = NULL;
+    env->min = NULL;
+} //envelope_free
 
-    /* Testing positive max and zero min.*/
-    float data_1[5] = {0,2,4,6,10};
-    int scaled_1[5] = {0, 0, 0, 0, 0};
-    scale(data_1, scaled_1, 5, 2, 0, 10);
-    int expected_array_1[5] = {0, 0, 0, 1, 1};
-     for (int i = 0; i < 5; i++)
+size_t
+stream_read (FILE * in, enum stream_format format, float chunk[], size_t capacity, int * p_bad)
+{
+    size_t count = 0;
+    int matched = 1;
+    *p_bad = 0;
+    if (format == STREAM_BINARY)
+    return fread(chunk, sizeof(float), capacity, in);
+    while (count < capacity && (matched = fscanf(in, "%f", &chunk[count])) == 1)
+    count++;
+    *p_bad = (matched == 0); /* EOF at the end, 0 at text fscanf could not take as a float.*/
+    return count;
+} //stream_read
+
+int
+stream_plot (FILE * in, enum stream_format format, FILE * out, char symbol, int len, int height,
+             float chunk[], int scaled[], char frame[], size_t * p_bad_sample)
+{
+    int frames = 0;
+    int shared_range = 0;
+    int bad = 0;
+    long start = ftell(in);
+    size_t count;
+    size_t samples = 0;
+    float max = 0;
+    float min = 0;
+
+    /* First pass over a stream that can seek, for the range of all of it.*/
+    if (start >= 0 && fseek(in, start, SEEK_SET) == 0)
     {
-        TEST(expected_array_1[i], scaled_1[i]);
+        while ((count = stream_read (in, format, chunk, len, &bad)) > 0 || bad)
+        {
+            samples += count;
+            if (bad)
+            {
+                *p_bad_sample = samples;
+                return -1;
+            }
+            float chunk_max;
+            float chunk_min;
+            range (chunk, count, &chunk_max, &chunk_min);
+            max = (!shared_range || chunk_max > max) ? chunk_max : max;
+            min = (!shared_range || chunk_min < min) ? chunk_min : min;
+            shared_range = 1;
+        }
+        clearerr(in);
+        if (fseek(in, start, SEEK_SET) != 0)
+        shared_range = 0;
     }
 
-    /* Testing zero max and negative min. */
-    float data_2[5] = {0,-2,-4,-6,-10};
-    int scaled_2[5] = {0, 0, 0, 0, 0};
-    scale(data_2, scaled_2, 5, 5, -10, 0);
-    int expected_array_2[5] = {4, 4, 3, 2, 0};
-    for (int i = 0; i < 5; i++)
+    /* Drawing each chunk as a frame, scaled to the whole stream or to the chunk.*/
+    samples = 0;
+    while ((count = stream_read (in, format, chunk, len, &bad)) > 0 || bad)
     {
-        TEST(expected_array_2[i], scaled_2[i]);
+        samples += count;
+        if (bad)
+        {
+            *p_bad_sample = samples;
+            return -1;
+        }
+        if (!shared_range)
+        range (chunk, count, &max, &min);
+        scale (chunk, scaled, count, height, min, max);
+        fill_frame (scaled, symbol, count, height, frame);
+        fwrite (frame, 1, (size_t) height * (count + 1), out);
+        COUNT(bytes_written, (size_t) height * (count + 1));
+        frames++;
     }
+    return frames;
+} //stream_plot
 
-    /* Testing positive max and negative min.*/
-    float data_3[7] = {0,2,4,-6,-10, 0, -8};
-    int scaled_3[7] = {0, 0, 0, 0, 0, 0, 0};
-    scale(data_3, scaled_3, 7, 10, -10, 10);
-    int expected_array_3[5] = {5, 6, 7, 2, 0};
-    for (int i = 0; i < 5; i++)
+int
+table_export (const char * path, const struct function_spec * function, size_t len, float x_scale, float x_shift)
+{
+    struct table_header header = { TABLE_MAGIC, TABLE_VERSION, function->kind, x_scale, x_shift, len, 0, 0, 0, 0 };
+    size_t coeff_count = (function->kind == FUNCTION_POLYNOMIAL) ? function->degree + 1 : 0;
+    size_t header_size = sizeof(header) + coeff_count * sizeof(float);
+    char padding[TABLE_ALIGNMENT] = { 0 };
+    float block[PIPELINE_BLOCK];
+    size_t begin;
+    size_t count;
+    size_t k;
+    int failed = 0;
+    FILE * out = fopen(path, "wb");
+    if (!out)
+    return -1;
+
+    header.degree = function->degree;
+    header.payload_offset = (header_size + TABLE_ALIGNMENT - 1) / TABLE_ALIGNMENT * TABLE_ALIGNMENT;
+
+    /* Header with a placeholder range, coefficients and padding, then the samples a block at a time.*/
+    failed |= fwrite(&header, sizeof(header), 1, out) != 1;
+    if (coeff_count) /* Cosine has no coefficients to write, and may have no array.*/
+    failed |= fwrite(function->coeffs, sizeof(float), coeff_count, out) != coeff_count;
+    failed |= fwrite(padding, 1, header.payload_offset - header_size, out) != header.payload_offset - header_size;
+    for (begin = 0; begin < len && !failed; begin += count)
     {
-        TEST(expected_array_3[i], scaled_3[i]);
+        count = (len - begin < PIPELINE_BLOCK) ? len - begin : PIPELINE_BLOCK;
+        evaluate_block (function, block, begin, count, x_scale, x_shift);
+        if (begin == 0)
+        {
+            header.max = block[0]; /* Initializing with the first sample.*/
+            header.min = header.max;
+        }
+        for (k = 0; k < count; k++)
+        {
+            if (block[k] > header.max)
+            header.max = block[k];
+            if (block[k] < header.min)
+            header.min = block[k];
+        }
+        failed |= fwrite(block, sizeof(float), count, out) != count;
     }
 
-    reportTests (numErrors);
-    return numErrors;
-} //testScale
+    /* Rewriting the header now the range is known.*/
+    if (!failed)
+    failed |= fseek(out, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, out) != 1;
+    if (failed || ferror(out))
+    {
+        fclose(out);
+        return -1;
+    }
+    return (fclose(out) == 0) ? 0 : -1;
+} //table_export
+
+int
+table_map (const char * path, struct sample_table * table)
+{
+    struct stat status;
+    const struct table_header * header;
+    int descriptor = open(path, O_RDONLY);
+    table->header = NULL;
+    table->coeffs = NULL;
+    table->values = NULL;
+    table->mapping = NULL;
+    table->size = 0;
+    if (descriptor < 0)
+    return -1;
+    if (fstat(descriptor, &status) != 0 || (size_t) status.st_size < sizeof(struct table_header))
+    {
+        close(descriptor);
+        return -1;
+    }
+    void * mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor); /* The mapping keeps the file open.*/
+    if (mapping == MAP_FAILED)
+    return -1;
+
+    /* Checking the header before trusting its offsets, in a way no field can overflow.*/
+    header = mapping;
+    uint64_t size = status.st_size;
+    uint64_t coeff_count = (header->function_kind == FUNCTION_POLYNOMIAL) ? (uint64_t) header->degree + 1 : 0;
+    if (memcmp(header->magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0 || header->version != TABLE_VERSION
+        || header->payload_offset % TABLE_ALIGNMENT != 0
+        || header->payload_offset > size
+        || header->len > (size - header->payload_offset) / sizeof(float)
+        || sizeof(*header) + coeff_count * sizeof(float) > header->payload_offset)
+    {
+        munmap(mapping, status.st_size);
+        return -1;
+    }
+    table->header = header;
+    table->coeffs = (const float *) (header + 1);
+    table->values = (const float *) ((const char *) mapping + header->payload_offset);
+    table->mapping = mapping;
+    table->size = status.st_size;
+    return 0;
+} //table_map
 
-/* Tests for plot(). */
 void
-testPlot (void)
+table_unmap (struct sample_table * table)
 {
-    printf("Testing the plot function:\n");
+    if (table->mapping)
+    munmap(table->mapping, table->size);
+    table->header = NULL;
+    table->coeffs = NULL;
+    table->values = NULL;
+    table->mapping = NULL;
+    table->size = 0;
+} //table_unmap
 
-    /* Testing example 1.*/
-    int SCREEN_HEIGHT_1 = 3;
-    int SCREEN_WIDTH_1 = 6;
-    
-    float values_1[SCREEN_WIDTH_1];
+int
+plot_table (const struct sample_table * table, FILE * out, char symbol, int height, int scaled[], char frame[])
+{
+    if (table->header->len > INT_MAX)
+    return -1;
+    int len = (int) table->header->len;
+    /* No range(): the max and min were stored when the table was written.*/
+    scale (table->values, scaled, len, height, table->header->min, table->header->max);
+    fill_frame (scaled, symbol, len, height, frame);
+    fwrite (frame, 1, (size_t) height * (len + 1), out);
+    COUNT(bytes_written, (size_t) height * (len + 1));
+    return 0;
+} //plot_table
 
-    cosine (values_1, SCREEN_WIDTH_1, M_PI, 0.0);
-    printf("Alternating points between maximum and minum of the function.\n");
-    plot (values_1, '*', SCREEN_WIDTH_1, SCREEN_HEIGHT_1);
+/* The degree of a function as the cache keys it, 0 for a cosine. */
+static size_t
+cache_degree (const struct function_spec * function)
+{
+    return (function->kind == FUNCTION_POLYNOMIAL) ? function->degree : 0;
+} //cache_degree
 
-    /* Testing example 2.*/
-    int SCREEN_HEIGHT_2 = 5;
-    int SCREEN_WIDTH_2 = 10;
-    
-    float values_2[SCREEN_WIDTH_2];
-    float cubic_1[] = {0,1,2,1};  
-    polynomial(cubic_1, 3, values_2, SCREEN_WIDTH_2, 1, 20);
-    printf("Diagonal line from top right to bottom left with atleast one symbol across the line.\n");
-    plot (values_2, '*', SCREEN_WIDTH_2, SCREEN_HEIGHT_2);
+/* Hashes a cache key with FNV-1a. */
+static uint64_t
+cache_hash (const struct function_spec * function, size_t len, float x_scale, float x_shift, int height, char symbol)
+{
+    uint64_t hash = 14695981039346656037u;
+    size_t degree = cache_degree(function);
+    const unsigned char * parts[7] = { (const void *) &function->kind, (const void *) &degree,
+                                       (const void *) &x_scale, (const void *) &x_shift, (const void *) &len,
+                                       (const void *) &height, (const void *) &symbol };
+    size_t sizes[7] = { sizeof(function->kind), sizeof(degree), sizeof(x_scale), sizeof(x_shift),
+                        sizeof(len), sizeof(height), sizeof(symbol) };
+    size_t coeff_bytes = (function->kind == FUNCTION_POLYNOMIAL) ? (function->degree + 1) * sizeof(float) : 0;
+    size_t p;
+    size_t k;
+    for (p = 0; p < 7; p++)
+    {
+        for (k = 0; k < sizes[p]; k++)
+        hash = (hash ^ parts[p][k]) * 1099511628211u;
+    }
+    for (k = 0; k < coeff_bytes; k++)
+    hash = (hash ^ ((const unsigned char *) function->coeffs)[k]) * 1099511628211u;
+    return hash;
+} //cache_hash
 
-    /* Testing example 3.*/
-    int SCREEN_HEIGHT_3 = 4;
-    int SCREEN_WIDTH_3 = 8;
-    
-    float values_3[SCREEN_WIDTH_3];
-    float square_1[] = {0,1,2};  
-    polynomial(square_1, 3, values_3, SCREEN_WIDTH_3, 0.5, 5);
-    printf("Diagonal line from top left to bottom right with atleast one symbol across the line.\n");
-    plot (values_3, '*', SCREEN_WIDTH_3, SCREEN_HEIGHT_3);
+/* Takes an entry out of the least recently used list. */
+static void
+cache_unlink (struct sample_cache * cache, struct cache_entry * entry)
+{
+    if (entry->newer)
+    entry->newer->older = entry->older;
+    else
+    cache->newest = entry->older;
+    if (entry->older)
+    entry->older->newer = entry->newer;
+    else
+    cache->oldest = entry->newer;
+} //cache_unlink
+
+/* Puts an entry at the most recently used end of the list. */
+static void
+cache_push (struct sample_cache * cache, struct cache_entry * entry)
+{
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest)
+    cache->newest->newer = entry;
+    else
+    cache->oldest = entry;
+    cache->newest = entry;
+} //cache_push
+
+/* Removes the least recently used entry from its bucket and the list, and frees it. */
+static void
+cache_evict (struct sample_cache * cache)
+{
+    struct cache_entry * entry = cache->oldest;
+    struct cache_entry ** link = &cache->buckets[entry->hash % CACHE_BUCKETS];
+    while (*link != entry)
+    link = &(*link)->chain;
+    *link = entry->chain;
+    cache_unlink (cache, entry);
+    cache->used -= entry->bytes;
+    free(entry);
+} //cache_evict
+
+void
+cache_init (struct sample_cache * cache, size_t budget)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->budget = budget;
+} //cache_init
+
+const struct cache_entry *
+cache_get (struct sample_cache * cache, const struct function_spec * function, size_t len,
+           float x_scale, float x_shift, int height, char symbol)
+{
+    uint64_t hash = cache_hash(function, len, x_scale, x_shift, height, symbol);
+    size_t coeff_count = (function->kind == FUNCTION_POLYNOMIAL) ? function->degree + 1 : 0;
+    struct cache_entry * entry;
+
+    /* Looking for the key in its bucket, comparing floats bit for bit.*/
+    for (entry = cache->buckets[hash % CACHE_BUCKETS]; entry; entry = entry->chain)
+    {
+        if (entry->hash == hash && entry->kind == function->kind && entry->degree == cache_degree(function)
+            && memcmp(&entry->x_scale, &x_scale, sizeof(float)) == 0
+            && memcmp(&entry->x_shift, &x_shift, sizeof(float)) == 0
+            && entry->len == len && entry->height == height && entry->symbol == symbol
+            && (coeff_count == 0 || memcmp(entry->coeffs, function->coeffs, coeff_count * sizeof(float)) == 0))
+        {
+            cache->hits++;
+            cache_unlink (cache, entry);
+            cache_push (cache, entry);
+            return entry;
+        }
+    }
+    cache->misses++;
+
+    /* One allocation for the entry, its coefficients, samples, levels and frame.*/
+    size_t frame_bytes = (size_t) height * (len + 1);
+    size_t bytes = sizeof(struct cache_entry) + coeff_count * sizeof(float) + len * sizeof(float)
+                   + len * sizeof(int) + frame_bytes;
+    if (bytes > cache->budget)
+    return NULL;
+    while (cache->used + bytes > cache->budget)
+    {
+        cache_evict (cache);
+        cache->evictions++;
+    }
+    entry = malloc(bytes);
+    if (!entry)
+    return NULL;
+    entry->kind = function->kind;
+    entry->degree = cache_degree(function);
+    entry->coeffs = (float *) (entry + 1);
+    entry->values = entry->coeffs + coeff_count;
+    entry->levels = (int *) (entry->values + len);
+    entry->frame = (char *) (entry->levels + len);
+    entry->x_scale = x_scale;
+    entry->x_shift = x_shift;
+    entry->len = len;
+    entry->height = height;
+    entry->symbol = symbol;
+    entry->bytes = bytes;
+    entry->hash = hash;
+    if (coeff_count)
+    memcpy(entry->coeffs, function->coeffs, coeff_count * sizeof(float));
+
+    /* Rendering it once.*/
+    evaluate_block (function, entry->values, 0, len, x_scale, x_shift);
+    range (entry->values, len, &entry->max, &entry->min);
+    scale (entry->values, entry->levels, len, height, entry->min, entry->max);
+    fill_frame (entry->levels, symbol, len, height, entry->frame);
+
+    entry->chain = cache->buckets[hash % CACHE_BUCKETS];
+    cache->buckets[hash % CACHE_BUCKETS] = entry;
+    cache_push (cache, entry);
+    cache->used += bytes;
+    return entry;
+} //cache_get
+
+void
+cache_free (struct sample_cache * cache)
+{
+    while (cache->oldest)
+    cache_evict (cache);
+} //cache_free
+
+/* cos(2*pi*k/COSINE_TABLE_SIZE) for k in 0..COSINE_TABLE_SIZE, the last entry repeating the first. */
+static float cosine_table[COSINE_TABLE_SIZE + 1];
+static pthread_once_t cosine_table_once = PTHREAD_ONCE_INIT;
+
+static void
+cosine_table_init (void)
+{
+    int k;
+    for (k = 0; k <= COSINE_TABLE_SIZE; k++)
+    cosine_table[k] = cos(2 * M_PI * k / COSINE_TABLE_SIZE);
+} //cosine_table_init
+
+/* Looks cos(x) up in the table, interpolating linearly; the reduction is in double so any float x is fine. */
+static float
+cosine_lookup (float x)
+{
+    double t = x * (COSINE_TABLE_SIZE / (2 * M_PI));
+    double whole = floor(t);
+    float fraction = (float) (t - whole);
+    int k = (int) ((int64_t) whole & (COSINE_TABLE_SIZE - 1));
+    return cosine_table[k] + fraction * (cosine_table[k + 1] - cosine_table[k]);
+} //cosine_lookup
+
+double
+cosine_tier_bound (enum cosine_tier tier)
+{
+    double step = 2 * M_PI / COSINE_TABLE_SIZE;
+    switch (tier)
+    {
+        case COSINE_TABLE:
+        return step * step / 8 + 4 * FLT_EPSILON;
+        case COSINE_MINIMAX:
+        return 1e-7;
+        default:
+        return FLT_EPSILON / 2;
+    }
+} //cosine_tier_bound
+
+double
+cosine_tier_measure (enum cosine_tier tier, size_t samples)
+{
+    float values[EXPRESSION_BATCH];
+    /* Starting off the grid, so the samples fall at every phase of the table.*/
+    float x_scale = 2.0 * COSINE_APPROX_LIMIT / samples;
+    double worst = 0;
+    size_t begin;
+    size_t i;
+    for (begin = 0; begin < samples; begin += EXPRESSION_BATCH)
+    {
+        size_t count = (samples - begin < EXPRESSION_BATCH) ? samples - begin : EXPRESSION_BATCH;
+        float x_shift = COSINE_APPROX_LIMIT - begin * x_scale - 0.318f * x_scale;
+        cosine_tiered (values, count, x_scale, x_shift, tier);
+        for (i = 0; i < count; i++)
+        {
+            double error = fabs(values[i] - cos((double) get_x(i, x_scale, x_shift)));
+            if (error > worst)
+            worst = error;
+        }
+    }
+    return worst;
+} //cosine_tier_measure
+
+void
+cosine_tiered (float values[], size_t len, float x_scale, float x_shift, enum cosine_tier tier)
+{
+    size_t i;
+    switch (tier)
+    {
+        case COSINE_TABLE:
+        pthread_once (&cosine_table_once, cosine_table_init);
+        for (i = 0; i < len; i++)
+        values[i] = cosine_lookup(get_x(i, x_scale, x_shift));
+        COUNT(evaluations, len);
+        break;
+        case COSINE_MINIMAX:
+        cosine_batch (values, len, x_scale, x_shift);
+        break;
+        default:
+        cosine (values, len, x_scale, x_shift);
+    }
+} //cosine_tiered
+
+enum cosine_tier
+cosine_tier_choose (int height, float span, float x_limit)
+{
+    double level = (double) span / height;
+    if (2 * cosine_tier_bound(COSINE_TABLE) < level)
+    return COSINE_TABLE;
+    if (2 * cosine_tier_bound(COSINE_MINIMAX) < level && fabsf(x_limit) <= COSINE_APPROX_LIMIT)
+    return COSINE_MINIMAX;
+    return COSINE_LIBM;
+} //cosine_tier_choose
+
+enum cosine_tier
+cosine_for_height (float values[], size_t len, float x_scale, float x_shift, int height)
+{
+    struct function_spec function = { FUNCTION_COSINE, NULL, 0 };
+    float max;
+    float min;
+    float first;
+    float last;
+    double prefix;
+    enum cosine_tier tier;
+    if (len == 0)
+    return COSINE_TABLE;
+    first = fabsf(get_x(0, x_scale, x_shift));
+    last = fabsf(get_x(len - 1, x_scale, x_shift));
+
+    /* The span of the samples, or a lower bound on it from some of them, so the level it gives is never too big.*/
+    if (range_oracle(&function, len, x_scale, x_shift, &max, &min) < 0)
+    {
+        prefix = (x_scale != 0) ? 8 * M_PI / fabsf(x_scale) + 2 : len;
+        if (!(prefix < len) || range_oracle(&function, (size_t) prefix, x_scale, x_shift, &max, &min) < 0)
+        {
+            float ends[2];
+            ends[0] = evaluate_function(&function, get_x(0, x_scale, x_shift));
+            ends[1] = evaluate_function(&function, get_x(len - 1, x_scale, x_shift));
+            COUNT(evaluations, 2);
+            range (ends, 2, &max, &min);
+        }
+    }
+    tier = cosine_tier_choose(height, max - min, (first > last) ? first : last);
+    cosine_tiered (values, len, x_scale, x_shift, tier);
+    return tier;
+} //cosine_for_height
+
+void
+range_series (const struct series series[], size_t count, size_t len, float * p_max, float * p_min)
+{
+    float max = series[0].values[0];
+    float min = series[0].values[0];
+    size_t s;
+    size_t i;
+    for (s = 0; s < count; s++)
+    {
+        for (i = 0; i < len; i++)
+        {
+            if (series[s].values[i] > max)
+            max = series[s].values[i];
+            if (series[s].values[i] < min)
+            min = series[s].values[i];
+        }
+    }
+    *p_max = max;
+    *p_min = min;
+} //range_series
+
+void
+fill_overlay_frame (const struct series series[], size_t count, int len, int height, float min, float max,
+                    enum overlay_collision collision, int scaled[], char drawn[], char frame[])
+{
+    int row_length = len + 1; /* Each row is followed by a newline.*/
+    size_t s;
+    int j;
+    int i;
+    for (j = 0; j < height; j++)
+    {
+        memset(frame + j * row_length, ' ', len);
+        frame[j * row_length + len] = '\n';
+    }
+    memset(drawn, 0, (size_t) height * len);
+    for (s = 0; s < count; s++)
+    {
+        /* Each series quantized on the shared scale, then scattered like fill_frame(); a column of one series
+           has one level, so a cell already drawn belongs to an earlier series.*/
+        scale (series[s].values, scaled, len, height, min, max);
+        for (i = 0; i < len; i++)
+        {
+            if (scaled[i] < 0 || scaled[i] >= height)
+            continue;
+            int row = height - 1 - scaled[i];
+            char * cell = &frame[row * row_length + i];
+            if (!drawn[row * len + i] || collision == COLLISION_LAST)
+            *cell = series[s].symbol;
+            else if (collision == COLLISION_MARK)
+            *cell = COLLISION_SYMBOL;
+            drawn[row * len + i] = 1;
+        }
+    }
+} //fill_overlay_frame
+
+void
+plot_overlay (const struct series series[], size_t count, int len, int height,
+              enum overlay_collision collision, FILE * out, int scaled[], char drawn[], char frame[])
+{
+    float min;
+    float max;
+    range_series (series, count, len, &max, &min);
+    fill_overlay_frame (series, count, len, height, min, max, collision, scaled, drawn, frame);
+    fwrite (frame, 1, (size_t) height * (len + 1), out); /* One write for all series.*/
+    COUNT(bytes_written, (size_t) height * (len + 1));
+} //plot_overlay
+
+#ifdef INSTRUMENT
+/* Names of the probes in the summary. */
+static const char * probe_names[PROBE_COUNT] = { "cosine", "polynomial", "range", "scale", "plot", "plot_buffered" };
+
+uint64_t
+probe_now (void)
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+} //probe_now
+
+uint64_t
+probe_cycles (void)
+{
+#ifdef HAVE_X86_KERNELS
+    return __rdtsc();
+#else
+    return 0;
+#endif
+} //probe_cycles
+
+void
+probe_record (enum probe probe, uint64_t start_ns, uint64_t start_cycles)
+{
+    uint64_t cycles = probe_cycles() - start_cycles;
+    uint64_t ns = probe_now() - start_ns;
+    __atomic_fetch_add(&instrument_totals.calls[probe], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&instrument_totals.ns[probe], ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&instrument_totals.cycles[probe], cycles, __ATOMIC_RELAXED);
+} //probe_record
+
+/* Appends text to line at *used; no stdio, so a signal handler can use it. */
+static void
+dump_text (char line[], size_t * used, const char * text)
+{
+    while (*text)
+    line[(*used)++] = *text++;
+} //dump_text
+
+/* Appends an unsigned number in decimal to line at *used. */
+static void
+dump_number (char line[], size_t * used, uint64_t number)
+{
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = '0' + number % 10;
+        number /= 10;
+    } while (number);
+    while (count)
+    line[(*used)++] = digits[--count];
+} //dump_number
+
+void
+instrument_dump (int fd)
+{
+    char line[256];
+    size_t used;
+    int p;
+    for (p = 0; p < PROBE_COUNT; p++)
+    {
+        uint64_t calls = __atomic_load_n(&instrument_totals.calls[p], __ATOMIC_RELAXED);
+        if (calls == 0)
+        continue;
+        used = 0;
+        dump_text (line, &used, "instrument: ");
+        dump_text (line, &used, probe_names[p]);
+        dump_text (line, &used, " calls ");
+        dump_number (line, &used, calls);
+        dump_text (line, &used, " ns ");
+        dump_number (line, &used, __atomic_load_n(&instrument_totals.ns[p], __ATOMIC_RELAXED));
+        dump_text (line, &used, " cycles ");
+        dump_number (line, &used, __atomic_load_n(&instrument_totals.cycles[p], __ATOMIC_RELAXED));
+        dump_text (line, &used, "\n");
+        if (write(fd, line, used) < 0)
+        return;
+    }
+    used = 0;
+    dump_text (line, &used, "instrument: evaluations ");
+    dump_number (line, &used, __atomic_load_n(&instrument_totals.evaluations, __ATOMIC_RELAXED));
+    dump_text (line, &used, " bytes_written ");
+    dump_number (line, &used, __atomic_load_n(&instrument_totals.bytes_written, __ATOMIC_RELAXED));
+    dump_text (line, &used, " quantize_calls ");
+    dump_number (line, &used, __atomic_load_n(&instrument_totals.quantize_calls, __ATOMIC_RELAXED));
+    dump_text (line, &used, "\n");
+    if (write(fd, line, used) < 0)
+    return;
+} //instrument_dump
+
+void
+instrument_reset (void)
+{
+    memset(&instrument_totals, 0, sizeof(instrument_totals));
+} //instrument_reset
+
+static void
+instrument_at_exit (void)
+{
+    instrument_dump (STDERR_FILENO);
+} //instrument_at_exit
+
+static void
+instrument_on_signal (int signal_number)
+{
+    (void) signal_number;
+    instrument_dump (STDERR_FILENO);
+} //instrument_on_signal
+
+void
+instrument_init (void)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = instrument_on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGUSR1, &action, NULL);
+    atexit (instrument_at_exit);
+} //instrument_init
+#endif
+
+int
+quantizer_init (struct quantizer * quantizer, int levels, float min, float max)
+{
+    float distance_between_min_max = max - min;
+    float value_of_level = distance_between_min_max / levels; /* The step quantize() divides by.*/
+    int k;
+
+    quantizer->min = min;
+    quantizer->top = levels - 1;
+    quantizer->reciprocal = (value_of_level > 0) ? levels / distance_between_min_max : 0;
+    /* A subnormal step has lost the precision that keeps the multiply within a level of the divide.*/
+    quantizer->search = value_of_level > 0 && (value_of_level < FLT_MIN || !(quantizer->reciprocal <= FLT_MAX));
+    quantizer->thresholds = malloc((levels + 1) * sizeof(float));
+    if (!quantizer->thresholds)
+    return -1;
+    quantizer->thresholds[0] = -INFINITY;
+    quantizer->thresholds[levels] = INFINITY;
+    for (k = 1; k < levels; k++)
+    {
+        if (value_of_level <= 0)
+        {
+            quantizer->thresholds[k] = INFINITY; /* An empty range puts everything at level 0.*/
+            continue;
+        }
+        /* The least distance y whose y / value_of_level, rounded to float, reaches k.*/
+        float y = k * value_of_level;
+        while (y / value_of_level >= k)
+        y = nextafterf(y, -INFINITY);
+        while (y / value_of_level < k)
+        y = nextafterf(y, INFINITY);
+        quantizer->thresholds[k] = y;
+    }
+    return 0;
+} //quantizer_init
+
+/* Level of one value: a guess by multiplying, clamped with min and max, then moved by at most one threshold
+   either way; the multiply is within one level of the divide, so this is exactly quantize(). */
+static inline int
+quantize_guess (const struct quantizer * quantizer, float value)
+{
+    float y_value = (double) value - quantizer->min; /* Rounded like quantize() rounds it.*/
+    float guess = y_value * quantizer->reciprocal;
+    guess = (guess > 0) ? guess : 0;
+    guess = (guess < quantizer->top) ? guess : quantizer->top;
+    int level = (int) guess;
+    return level - (y_value < quantizer->thresholds[level]) + (y_value >= quantizer->thresholds[level + 1]);
+} //quantize_guess
+
+/* Level of one value by binary search: the highest k whose threshold the value reaches, for quantizers whose
+   multiply cannot guess. */
+static int
+quantize_search (const struct quantizer * quantizer, float value)
+{
+    float y_value = (double) value - quantizer->min; /* Rounded like quantize() rounds it.*/
+    int low = 0;
+    int high = quantizer->top;
+    while (low < high)
+    {
+        int middle = low + (high - low + 1) / 2;
+        if (y_value >= quantizer->thresholds[middle])
+        low = middle;
+        else
+        high = middle - 1;
+    }
+    return low;
+} //quantize_search
+
+#ifdef HAVE_X86_KERNELS
+/* quantize_guess() on 8 values at once, the thresholds fetched with gathers. */
+__attribute__((target("avx2"))) static inline __m256i
+quantize_guess_avx2 (const struct quantizer * quantizer, const float values[])
+{
+    __m256 value = _mm256_loadu_ps(values);
+    __m256d min = _mm256_set1_pd(quantizer->min);
+    /* Subtracting in double and rounding to float, as quantize() does.*/
+    __m128 low = _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(value)), min));
+    __m128 high = _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(value, 1)), min));
+    __m256 y_value = _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+    __m256 guess = _mm256_mul_ps(y_value, _mm256_set1_ps(quantizer->reciprocal));
+    guess = _mm256_min_ps(_mm256_max_ps(guess, _mm256_setzero_ps()), _mm256_set1_ps(quantizer->top));
+    __m256i level = _mm256_cvttps_epi32(guess);
+    __m256 below = _mm256_i32gather_ps(quantizer->thresholds, level, 4);
+    __m256 above = _mm256_i32gather_ps(quantizer->thresholds + 1, level, 4);
+    /* The compares give -1 where true: adding the first and subtracting the second moves the level.*/
+    level = _mm256_add_epi32(level, _mm256_castps_si256(_mm256_cmp_ps(y_value, below, _CMP_LT_OQ)));
+    return _mm256_sub_epi32(level, _mm256_castps_si256(_mm256_cmp_ps(y_value, above, _CMP_GE_OQ)));
+} //quantize_guess_avx2
 
-    /* Testing example 4.*/
-    int SCREEN_HEIGHT_4 = 7;
-    int SCREEN_WIDTH_4 = 14;
-    
-    float values_4[SCREEN_WIDTH_4];
-    cosine (values_4, SCREEN_WIDTH_4, M_PI_2, 1);
-    printf("Small diagonal lines from top right to bottom left, one below the other and after each other.\n");
-    plot (values_4, '*', SCREEN_WIDTH_4, SCREEN_HEIGHT_4);
-    
-} //testPlot
+/* Narrows 8 levels to 16 bits, in order, in the low half. */
+__attribute__((target("avx2"))) static inline __m128i
+quantize_pack_avx2 (__m256i level)
+{
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(level, level), 0x08));
+} //quantize_pack_avx2
 
-int
-testAll (void)
+__attribute__((target("avx2"))) static size_t
+quantize_batch_u8_avx2 (const struct quantizer * quantizer, const float values[], uint8_t levels_out[], size_t len)
 {
-  int numErrors = 0;
+    size_t i;
+    for (i = 0; i + 8 <= len; i += 8)
+    {
+        __m128i wide = quantize_pack_avx2(quantize_guess_avx2(quantizer, values + i));
+        _mm_storel_epi64((__m128i *) (levels_out + i), _mm_packus_epi16(wide, wide));
+    }
+    return i;
+} //quantize_batch_u8_avx2
 
-  numErrors += testGetX();
-  numErrors += testCosine();
-  numErrors += testPolynomial();
-  numErrors += testRange();
-  numErrors += testQuantize();
-  numErrors += testScale();
-  
-  testPlot(); 
-  
-  if (numErrors==0)
-    printf ("TESTS PASSED\n");
-  else
-    printf ("TOTAL ERRORS: %d\n",numErrors);
-  return numErrors;
+__attribute__((target("avx2"))) static size_t
+quantize_batch_u16_avx2 (const struct quantizer * quantizer, const float values[], uint16_t levels_out[], size_t len)
+{
+    size_t i;
+    for (i = 0; i + 8 <= len; i += 8)
+    _mm_storeu_si128((__m128i *) (levels_out + i), quantize_pack_avx2(quantize_guess_avx2(quantizer, values + i)));
+    return i;
+} //quantize_batch_u16_avx2
+#endif
 
-} //testAll
+void
+quantize_batch_u8 (const struct quantizer * quantizer, const float values[], uint8_t levels_out[], size_t len)
+{
+    size_t i = 0;
+    if (quantizer->search)
+    {
+        for (; i < len; i++)
+        levels_out[i] = quantize_search(quantizer, values[i]);
+        return;
+    }
+    if (active_batch_kernel < 0)
+    batch_kernel_select (KERNEL_AVX2); /* Runtime dispatch on first use.*/
+#ifdef HAVE_X86_KERNELS
+    if (active_batch_kernel == KERNEL_AVX2)
+    i = quantize_batch_u8_avx2 (quantizer, values, levels_out, len);
+#endif
+    for (; i < len; i++)
+    levels_out[i] = quantize_guess(quantizer, values[i]);
+} //quantize_batch_u8
 
-/***************************** FUNCTIONS *****************************/
+void
+quantize_batch_u16 (const struct quantizer * quantizer, const float values[], uint16_t levels_out[], size_t len)
+{
+    size_t i = 0;
+    if (quantizer->search)
+    {
+        for (; i < len; i++)
+        levels_out[i] = quantize_search(quantizer, values[i]);
+        return;
+    }
+    if (active_batch_kernel < 0)
+    batch_kernel_select (KERNEL_AVX2); /* Runtime dispatch on first use.*/
+#ifdef HAVE_X86_KERNELS
+    if (active_batch_kernel == KERNEL_AVX2)
+    i = quantize_batch_u16_avx2 (quantizer, values, levels_out, len);
+#endif
+    for (; i < len; i++)
+    levels_out[i] = quantize_guess(quantizer, values[i]);
+} //quantize_batch_u16
+
+void
+quantizer_free (struct quantizer * quantizer)
+{
+    free(quantizer->thresholds);
+    quantizer->thresholds = NULL;
+} //quantizer_free
 
-/* Main program entry.*/
 int
-main (void)
+render_subcells (enum render_mode mode)
 {
-  #ifdef TESTING
-    return testAll();
-  #endif
+    if (mode == RENDER_BRAILLE)
+    return 4;
+    if (mode == RENDER_HALF_BLOCK)
+    return 2;
+    return 1;
+} //render_subcells
 
-  int SCREEN_HEIGHT = 60;
-  int SCREEN_WIDTH = 80;
+size_t
+render_frame_size (enum render_mode mode, int len, int height)
+{
+    if (mode == RENDER_BRAILLE)
+    return (size_t) height * ((size_t) (len + 1) / 2 * 3 + 1);
+    if (mode == RENDER_HALF_BLOCK)
+    return (size_t) height * ((size_t) len * 3 + 1);
+    return (size_t) height * (len + 1);
+} //render_frame_size
 
-  float values[SCREEN_WIDTH];
+/* Braille dot of each column of a cell at each level in it, bottom first. */
+static const unsigned char braille_dots[2][4] = { { 0x40, 0x04, 0x02, 0x01 }, { 0x80, 0x20, 0x10, 0x08 } };
 
-  cosine (values, SCREEN_WIDTH, 0.15, 0.0);
-  printf("Cosine\n");
-  plot (values, '*', SCREEN_WIDTH, SCREEN_HEIGHT);
-  
-  float cubic[] = {0,1,18,1};  
-  polynomial(cubic, 3, values, SCREEN_WIDTH, 0.375, 20);
-  printf("Cubic\n");
-  plot (values, '*', SCREEN_WIDTH, SCREEN_HEIGHT);
+size_t
+fill_render_frame (const int scaled[], int len, int height, enum render_mode mode, char symbol, char frame[])
+{
+    int subcells = render_subcells(mode);
+    int columns = (mode == RENDER_BRAILLE) ? 2 : 1; /* Columns of values in each cell.*/
+    size_t used = 0;
+    int j;
+    int i;
 
-  return 0;
-} //main
+    if (mode == RENDER_ASCII)
+    {
+        fill_frame (scaled, symbol, len, height, frame);
+        return (size_t) height * (len + 1);
+    }
+    for (j = 0; j < height; j++)
+    {
+        int base = (height - 1 - j) * subcells; /* Level of the bottom of this row.*/
+        for (i = 0; i < len; i += columns)
+        {
+            /* Gathering the levels of the cell's columns that fall in this row into dot bits.*/
+            int bits = 0;
+            int column;
+            for (column = 0; column < columns && i + column < len; column++)
+            {
+                int sub = scaled[i + column] - base;
+                if (sub < 0 || sub >= subcells)
+                continue;
+                bits |= (mode == RENDER_BRAILLE) ? braille_dots[column][sub] : 1 << sub;
+            }
+            if (bits == 0)
+            {
+                frame[used++] = ' ';
+                continue;
+            }
+            /* U+2800 + bits for Braille; U+2584 lower, U+2580 upper half block. UTF-8 in 3 bytes.*/
+            int code = (mode == RENDER_BRAILLE) ? 0x2800 + bits : (bits == 1) ? 0x2584 : 0x2580;
+            frame[used++] = 0xe0 | (code >> 12);
+            frame[used++] = 0x80 | ((code >> 6) & 0x3f);
+            frame[used++] = 0x80 | (code & 0x3f);
+        }
+        frame[used++] = '\n';
+    }
+    return used;
+} //fill_render_frame
 
+void
+plot_render (const float values[], int len, int height, enum render_mode mode, char symbol, FILE * out,
+             int scaled[], char frame[])
+{
+    float min;
+    float max;
+    range (values, len, &max, &min);
+    scale (values, scaled, len, height * render_subcells(mode), min, max);
+    size_t used = fill_render_frame(scaled, len, height, mode, symbol, frame);
+    fwrite (frame, 1, used, out); /* One write for the whole frame.*/
+    COUNT(bytes_written, used);
+} //plot_render
 
-float 
-get_x (int index, float x_scale, float x_shift) 
+/* Returns the number of decimal digits of a positive integer. */
+static size_t
+decimal_digits (long n)
 {
-    float continuous_x_value; 
-    continuous_x_value = (index * x_scale) - x_shift; 
-    /* Using the transformation formula.*/
+    size_t digits = 1;
+    for (; n >= 10; n /= 10)
+    digits++;
+    return digits;
+} //decimal_digits
 
-    return continuous_x_value;
-} //get_x
+int
+diff_init (struct diff_renderer * renderer, int len, int height)
+{
+    /* Each change is a cursor position, \x1b[row;columnH, and its character. The screen is cleared with
+       \x1b[H\x1b[2J before them and the cursor left on row height + 1 after them.*/
+    size_t change_bytes = sizeof("\x1b[;H") - 1 + decimal_digits(height) + decimal_digits(len) + 1;
+    size_t fixed_bytes = sizeof("\x1b[H\x1b[2J") - 1 + sizeof("\x1b[;1H") - 1 + decimal_digits((long) height + 1);
+    int i;
+    renderer->len = len;
+    renderer->height = height;
+    renderer->symbol = 0;
+    renderer->rendered = 0;
+    renderer->previous = malloc(len * sizeof(int));
+    renderer->changes = malloc(2 * (size_t) len * sizeof(int64_t));
+    renderer->output = malloc(2 * (size_t) len * change_bytes + fixed_bytes + 1); /* sprintf() ends with a '\0'.*/
+    if (!renderer->previous || !renderer->changes || !renderer->output)
+    {
+        diff_free (renderer);
+        return -1;
+    }
+    for (i = 0; i < len; i++)
+    renderer->previous[i] = -1;
+    return 0;
+} //diff_init
 
+static int
+compare_changes (const void * a, const void * b)
+{
+    int64_t left = *(const int64_t *) a;
+    int64_t right = *(const int64_t *) b;
+    return (left > right) - (left < right);
+} //compare_changes
 
-void
-cosine (float values[], size_t len, float x_scale, float x_shift)
+size_t
+diff_render (struct diff_renderer * renderer, const int scaled[], char symbol, FILE * out)
 {
-    float value_of_x_after_transformation;
+    int len = renderer->len;
+    int height = renderer->height;
+    int redraw = !renderer->rendered || symbol != renderer->symbol;
+    size_t count = 0;
+    size_t used = 0;
+    size_t k;
     int i;
+
+    if (redraw)
+    {
+        used += sprintf(renderer->output, "\x1b[H\x1b[2J");
+        for (i = 0; i < len; i++)
+        renderer->previous[i] = -1;
+    }
     for (i = 0; i < len; i++)
     {
-        value_of_x_after_transformation = get_x(i, x_scale, x_shift); /* Applying get_x on domain.*/
-        values[i] = cos(value_of_x_after_transformation); 
-        /* Doing cos(x) on new values of domain and storing in values[].*/
+        /* Each changed column blanks its old cell and draws its new one, top row first.*/
+        int old = renderer->previous[i];
+        int level = scaled[i];
+        if (old == level && !redraw)
+        continue;
+        if (old >= 0 && old < height)
+        renderer->changes[count++] = ((int64_t) (height - 1 - old) * len + i) << 8 | ' ';
+        if (level >= 0 && level < height)
+        renderer->changes[count++] = ((int64_t) (height - 1 - level) * len + i) << 8 | (unsigned char) symbol;
+        renderer->previous[i] = level;
     }
-} //cosine
+    renderer->symbol = symbol;
+    renderer->rendered = 1;
+    if (count == 0 && used == 0)
+    return 0;
 
-float
-power_function (float value_of_x_after_transformation, int j)
+    /* Writing the cells in screen order, so neighbours on a row need no cursor move between them.*/
+    qsort (renderer->changes, count, sizeof(int64_t), compare_changes);
+    long cursor_row = -1;
+    long cursor_column = 0;
+    for (k = 0; k < count; k++)
+    {
+        long cell = renderer->changes[k] >> 8;
+        long row = cell / len;
+        long column = cell % len;
+        if (row == cursor_row && column > cursor_column)
+        used += sprintf(renderer->output + used, "\x1b[%ldC", column - cursor_column);
+        else if (row != cursor_row || column != cursor_column)
+        used += sprintf(renderer->output + used, "\x1b[%ld;%ldH", row + 1, column + 1);
+        renderer->output[used++] = renderer->changes[k] & 0xff;
+        /* The cursor moves on after the character, except past the last column where terminals differ.*/
+        cursor_row = (column + 1 < len) ? row : -1;
+        cursor_column = column + 1;
+    }
+    used += sprintf(renderer->output + used, "\x1b[%d;1H", height + 1);
+    fwrite (renderer->output, 1, used, out); /* One write for the whole update.*/
+    COUNT(bytes_written, used);
+    return used;
+} //diff_render
+
+void
+diff_free (struct diff_renderer * renderer)
 {
-    int k;
-    float x_with_power = 1;
-    for (k = 1; k <= j; k++)
-    x_with_power *= value_of_x_after_transformation;
-    return x_with_power;
-} //power_function
+    free(renderer->previous);
+    free(renderer->changes);
+    free(renderer->output);
+    renderer->previous = NULL;
+    renderer->changes = NULL;
+    renderer->output = NULL;
+} //diff_free
 
-float
-f_of_x_of_polynomial (float coeffs[], size_t degree, float value_of_x_after_transformation)
+int
+arena_init (struct arena * arena, size_t size)
 {
-    float sum = 0;
-    int j;
-    for (j= 0; j <= degree; j++)
-    sum += (coeffs[j] * power_function(value_of_x_after_transformation, j)); 
-    return sum; /* sum = c0*(x^0)+ c1*(x^1) + c2*(x^2) + c3*(x^3). */
-} //f_of_x_of_polynomial 
+    arena->used = 0;
+    arena->size = size;
+    arena->base = aligned_alloc(64, (size + 63) / 64 * 64);
+    return arena->base ? 0 : -1;
+} //arena_init
+
+void *
+arena_alloc (struct arena * arena, size_t bytes)
+{
+    size_t start = (arena->used + 63) / 64 * 64;
+    if (start + bytes > arena->size)
+    return NULL;
+    arena->used = start + bytes;
+    return arena->base + start;
+} //arena_alloc
 
 void
-polynomial (float coeffs[], size_t degree, float values[], size_t len,
-            float x_scale, float x_shift )
+arena_reset (struct arena * arena)
 {
-    float value_of_x_after_transformation;
-    int i;
-    for (i = 0; i < len; i++) 
-    {   
-        /* Updating values[i], after the applying the polynomial function to domain. */
-        value_of_x_after_transformation = get_x(i, x_scale, x_shift); /* Applying get_x to domain.*/
-        values[i] = f_of_x_of_polynomial(coeffs, degree, value_of_x_after_transformation); 
-    }
-} //polynomial
+    arena->used = 0;
+} //arena_reset
 
 void
-range (float values[], size_t len, float * p_max, float * p_min)
+arena_free (struct arena * arena)
 {
-    int i;
-    *p_max = values[0]; /* Initializing the content of the pointers.*/
-    *p_min = values[0]; /* Initializing the content of the pointers.*/
-    for (i = 1; i < len ; i++)
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+} //arena_free
+
+/* Reads a width or height with strtol(), setting *p_end after it. Returns -1 when there is no number, it is out of
+   range, it is not between 1 and JOB_MAX_SIZE, or it runs into the next field. */
+static int
+batch_size (const char * text, const char ** p_end)
+{
+    char * end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (end == text || errno == ERANGE || value <= 0 || value > JOB_MAX_SIZE
+        || (*end && !isspace((unsigned char) *end)))
+    return -1;
+    *p_end = end;
+    return value;
+} //batch_size
+
+int
+batch_parse (const char * line, struct plot_job * job)
+{
+    char name[16];
+    int consumed = 0;
+    while (isspace((unsigned char) *line))
+    line++;
+    if (*line == '\0' || *line == '#')
+    return 0;
+    if (sscanf(line, "%15s%n", name, &consumed) != 1)
+    return -1;
+    line += consumed;
+
+    memset(job, 0, sizeof(*job));
+    if (strcmp(name, "cosine") == 0)
+    job->function.kind = FUNCTION_COSINE;
+    else if (strcmp(name, "polynomial") == 0)
     {
-        /* Updating content of pointers to actual max and min by looping through array.*/
-        if (values[i] > *p_max)
-        (*p_max = values[i]); 
-        if (values[i] < *p_min)
-        (*p_min = values[i]);
+        /* The coefficients, lowest power first, separated by commas.*/
+        job->function.kind = FUNCTION_POLYNOMIAL;
+        size_t k = 0;
+        do
+        {
+            char * end;
+            if (k > JOB_MAX_DEGREE)
+            return -1;
+            job->coeffs[k++] = strtof(line, &end);
+            if (end == line)
+            return -1;
+            line = end;
+        } while (*line++ == ',');
+        line--;
+        job->function.degree = k - 1;
     }
-} //range
+    else
+    return -1;
+
+    /* The grid and the sizes, each ended by a space or the end of the line, then an optional one-character symbol.*/
+    char * end;
+    job->x_scale = strtof(line, &end);
+    if (end == line || (*end && !isspace((unsigned char) *end)))
+    return -1;
+    line = end;
+    job->x_shift = strtof(line, &end);
+    if (end == line || (*end && !isspace((unsigned char) *end)))
+    return -1;
+    line = end;
+    if ((job->width = batch_size(line, &line)) < 0 || (job->height = batch_size(line, &line)) < 0)
+    return -1;
+    if ((size_t) job->height * (job->width + 1) > JOB_MAX_FRAME)
+    return -1;
+    while (isspace((unsigned char) *line))
+    line++;
+    job->symbol = *line ? *line++ : '*';
+    while (isspace((unsigned char) *line))
+    line++;
+    if (*line)
+    return -1;
+    job->function.coeffs = job->coeffs;
+    return 1;
+} //batch_parse
 
 int
-quantize (double value, int levels, float min, float max )
+batch_read (FILE * in, struct plot_job ** jobs, size_t * count, size_t * bad_line)
 {
-    float distance_between_min_max;
-    float value_of_level;
-    float y_value;
-    int  level_number;
+    char line[JOB_MAX_LINE + 1];
+    size_t capacity = 0;
+    size_t number = 0;
+    size_t total = 0;
+    *jobs = NULL;
+    *count = 0;
+    *bad_line = 0;
+    while (fgets(line, sizeof(line), in))
+    {
+        number++;
+        /* A line fgets() split would be read as two; only the last line may end without a newline.*/
+        size_t length = strlen(line);
+        if (line[length - 1] != '\n' && !feof(in))
+        {
+            *bad_line = number;
+            break;
+        }
+        if (*count == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 64;
+            struct plot_job * grown = realloc(*jobs, capacity * sizeof(struct plot_job));
+            if (!grown)
+            break;
+            *jobs = grown;
+        }
+        int parsed = batch_parse(line, &(*jobs)[*count]);
+        if (parsed > 0)
+        total += (size_t) (*jobs)[*count].height * ((*jobs)[*count].width + 1);
+        if (parsed < 0 || total > BATCH_MAX_BYTES)
+        {
+            *bad_line = number;
+            break;
+        }
+        *count += parsed;
+    }
+    if (*bad_line || ferror(in) || !feof(in))
+    {
+        free(*jobs);
+        *jobs = NULL;
+        *count = 0;
+        return -1;
+    }
+    return 0;
+} //batch_read
 
-    distance_between_min_max = (max - min); /* Distance between given min and max*/
-    value_of_level = distance_between_min_max / levels; /* Value that makes up each level.*/
-    y_value = (value - min); /* Distance bewteen given value and minimum value.*/
-    level_number = floor(y_value / value_of_level); /* Rounds down to the lowest integer.*/ 
-    if (level_number == levels) /* The returned value has to be between 0 and level-1.*/
+/* The state the batch threads share: the jobs, the counter they take them from, the output, and an arena
+   for each lane. */
+struct batch_run
+{
+    struct plot_job * jobs;
+    size_t count;
+    size_t next;
+    char * output;
+    struct arena arenas[MAX_THREADS];
+};
+
+/* A pool task over lanes: each lane pulls jobs from the shared counter until none are left, with its
+   own arena. Only one thread claims a lane, so no two threads share an arena. */
+static void
+batch_lanes (void * context, size_t begin, size_t end)
+{
+    struct batch_run * run = context;
+    size_t lane;
+    size_t k;
+    for (lane = begin; lane < end; lane++)
     {
-        level_number = (levels-1); 
+        while ((k = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED)) < run->count)
+        {
+            struct plot_job * job = &run->jobs[k];
+            struct arena * arena = &run->arenas[lane];
+            float max;
+            float min;
+            arena_reset (arena);
+            float * values = arena_alloc(arena, job->width * sizeof(float));
+            int * scaled = arena_alloc(arena, job->width * sizeof(int));
+            pipeline_levels (&job->function, job->width, job->x_scale, job->x_shift, job->height, scaled, values,
+                             &max, &min);
+            fill_frame (scaled, job->symbol, job->width, job->height, run->output + job->offset);
+        }
     }
+} //batch_lanes
 
-    return level_number;
-} //quantize
+int
+batch_render (struct plot_job jobs[], size_t count, FILE * out)
+{
+    struct batch_run run = { .jobs = jobs, .count = count };
+    size_t lanes = pool.worker_count + 1;
+    size_t total = 0;
+    size_t widest = 1;
+    size_t k;
+    size_t w;
 
-void
-scale (const float values[], int scaled[], size_t len, size_t height, float min, float max)
+    /* Placing every frame in the output, and sizing the arenas for the widest job.*/
+    for (k = 0; k < count; k++)
+    {
+        size_t frame = (size_t) jobs[k].height * (jobs[k].width + 1);
+        if (frame > JOB_MAX_FRAME || frame > BATCH_MAX_BYTES - total)
+        return -1;
+        jobs[k].function.coeffs = jobs[k].coeffs;
+        jobs[k].offset = total;
+        total += frame;
+        if ((size_t) jobs[k].width > widest)
+        widest = jobs[k].width;
+    }
+    if (lanes > count)
+    lanes = count ? count : 1;
+
+    run.output = malloc(total ? total : 1);
+    if (!run.output)
+    return -1;
+    for (w = 0; w < lanes; w++)
+    {
+        if (arena_init(&run.arenas[w], widest * (sizeof(float) + sizeof(int)) + 128) < 0)
+        break;
+    }
+    if (w < lanes)
+    {
+        while (w--)
+        arena_free (&run.arenas[w]);
+        free(run.output);
+        return -1;
+    }
+
+    /* One lane for each thread of the pool, the calling thread included.*/
+    parallel_run (lanes, 1, batch_lanes, &run);
+
+    fwrite (run.output, 1, total, out); /* Every frame, in job order, in one write.*/
+    COUNT(bytes_written, total);
+    for (w = 0; w < lanes; w++)
+    arena_free (&run.arenas[w]);
+    free(run.output);
+    return 0;
+} //batch_render
+
+/* Folds the samples around index into *p_max and *p_min, evaluated as the generators evaluate them. An estimate
+   of the last index before a critical point is at most an index off, so the two on each side cover the pair.
+   Then, on either side, folds in every further sample whose exact value, in double, is at least high_cut or at
+   most low_cut: where a polynomial is flat its float samples wobble, and one of them may pass the pair. The curve
+   is monotonic away from the pair, so the first sample inside the cuts ends each walk. Returns -1 when the walks
+   take more than *p_budget samples, which counts down. */
+static int
+range_oracle_visit (const struct function_spec * function, size_t len, float x_scale, float x_shift,
+                    double index, double high_cut, double low_cut, size_t * p_budget, float * p_max, float * p_min)
 {
-    int i;
-    for (i = 0; i < len; i++)
+    if (!(index >= 0)) /* Also NaN.*/
+    index = 0;
+    if (index > len)
+    index = len;
+    long first = (long) floor(index) - 1;
+    long last = first + 3;
+    long i;
+    long step;
+    if (first < 0)
+    first = 0;
+    if (last > (long) len - 1)
+    last = (long) len - 1;
+    for (step = -1; step <= 1; step += 2)
     {
-        /* Updating array, scaled[], by looping through each value in the array.*/
-        scaled[i] = quantize(values[i], height, min, max); 
+        for (i = (step < 0) ? last : last + 1; i >= 0 && i < (long) len; i += step)
+        {
+            float x = get_x(i, x_scale, x_shift);
+            if (i < first || i > last)
+            {
+                double exact = 0;
+                if (function->kind == FUNCTION_COSINE)
+                break;
+                size_t k;
+                for (k = function->degree + 1; k-- > 0;)
+                exact = exact * x + function->coeffs[k];
+                if (!(exact >= high_cut || exact <= low_cut))
+                break;
+                if (*p_budget == 0)
+                return -1;
+                --*p_budget;
+            }
+            float value = (function->kind == FUNCTION_COSINE) ? cos(x)
+                          : polynomial_eval(function->coeffs, function->degree, x, POLY_HORNER);
+            COUNT(evaluations, 1);
+            if (value > *p_max)
+            *p_max = value;
+            if (value < *p_min)
+            *p_min = value;
+        }
     }
-} //scale
+    return 0;
+} //range_oracle_visit
 
-void
-plot (const float values[], char symbol, int len, int height)
+int
+range_oracle (const struct function_spec * function, size_t len, float x_scale, float x_shift,
+              float * p_max, float * p_min)
 {
-    float min;
-    float max;
-    range (values, len, &max, &min);
-    int scaled_values[len];
-    scale(values, scaled_values, len, height, min, max);
-    
-    for (int j = (height- 1); j >= 0; j--)
+    double first_x = get_x(0, x_scale, x_shift);
+    double last_x = get_x(len - 1, x_scale, x_shift);
+    double low = fmin(first_x, last_x);
+    double high = fmax(first_x, last_x);
+    double roots[2];
+    int root_count = 0;
+    double high_cut = INFINITY;
+    double low_cut = -INFINITY;
+    size_t budget = len / 4;
+    double turn;
+    int pass;
+    int k;
+
+    if (len == 0 || (function->kind == FUNCTION_POLYNOMIAL && function->degree > 3))
+    return -1;
+    if (!isfinite(low) || !isfinite(high))
+    return -1;
+    for (k = 0; function->kind == FUNCTION_POLYNOMIAL && k <= (int) function->degree; k++)
     {
-        for (int i = 0; i < len; i++)
+        if (!isfinite(function->coeffs[k])) /* NaN samples would leave range() with whatever came first.*/
+        return -1;
+    }
+    if (function->kind == FUNCTION_COSINE)
+    {
+        /* The critical points k*pi strictly inside the window.*/
+        double first_k = floor(low / M_PI) + 1;
+        double last_k = ceil(high / M_PI) - 1;
+        double count = last_k - first_k + 1;
+        if (count > RANGE_ORACLE_LIMIT || 4 * count + 2 >= len || fmax(-low, high) >= 0x1p52) /* Past 2^52, k + 1 == k.*/
+        return -1;
+    }
+    else if (function->degree >= 2)
+    {
+        /* The roots of the derivative c1 + 2 c2 x + 3 c3 x^2, found in double.*/
+        double c1 = function->coeffs[1];
+        double c2 = function->coeffs[2];
+        double c3 = (function->degree == 3) ? function->coeffs[3] : 0;
+        if (c3 == 0 && c2 != 0)
+        roots[root_count++] = -c1 / (2 * c2);
+        else if (c3 != 0)
         {
-            if (scaled_values[i] == j)
-            printf("%c", symbol);
-            else
-            printf(" ");
+            double discriminant = 4 * c2 * c2 - 12 * c3 * c1;
+            if (discriminant >= 0)
+            {
+                /* The stable pair of the quadratic formula.*/
+                double q = -(2 * c2 + copysign(sqrt(discriminant), c2)) / 2;
+                roots[root_count++] = q / (3 * c3);
+                if (q != 0)
+                roots[root_count++] = c1 / q;
+            }
         }
-        printf("\n");
     }
-} //plot
+
+    /* The pairs at both ends and around each critical point; for a polynomial of degree 2 or 3 a second pass
+       walks out from them through the samples that rounding could lift past the max or drop below the min.*/
+    for (pass = 0; pass < 2; pass++)
+    {
+        *p_max = -INFINITY;
+        *p_min = INFINITY;
+        if (range_oracle_visit (function, len, x_scale, x_shift, 1, high_cut, low_cut, &budget, p_max, p_min) < 0
+            || range_oracle_visit (function, len, x_scale, x_shift, (double) len - 2, high_cut, low_cut, &budget,
+                                   p_max, p_min) < 0)
+        return -1;
+        if (x_scale == 0)
+        return 0;
+        if (function->kind == FUNCTION_COSINE)
+        {
+            for (turn = floor(low / M_PI) + 1; turn * M_PI < high; turn++)
+            range_oracle_visit (function, len, x_scale, x_shift, (turn * M_PI + x_shift) / x_scale,
+                                high_cut, low_cut, &budget, p_max, p_min);
+            return 0;
+        }
+        for (k = 0; k < root_count; k++)
+        {
+            if (roots[k] > low && roots[k] < high
+                && range_oracle_visit (function, len, x_scale, x_shift, (roots[k] + x_shift) / x_scale,
+                                       high_cut, low_cut, &budget, p_max, p_min) < 0)
+            return -1;
+        }
+        if (function->degree < 2 || pass == 1)
+        return 0;
+
+        /* Horner's rule in float is off by at most gamma(2 degree) * sum |c_k| |x|^k, and the double values of
+           the walks by far less, so only a sample whose exact value is within that of the max or min found so
+           far can pass it.*/
+        double reach = fmax(fabs(low), fabs(high));
+        double unit = 0x1p-24;
+        double gamma = 2 * function->degree * unit / (1 - 2 * function->degree * unit);
+        double size = 0;
+        for (k = (int) function->degree; k >= 0; k--)
+        size = size * reach + fabs(function->coeffs[k]);
+        double error = 2 * (gamma * size + 2 * function->degree * FLT_TRUE_MIN); /* Underflow adds to each step.*/
+        if (!(size < FLT_MAX / 2)) /* A step of Horner's rule could overflow, and inf - inf give a NaN sample.*/
+        return -1;
+        high_cut = *p_max - error;
+        low_cut = *p_min + error;
+    }
+    return 0;
+} //range_oracle
+
+void
+cosine_ranged (float values[], size_t len, float x_scale, float x_shift, float * p_max, float * p_min)
+{
+    struct function_spec cosine_function = { FUNCTION_COSINE, NULL, 0 };
+    cosine (values, len, x_scale, x_shift);
+    if (range_oracle(&cosine_function, len, x_scale, x_shift, p_max, p_min) < 0)
+    range (values, len, p_max, p_min);
+} //cosine_ranged
+
+void
+polynomial_ranged (const float coeffs[], size_t degree, float values[], size_t len, float x_scale, float x_shift,
+                   float * p_max, float * p_min)
+{
+    struct function_spec function = { FUNCTION_POLYNOMIAL, coeffs, degree };
+    polynomial ((float *) coeffs, degree, values, len, x_scale, x_shift);
+    if (range_oracle(&function, len, x_scale, x_shift, p_max, p_min) < 0)
+    range (values, len, p_max, p_min);
+} //polynomial_ranged
+
+q16
+q16_from_double (double value)
+{
+    double scaled = nearbyint(value * Q16_ONE);
+    if (!(scaled == scaled)) /* NaN.*/
+    return 0;
+    if (scaled >= INT32_MAX)
+    return INT32_MAX;
+    if (scaled <= INT32_MIN)
+    return INT32_MIN;
+    return (q16) scaled;
+} //q16_from_double
+
+double
+q16_to_double (q16 value)
+{
+    return value / (double) Q16_ONE;
+} //q16_to_double
+
+/* The operations DEFINE_NUMERIC_CORE builds on, one set per type: converting, get_x, Horner's step, cos() and the
+   level of a value. Each is static inline so the instantiation compiles to the type's own instructions. */
+
+static inline float numeric_from_double_f32 (double value) { return value; }
+static inline float numeric_x_f32 (size_t index, float x_scale, float x_shift) { return index * x_scale - x_shift; }
+static inline float numeric_horner_f32 (float sum, float x, float coeff) { return sum * x + coeff; }
+static inline float numeric_cos_f32 (float x) { return cosf(x); }
+static inline void numeric_prepare_f32 (void) { }
+
+static inline double numeric_from_double_f64 (double value) { return value; }
+static inline double numeric_x_f64 (size_t index, double x_scale, double x_shift) { return index * x_scale - x_shift; }
+static inline double numeric_horner_f64 (double sum, double x, double coeff) { return sum * x + coeff; }
+static inline double numeric_cos_f64 (double x) { return cos(x); }
+static inline void numeric_prepare_f64 (void) { }
+
+/* The level of value by the rules of quantize(), in the floating-point type T with floor function FLOOR. */
+#define DEFINE_FLOATING_LEVEL(S, T, FLOOR) \
+static inline int \
+numeric_level_##S (T value, int levels, T min, T max) \
+{ \
+    T value_of_level = (max - min) / levels; \
+    if (value_of_level == 0) \
+    return 0; \
+    T quotient = FLOOR((value - min) / value_of_level); \
+    if (!(quotient > INT_MIN && quotient < INT_MAX)) \
+    return -1; \
+    int level_number = quotient; \
+    if (level_number == levels || (level_number > levels && value <= max)) \
+    level_number = levels - 1; \
+    return level_number; \
+}
+
+DEFINE_FLOATING_LEVEL(f32, float, floorf)
+DEFINE_FLOATING_LEVEL(f64, double, floor)
+
+/* Clamps a 64-bit intermediate into a q16. */
+static inline q16
+q16_saturate (int64_t value)
+{
+    return (value > INT32_MAX) ? INT32_MAX : (value < INT32_MIN) ? INT32_MIN : (q16) value;
+} //q16_saturate
+
+/* cos(2*pi*k/1024) in q16 for k in 0..1024, the last entry repeating the first. */
+#define Q16_COSINE_BITS 10
+static q16 q16_cosine_table[(1 << Q16_COSINE_BITS) + 1];
+static pthread_once_t q16_cosine_once = PTHREAD_ONCE_INIT;
+
+static void
+q16_cosine_init (void)
+{
+    int k;
+    for (k = 0; k <= 1 << Q16_COSINE_BITS; k++)
+    q16_cosine_table[k] = q16_from_double(cos(2 * M_PI * k / (1 << Q16_COSINE_BITS)));
+} //q16_cosine_init
+
+static inline q16 numeric_from_double_q16 (double value) { return q16_from_double(value); }
+static inline void numeric_prepare_q16 (void) { pthread_once (&q16_cosine_once, q16_cosine_init); }
+
+static inline q16
+numeric_x_q16 (size_t index, q16 x_scale, q16 x_shift)
+{
+    /* The index is an integer, so index * x_scale is already in q16; only the range needs checking.*/
+    return q16_saturate((int64_t) index * x_scale - x_shift);
+} //numeric_x_q16
+
+static inline q16
+numeric_horner_q16 (q16 sum, q16 x, q16 coeff)
+{
+    int64_t product = ((int64_t) sum * x + Q16_ONE / 2) >> 16; /* Rounded to the nearest q16.*/
+    return q16_saturate(q16_saturate(product) + (int64_t) coeff);
+} //numeric_horner_q16
+
+static inline q16
+numeric_cos_q16 (q16 x)
+{
+    /* x times 2^32 / 2pi is the angle in turns with 48 fraction bits; the low 32 of those are the turn modulo one,
+       the top bits of which pick the table entry and the rest interpolate.*/
+    uint32_t turn = (uint32_t) (((int64_t) x * 683565276) >> 16);
+    uint32_t k = turn >> (32 - Q16_COSINE_BITS);
+    int64_t weight = (turn >> (16 - Q16_COSINE_BITS)) & 0xFFFF;
+    q16 low = q16_cosine_table[k];
+    return low + (q16) (((q16_cosine_table[k + 1] - low) * weight) >> 16);
+} //numeric_cos_q16
+
+static inline int
+numeric_level_q16 (q16 value, int levels, q16 min, q16 max)
+{
+    /* (value - min) * levels / (max - min) in integers, rounded down: exact, where floats round twice.*/
+    int64_t distance = (int64_t) max - min;
+    int64_t offset = (int64_t) value - min;
+    if (distance == 0)
+    return 0;
+    int64_t numerator = offset * levels;
+    int64_t level_number = numerator / distance;
+    if (numerator % distance != 0 && numerator < 0)
+    level_number--;
+    if (level_number == levels)
+    level_number = levels - 1;
+    return level_number;
+} //numeric_level_q16
+
+/* The numeric core over T, from the operations numeric_*_S above; see DECLARE_NUMERIC_CORE. */
+#define DEFINE_NUMERIC_CORE(S, T) \
+void \
+numeric_evaluate_##S (const struct function_spec * function, T values[], size_t len, T x_scale, T x_shift) \
+{ \
+    T coeffs[NUMERIC_MAX_DEGREE + 1]; \
+    size_t degree = function->degree; \
+    size_t i; \
+    size_t k; \
+    numeric_prepare_##S(); \
+    if (function->kind == FUNCTION_COSINE) \
+    { \
+        for (i = 0; i < len; i++) \
+        values[i] = numeric_cos_##S(numeric_x_##S(i, x_scale, x_shift)); \
+        return; \
+    } \
+    if (degree > NUMERIC_MAX_DEGREE) \
+    { \
+        /* Too many coefficients for the array: converting each one as Horner's rule reaches it.*/ \
+        for (i = 0; i < len; i++) \
+        { \
+            T x = numeric_x_##S(i, x_scale, x_shift); \
+            T sum = numeric_from_double_##S(function->coeffs[degree]); \
+            for (k = degree; k > 0; k--) \
+            sum = numeric_horner_##S(sum, x, numeric_from_double_##S(function->coeffs[k - 1])); \
+            values[i] = sum; \
+        } \
+        return; \
+    } \
+    for (k = 0; k <= degree; k++) \
+    coeffs[k] = numeric_from_double_##S(function->coeffs[k]); \
+    for (i = 0; i < len; i++) \
+    { \
+        T x = numeric_x_##S(i, x_scale, x_shift); \
+        T sum = coeffs[degree]; \
+        for (k = degree; k > 0; k--) \
+        sum = numeric_horner_##S(sum, x, coeffs[k - 1]); \
+        values[i] = sum; \
+    } \
+} \
+\
+void \
+numeric_range_##S (const T values[], size_t len, T * p_max, T * p_min) \
+{ \
+    T max; \
+    T min; \
+    size_t i; \
+    if (len == 0) \
+    return; \
+    max = values[0]; \
+    min = values[0]; \
+    for (i = 1; i < len; i++) \
+    { \
+        if (values[i] > max) \
+        max = values[i]; \
+        if (values[i] < min) \
+        min = values[i]; \
+    } \
+    *p_max = max; \
+    *p_min = min; \
+} \
+\
+void \
+numeric_scale_##S (const T values[], int scaled[], size_t len, size_t height, T min, T max) \
+{ \
+    size_t i; \
+    for (i = 0; i < len; i++) \
+    scaled[i] = numeric_level_##S(values[i], height, min, max); \
+} \
+\
+void \
+numeric_levels_##S (const struct function_spec * function, size_t len, double x_scale, double x_shift, \
+                    size_t height, int levels[], T values[], T * p_max, T * p_min) \
+{ \
+    if (len == 0) \
+    return; \
+    numeric_evaluate_##S (function, values, len, numeric_from_double_##S(x_scale), numeric_from_double_##S(x_shift)); \
+    numeric_range_##S (values, len, p_max, p_min); \
+    numeric_scale_##S (values, levels, len, height, *p_min, *p_max); \
+}
+
+DEFINE_NUMERIC_CORE(f32, float)
+DEFINE_NUMERIC_CORE(f64, double)
+DEFINE_NUMERIC_CORE(q16, q16)